@@ -506,7 +506,7 @@ ms_dri2_schedule_flip(ms_dri2_frame_event_ptr info)
                        drmmode_crtc->vblank_pipe, FALSE,
                        ms_dri2_flip_handler,
                        ms_dri2_flip_abort,
-                       "DRI2-flip"))
+                       "DRI2-flip", 0, 0))
     {
         pDrmMode->dri2_flipping = TRUE;
         return TRUE;
@@ -65,6 +65,7 @@
 #include "loongson_shadow.h"
 #include "loongson_entity.h"
 #include "loongson_exa.h"
+#include "loongson_rotation.h"
 #include "loongson_glamor.h"
 #include "loongson_scanout.h"
 #include "loongson_prime.h"
@@ -77,6 +78,9 @@
 #include "loongson_modeset.h"
 #include "loongson_blt.h"
 #include "loongson_dri2.h"
+#include "loongson_dri2_damage.h"
+#include "loongson_video.h"
+#include "loongson_stats.h"
 
 #if HAVE_LIBDRM_GSGPU
 #include "gsgpu_dri2.h"
@@ -202,13 +206,14 @@ static void msBlockHandler(ScreenPtr pScreen, void *timeout)
 
     if (pScreen->isGPU)
     {
-        xf86DrvMsg(X_INFO, pScrn->scrnIndex,
-                   "%s IS GPU, dispatch dirty\n", __func__);
+        DEBUG_MSG("IS GPU, dispatch dirty");
         LS_DispatchSlaveDirty(pScreen);
     }
 
     if (pDrmMode->exa_shadow_enabled)
         loongson_dispatch_dirty(pScreen);
+
+    LS_StatsBlockHandler(pScreen);
 }
 
 
@@ -282,6 +287,7 @@ static void FreeRec(ScrnInfoPtr pScrn)
 
     pScrn->driverPrivate = NULL;
 
+    drmmode_overlay_planes_fini(pDrmMode);
     LS_FreeOptions(pScrn, &pDrmMode->Options);
     free(lsp);
 }
@@ -771,6 +777,33 @@ static Bool PreInit(ScrnInfoPtr pScrn, int flags)
     xf86DrvMsg(pScrn->scrnIndex, X_CONFIG,
         "PageFlip %s enabled.\n", pDrmMode->pageflip ? "is" : "is NOT");
 
+    pDrmMode->swap_damage = xf86ReturnOptValBool(pDrmMode->Options,
+                                                 OPTION_SWAP_DAMAGE,
+                                                 TRUE);
+    if (pDrmMode->swap_damage)
+    {
+        xf86DrvMsg(pScrn->scrnIndex, X_CONFIG,
+                   "DRI2 swaps only copy and damage the tiles that changed.\n");
+    }
+
+    pDrmMode->fast_startup = xf86ReturnOptValBool(pDrmMode->Options,
+                                                  OPTION_FAST_STARTUP,
+                                                  FALSE);
+    if (pDrmMode->fast_startup)
+    {
+        xf86DrvMsg(pScrn->scrnIndex, X_CONFIG,
+                   "Fast startup is enabled.\n");
+    }
+
+    pDrmMode->vrr_support = xf86ReturnOptValBool(pDrmMode->Options,
+                                                 OPTION_VARIABLE_REFRESH,
+                                                 FALSE);
+    if (pDrmMode->vrr_support)
+    {
+        xf86DrvMsg(pScrn->scrnIndex, X_CONFIG,
+                   "Variable refresh rate is enabled.\n");
+    }
+
     pScrn->capabilities = 0;
     if (is_prime_supported)
     {
@@ -887,6 +920,18 @@ static Bool PreInit(ScrnInfoPtr pScrn, int flags)
     return FALSE;
 }
 
+static void LS_StartupPhase(ScrnInfoPtr pScrn,
+                            const char *phase,
+                            CARD64 *pStart)
+{
+    CARD64 now = GetTimeInMicros();
+
+    xf86DrvMsg(pScrn->scrnIndex, X_INFO, "Startup: %s took %llu us\n",
+               phase, (unsigned long long) (now - *pStart));
+
+    *pStart = now;
+}
+
 /*
  * Adjust the screen pixmap for the current location of the front buffer.
  * This is done at EnterVT when buffers are bound as long as the resources
@@ -901,21 +946,34 @@ static Bool LS_CreateScreenResources(ScreenPtr pScreen)
     struct DrmModeBO * const pFront = pDrmMode->front_bo;
     void *pixels = NULL;
     PixmapPtr pRootPixmap;
+    CARD64 start = GetTimeInMicros();
+    CARD64 phase = start;
     Bool ret;
     int err;
 
     xf86Msg(X_INFO, "\n");
     xf86Msg(X_INFO, "-------- %s stated --------\n", __func__);
 
+    /* Fault the front bo in while the modeset below waits for the hw */
+    if (pDrmMode->fast_startup && pFront->dumb)
+    {
+        LS_MapFrontBOAsync(pScrn, lsp->fd, pFront);
+    }
+
     pScreen->CreateScreenResources = lsp->createScreenResources;
     ret = pScreen->CreateScreenResources(pScreen);
     pScreen->CreateScreenResources = LS_CreateScreenResources;
 
+    LS_StartupPhase(pScrn, "screen resources", &phase);
+
     if (!loongson_set_desired_modes(pScrn, pDrmMode, pScrn->is_gpu))
     {
+        LS_MapFrontBOFinish(pScrn, lsp->fd, pFront);
         return FALSE;
     }
 
+    LS_StartupPhase(pScrn, "modeset", &phase);
+
 #ifdef GLAMOR_HAS_GBM
     if (pDrmMode->glamor_enabled)
     {
@@ -928,20 +986,26 @@ static Bool LS_CreateScreenResources(ScreenPtr pScreen)
 
     drmmode_uevent_init(pScrn, pDrmMode);
 
-    if (pDrmMode->sw_cursor == FALSE)
+    /* With FastStartup the cursor is mapped when it is first loaded */
+    if ((pDrmMode->sw_cursor == FALSE) && !pDrmMode->fast_startup)
     {
         LS_MapCursorBO(pScrn, pDrmMode);
         xf86DrvMsg(pScrn->scrnIndex, X_INFO,
                    "Hardware cursor enabled, mapping it\n");
     }
 
+    LS_StartupPhase(pScrn, "uevent and cursor setup", &phase);
+
     if (pFront->dumb)
     {
-        pixels = LS_MapFrontBO(pScrn, lsp->fd, pFront);
+        /* Only waits for the helper thread, if any */
+        pixels = LS_MapFrontBOFinish(pScrn, lsp->fd, pFront);
         if (!pixels)
         {
             return FALSE;
         }
+
+        LS_StartupPhase(pScrn, "front bo mapping", &phase);
     }
 
     if (pDrmMode->shadow_enable || pDrmMode->exa_shadow_enabled)
@@ -1040,6 +1104,9 @@ static Bool LS_CreateScreenResources(ScreenPtr pScreen)
 
     LS_InitRandR(pScreen);
 
+    LS_StartupPhase(pScrn, "damage and randr", &phase);
+    LS_StartupPhase(pScrn, "CreateScreenResources", &start);
+
     xf86Msg(X_INFO, "-------- %s finished --------\n", __func__);
     xf86Msg(X_INFO, "\n");
 
@@ -1134,6 +1201,75 @@ static Bool CreateWindow_oneshot(WindowPtr pWin)
     return ret;
 }
 
+/*
+ * Forget the flipping window once it is unmapped or gone, see
+ * ls_present_check_flip. Nothing unflips a DRI2 client, so this is
+ * also where the VRR it asked for gets switched off.
+ */
+static void LS_ForgetFlipWindow(ScrnInfoPtr pScrn, WindowPtr pWin)
+{
+    loongsonPtr lsp = loongsonPTR(pScrn);
+    struct drmmode_rec * const pDrmMode = &lsp->drmmode;
+
+    if (pDrmMode->flip_window == pWin->drawable.id)
+        pDrmMode->flip_window = None;
+
+    if (pDrmMode->vrr_window == pWin->drawable.id)
+        drmmode_set_screen_vrr(pScrn, FALSE);
+}
+
+static Bool LS_DestroyWindow(WindowPtr pWin)
+{
+    ScreenPtr pScreen = pWin->drawable.pScreen;
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+    loongsonPtr lsp = loongsonPTR(pScrn);
+    Bool ret;
+
+    LS_ForgetFlipWindow(pScrn, pWin);
+
+    pScreen->DestroyWindow = lsp->DestroyWindow;
+    ret = pScreen->DestroyWindow(pWin);
+    lsp->DestroyWindow = pScreen->DestroyWindow;
+    pScreen->DestroyWindow = LS_DestroyWindow;
+
+    return ret;
+}
+
+static Bool LS_UnrealizeWindow(WindowPtr pWin)
+{
+    ScreenPtr pScreen = pWin->drawable.pScreen;
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+    loongsonPtr lsp = loongsonPTR(pScrn);
+    Bool ret;
+
+    LS_ForgetFlipWindow(pScrn, pWin);
+
+    pScreen->UnrealizeWindow = lsp->UnrealizeWindow;
+    ret = pScreen->UnrealizeWindow(pWin);
+    lsp->UnrealizeWindow = pScreen->UnrealizeWindow;
+    pScreen->UnrealizeWindow = LS_UnrealizeWindow;
+
+    return ret;
+}
+
+/* The DRI2 swap checksums only hold for as long as the window's clip */
+static void LS_ClipNotify(WindowPtr pWin, int dx, int dy)
+{
+    ScreenPtr pScreen = pWin->drawable.pScreen;
+    loongsonPtr lsp = loongsonPTR(xf86ScreenToScrn(pScreen));
+
+    if (lsp->drmmode.swap_damage)
+        LS_DRI2SwapInvalidate(pWin);
+
+    if (lsp->ClipNotify)
+    {
+        pScreen->ClipNotify = lsp->ClipNotify;
+        pScreen->ClipNotify(pWin, dx, dy);
+        lsp->ClipNotify = pScreen->ClipNotify;
+        pScreen->ClipNotify = LS_ClipNotify;
+    }
+}
+
 
 //
 // When ScreenInit() phase is done the common level will determine
@@ -1322,7 +1458,15 @@ static Bool ScreenInit(ScreenPtr pScreen, int argc, char **argv)
     else
     {
         struct DrmModeBO *pFrontBO = pDrmMode->front_bo;
-        void *pixels = LS_MapFrontBO(pScrn, lsp->fd, pFrontBO);
+        void *pixels = NULL;
+
+        /*
+         * With FastStartup the front bo is mapped on a helper thread in
+         * LS_CreateScreenResources, which then points the screen pixmap
+         * at it.
+         */
+        if (!pDrmMode->fast_startup || !pFrontBO->dumb)
+            pixels = LS_MapFrontBO(pScrn, lsp->fd, pFrontBO);
 
         xf86DrvMsg(pScrn->scrnIndex, X_INFO, "Init fb layer\n");
 
@@ -1362,6 +1506,10 @@ static Bool ScreenInit(ScreenPtr pScreen, int argc, char **argv)
 
     fbPictureInit(pScreen, NULL, 0);
 
+    /* Glamor rotates on the GPU, the CPU paths get the SIMD rotate blits */
+    if (!pDrmMode->glamor_enabled)
+        loongson_rotation_screen_init(pScreen);
+
 #ifdef GLAMOR_HAS_GBM
     if (pDrmMode->glamor_enabled)
     {
@@ -1427,7 +1575,8 @@ static Bool ScreenInit(ScreenPtr pScreen, int argc, char **argv)
      * later memory should be bound when allocating, e.g rotate_mem */
     pScrn->vtSema = TRUE;
 
-    if ((serverGeneration == 1) && bgNoneRoot && pDrmMode->glamor_enabled)
+    if ((serverGeneration == 1) && bgNoneRoot &&
+        (pDrmMode->glamor_enabled || pDrmMode->front_bo->dumb))
     {
         lsp->CreateWindow = pScreen->CreateWindow;
         pScreen->CreateWindow = CreateWindow_oneshot;
@@ -1447,6 +1596,17 @@ static Bool ScreenInit(ScreenPtr pScreen, int argc, char **argv)
     lsp->BlockHandler = pScreen->BlockHandler;
     pScreen->BlockHandler = LS_BlockHandler_Oneshot;
 
+    lsp->DestroyWindow = pScreen->DestroyWindow;
+    pScreen->DestroyWindow = LS_DestroyWindow;
+
+    lsp->UnrealizeWindow = pScreen->UnrealizeWindow;
+    pScreen->UnrealizeWindow = LS_UnrealizeWindow;
+
+    lsp->ClipNotify = pScreen->ClipNotify;
+    pScreen->ClipNotify = LS_ClipNotify;
+
+    LS_StatsInit(pScreen);
+
     // pixmap sharing infrastructure
     //
     // This is a hooks for pixmap sharing and tracking.
@@ -1505,6 +1665,14 @@ static Bool ScreenInit(ScreenPtr pScreen, int argc, char **argv)
     }
 #endif
 
+    /* glamor brings its own textured video adaptor */
+    if (!pDrmMode->glamor_enabled)
+    {
+        if (!LS_VideoScreenInit(pScreen))
+            xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+                       "Failed to initialize the overlay Xv adaptor.\n");
+    }
+
     if (pDrmMode->exa_enabled == TRUE)
     {
         if (!LS_InitExaLayer(pScreen))
@@ -1526,6 +1694,13 @@ static Bool ScreenInit(ScreenPtr pScreen, int argc, char **argv)
         return FALSE;
     }
 
+    /* Atoms don't survive a server regeneration, look it up every time */
+    if (pDrmMode->vrr_support)
+    {
+        pDrmMode->vrr_atom = MakeAtom("_VARIABLE_REFRESH",
+                                      sizeof("_VARIABLE_REFRESH") - 1, TRUE);
+    }
+
 #ifdef GLAMOR_HAS_GBM
     if (pDrmMode->glamor_enabled)
     {
@@ -1710,6 +1885,9 @@ static Bool CloseScreen(ScreenPtr pScreen)
 
     LS_EntityClearAssignedCrtc(pScrn);
 
+    LS_StatsDump(pScreen);
+    LS_StatsFini(pScreen);
+
     if (pDrmMode->dri2_enable)
     {
         if (pDrmMode->exa_acc_type == EXA_ACCEL_TYPE_GSGPU)
@@ -1728,13 +1906,19 @@ static Bool CloseScreen(ScreenPtr pScreen)
 
     ms_vblank_close_screen(pScreen);
 
+    LS_VideoCloseScreen(pScreen);
+
+    loongson_rotation_close_screen(pScreen);
+
     loongson_damage_destroy(pScreen, &lsp->damage);
     lsp->dirty_enabled = FALSE;
+    LS_FreeDirtyClips(pScrn);
 
     if (pDrmMode->shadow_enable)
     {
         lsp->shadow.Remove(pScreen, pScreen->GetScreenPixmap(pScreen));
 
+        LS_ShadowFlipFini(pScreen);
         LS_ShadowFreeFB(pScrn, &pDrmMode->shadow_fb);
     }
 
@@ -1768,6 +1952,9 @@ static Bool CloseScreen(ScreenPtr pScreen)
 
     pScreen->CreateScreenResources = lsp->createScreenResources;
     pScreen->BlockHandler = lsp->BlockHandler;
+    pScreen->DestroyWindow = lsp->DestroyWindow;
+    pScreen->UnrealizeWindow = lsp->UnrealizeWindow;
+    pScreen->ClipNotify = lsp->ClipNotify;
     pScreen->CloseScreen = lsp->CloseScreen;
 
     return (*pScreen->CloseScreen) (pScreen);
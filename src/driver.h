@@ -37,6 +37,7 @@
 #include <xf86drm.h>
 #include <xf86Crtc.h>
 #include <damage.h>
+#include <picturestr.h>
 #include <shadow.h>
 
 #if HAVE_LIBDRM_ETNAVIV
@@ -50,6 +51,7 @@
 #endif
 
 #include "drmmode_display.h"
+#include "loongson_sync.h"
 
 struct LoongsonRec {
     int fd;
@@ -78,9 +80,16 @@ struct LoongsonRec {
 
     CloseScreenProcPtr CloseScreen;
     CreateWindowProcPtr CreateWindow;
+    DestroyWindowProcPtr DestroyWindow;
+    UnrealizeWindowProcPtr UnrealizeWindow;
+    ClipNotifyProcPtr ClipNotify;
 
     CreateScreenResourcesProcPtr createScreenResources;
     ScreenBlockHandlerProcPtr BlockHandler;
+    /* Frame timing of this screen's crtcs, see loongson_stats.c */
+    struct ls_screen_stats *stats;
+    /* Wrapped for the rotated shadow updates, see loongson_rotation.c */
+    CompositeProcPtr Composite;
     miPointerSpriteFuncPtr SpriteFuncs;
     void *driver;
     char *render_node;
@@ -98,6 +107,12 @@ struct LoongsonRec {
 
     DamagePtr damage;
     Bool dirty_enabled;
+    /* Merge buffer for DirtyFB, and how many clips the kernel takes */
+    drmModeClip *dirty_clips;
+    unsigned int dirty_clips_size;
+    unsigned int dirty_max_clips;
+    /* Most clips the device accepted so far, the limit never goes below */
+    unsigned int dirty_clips_ok;
     Bool shadow_present;
 
     uint32_t cursor_width, cursor_height;
@@ -108,6 +123,9 @@ struct LoongsonRec {
     Bool kms_has_modifiers;
 
 
+    /* Xv adaptor, see loongson_video.c */
+    struct ls_video *video;
+
     /* EXA API */
     ExaDriverPtr exaDrvPtr;
 
@@ -124,6 +124,9 @@ Bool drmmode_xf86crtc_resize(ScrnInfoPtr pScrn, int width, int height)
 
     pDrmMode->fb_id = 0;
 
+    /* The pitch of the front bo changes with it */
+    drmmode_crtc_config_changed(pDrmMode);
+
     if (pDrmMode->glamor_enabled)
     {
 #ifdef GLAMOR_HAS_GBM
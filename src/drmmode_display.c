@@ -33,6 +33,7 @@
 
 #include <errno.h>
 #include <sys/mman.h>
+#include <poll.h>
 #include <unistd.h>
 #include <malloc.h>
 
@@ -42,6 +43,8 @@
 #include <drm_fourcc.h>
 #include <xf86drm.h>
 #include <cursorstr.h>
+#include <property.h>
+#include <propertyst.h>
 
 #include "driver.h"
 #include "drmmode_display.h"
@@ -60,6 +63,8 @@
 
 #include "loongson_buffer.h"
 #include "loongson_rotation.h"
+#include "loongson_blt.h"
+#include "loongson_usdt.h"
 
 #if HAVE_LIBDRM_GSGPU
 #include "gsgpu_bo_helper.h"
@@ -131,6 +136,102 @@ Bool drmmode_is_format_supported(ScrnInfoPtr scrn, uint32_t format, uint64_t mod
 }
 
 
+/*
+ * Union of the formats the primary planes of all crtcs can scan out.
+ * The caller owns the returned array.
+ */
+uint32_t drmmode_get_formats(ScrnInfoPtr scrn, uint32_t **formats)
+{
+    xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(scrn);
+    uint32_t count = 0;
+    uint32_t *ret = NULL;
+    int c;
+    uint32_t i, k;
+
+    for (c = 0; c < xf86_config->num_crtc; c++) {
+        drmmode_crtc_private_ptr drmmode_crtc = xf86_config->crtc[c]->driver_private;
+
+        for (i = 0; i < drmmode_crtc->num_formats; i++) {
+            uint32_t format = drmmode_crtc->formats[i].format;
+            uint32_t *tmp;
+
+            for (k = 0; k < count; k++) {
+                if (ret[k] == format)
+                    break;
+            }
+            if (k < count)
+                continue;
+
+            tmp = realloc(ret, (count + 1) * sizeof(uint32_t));
+            if (!tmp) {
+                free(ret);
+                *formats = NULL;
+                return 0;
+            }
+            ret = tmp;
+            ret[count++] = format;
+        }
+    }
+
+    *formats = ret;
+    return count;
+}
+
+/*
+ * Union of the modifiers the primary planes accept for @format, taken
+ * from the IN_FORMATS blob. The caller owns the returned array.
+ */
+uint32_t drmmode_get_modifiers(ScrnInfoPtr scrn, uint32_t format,
+                               uint64_t **modifiers, Bool enabled_crtc_only)
+{
+    xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(scrn);
+    uint32_t count = 0;
+    uint64_t *ret = NULL;
+    int c;
+    uint32_t i, j, k;
+
+    /* BO are imported as opaque surface, so let's pretend there is no alpha */
+    format = get_opaque_format(format);
+
+    for (c = 0; c < xf86_config->num_crtc; c++) {
+        xf86CrtcPtr crtc = xf86_config->crtc[c];
+        drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+
+        if (enabled_crtc_only && !crtc->enabled)
+            continue;
+
+        for (i = 0; i < drmmode_crtc->num_formats; i++) {
+            drmmode_format_ptr iter = &drmmode_crtc->formats[i];
+
+            if (iter->format != format)
+                continue;
+
+            for (j = 0; j < iter->num_modifiers; j++) {
+                uint64_t *tmp;
+
+                for (k = 0; k < count; k++) {
+                    if (ret[k] == iter->modifiers[j])
+                        break;
+                }
+                if (k < count)
+                    continue;
+
+                tmp = realloc(ret, (count + 1) * sizeof(uint64_t));
+                if (!tmp) {
+                    free(ret);
+                    *modifiers = NULL;
+                    return 0;
+                }
+                ret = tmp;
+                ret[count++] = iter->modifiers[j];
+            }
+        }
+    }
+
+    *modifiers = ret;
+    return count;
+}
+
 static uint64_t
 drmmode_prop_get_value(drmmode_prop_info_ptr info,
                        drmModeObjectPropertiesPtr props,
@@ -329,13 +430,43 @@ plane_add_prop(drmModeAtomicReq *req, drmmode_crtc_private_ptr drmmode_crtc,
     return (ret <= 0) ? -1 : 0;
 }
 
+static uint64_t
+drmmode_rotation_to_kernel(Rotation rotation)
+{
+    uint64_t value = 0;
+
+    switch (rotation & RR_Rotate_MASK)
+    {
+        case RR_Rotate_90: value = DRM_MODE_ROTATE_90; break;
+        case RR_Rotate_180: value = DRM_MODE_ROTATE_180; break;
+        case RR_Rotate_270: value = DRM_MODE_ROTATE_270; break;
+        default: value = DRM_MODE_ROTATE_0; break;
+    }
+
+    if (rotation & RR_Reflect_X)
+        value |= DRM_MODE_REFLECT_X;
+    if (rotation & RR_Reflect_Y)
+        value |= DRM_MODE_REFLECT_Y;
+
+    return value;
+}
+
 static int
 plane_add_props(drmModeAtomicReq *req, xf86CrtcPtr crtc,
                 uint32_t fb_id, int x, int y)
 {
     drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+    int src_w = crtc->mode.HDisplay;
+    int src_h = crtc->mode.VDisplay;
     int ret = 0;
 
+    /* A plane rotated by 90 or 270 degrees reads a transposed rectangle */
+    if (drmmode_crtc->plane_rotation & (RR_Rotate_90 | RR_Rotate_270))
+    {
+        src_w = crtc->mode.VDisplay;
+        src_h = crtc->mode.HDisplay;
+    }
+
     ret |= plane_add_prop(req, drmmode_crtc, DRMMODE_PLANE_FB_ID,
                           fb_id);
     ret |= plane_add_prop(req, drmmode_crtc, DRMMODE_PLANE_CRTC_ID,
@@ -343,9 +474,9 @@ plane_add_props(drmModeAtomicReq *req, xf86CrtcPtr crtc,
     ret |= plane_add_prop(req, drmmode_crtc, DRMMODE_PLANE_SRC_X, x << 16);
     ret |= plane_add_prop(req, drmmode_crtc, DRMMODE_PLANE_SRC_Y, y << 16);
     ret |= plane_add_prop(req, drmmode_crtc, DRMMODE_PLANE_SRC_W,
-                          crtc->mode.HDisplay << 16);
+                          src_w << 16);
     ret |= plane_add_prop(req, drmmode_crtc, DRMMODE_PLANE_SRC_H,
-                          crtc->mode.VDisplay << 16);
+                          src_h << 16);
     ret |= plane_add_prop(req, drmmode_crtc, DRMMODE_PLANE_CRTC_X, 0);
     ret |= plane_add_prop(req, drmmode_crtc, DRMMODE_PLANE_CRTC_Y, 0);
     ret |= plane_add_prop(req, drmmode_crtc, DRMMODE_PLANE_CRTC_W,
@@ -353,6 +484,11 @@ plane_add_props(drmModeAtomicReq *req, xf86CrtcPtr crtc,
     ret |= plane_add_prop(req, drmmode_crtc, DRMMODE_PLANE_CRTC_H,
                           crtc->mode.VDisplay);
 
+    /* Always sent, so leaving hw rotation resets the plane to rotate-0 */
+    if (drmmode_crtc->props_plane[DRMMODE_PLANE_ROTATION].prop_id)
+        ret |= plane_add_prop(req, drmmode_crtc, DRMMODE_PLANE_ROTATION,
+                              drmmode_rotation_to_kernel(drmmode_crtc->plane_rotation));
+
     return ret;
 }
 
@@ -858,6 +994,69 @@ static void *drmmode_bo_map(drmmode_ptr drmmode, drmmode_bo *bo)
     return NULL;
 }
 
+static void
+drmmode_SharedPixmapFenceNotify(int fd, int ready, void *data)
+{
+    PixmapPtr ppix = data;
+    ScrnInfoPtr scrn = xf86ScreenToScrn(ppix->drawable.pScreen);
+    drmmode_ptr drmmode = &loongsonPTR(scrn)->drmmode;
+    msPixmapPrivPtr ppriv = msGetPixmapPriv(drmmode, ppix);
+    xf86CrtcPtr crtc = ppriv->fence_crtc;
+
+    RemoveNotifyFd(fd);
+    ppriv->fence_wait = FALSE;
+
+    LS_CopySlaveBO(drmmode, ppix, NULL);
+
+    if (!drmmode_SharedPixmapFlip(ppix, crtc, drmmode))
+        drmmode_SharedPixmapPresentOnVBlank(ppix, crtc, drmmode);
+}
+
+void
+drmmode_SharedPixmapCancelFenceWait(PixmapPtr ppix, drmmode_ptr drmmode)
+{
+    msPixmapPrivPtr ppriv;
+
+    if (!ppix)
+        return;
+
+    ppriv = msGetPixmapPriv(drmmode, ppix);
+    if (ppriv->fence_wait) {
+        RemoveNotifyFd(ppriv->prime_fd);
+        ppriv->fence_wait = FALSE;
+    }
+}
+
+/*
+ * Flip to a shared pixmap the source has just presented on, once the
+ * source GPU is done rendering it: a dma-buf polls readable when its
+ * write fences have signalled. Until then the server keeps running and
+ * the flip is queued from the notify fd handler.
+ */
+static Bool
+drmmode_SharedPixmapFlipWhenIdle(PixmapPtr ppix, xf86CrtcPtr crtc,
+                                 drmmode_ptr drmmode)
+{
+    msPixmapPrivPtr ppriv = msGetPixmapPriv(drmmode, ppix);
+
+    if (ppriv->has_prime_fd) {
+        struct pollfd pfd = { .fd = ppriv->prime_fd, .events = POLLIN };
+
+        if (poll(&pfd, 1, 0) == 0) {
+            ppriv->fence_crtc = crtc;
+            ppriv->fence_wait = SetNotifyFd(ppriv->prime_fd,
+                                            drmmode_SharedPixmapFenceNotify,
+                                            X_NOTIFY_READ, ppix);
+            if (ppriv->fence_wait)
+                return TRUE;
+        }
+    }
+
+    LS_CopySlaveBO(drmmode, ppix, NULL);
+
+    return drmmode_SharedPixmapFlip(ppix, crtc, drmmode);
+}
+
 static Bool
 drmmode_SharedPixmapPresent(PixmapPtr ppix, xf86CrtcPtr crtc,
                             drmmode_ptr drmmode)
@@ -866,7 +1065,7 @@ drmmode_SharedPixmapPresent(PixmapPtr ppix, xf86CrtcPtr crtc,
 
     if (primary->PresentSharedPixmap(ppix)) {
         /* Success, queue flip to back target */
-        if (drmmode_SharedPixmapFlip(ppix, crtc, drmmode))
+        if (drmmode_SharedPixmapFlipWhenIdle(ppix, crtc, drmmode))
             return TRUE;
 
         xf86DrvMsg(drmmode->scrn->scrnIndex, X_WARNING,
@@ -1037,6 +1236,7 @@ drmmode_crtc_dpms(xf86CrtcPtr crtc, int mode)
     /* XXX Check if DPMS mode is already the right one */
 
     drmmode_crtc->dpms_mode = mode;
+    drmmode_crtc_config_changed(drmmode);
 
     xf86DrvMsg(pScrn->scrnIndex, X_INFO,
                "%s: dpms mode=%d\n", __func__, mode);
@@ -1100,15 +1300,107 @@ out_free_fb:
 }
 #endif
 
+/*
+ * No glamor: map the fbcon fb and copy it into the front bo with the CPU,
+ * plus into the shadow the screen pixmap renders to, if there is one.
+ */
+static Bool drmmode_copy_fb_cpu(ScrnInfoPtr pScrn,
+                                drmmode_ptr drmmode,
+                                int fbcon_id)
+{
+    struct DrmModeBO *pFront = drmmode->front_bo;
+    struct drm_mode_map_dumb map_arg;
+    struct drm_gem_close close_arg;
+    drmModeFBPtr fbcon;
+    uint8_t *src, *dst[2] = { NULL, NULL };
+    uint32_t dst_pitch;
+    size_t size;
+    int width, height;
+    int y, i;
+    Bool ret = FALSE;
+
+    if (!pFront || !pFront->dumb)
+        return FALSE;
+
+    fbcon = drmModeGetFB(drmmode->fd, fbcon_id);
+    if (fbcon == NULL)
+        return FALSE;
+
+    /* Newer kernels only give the handle out to CAP_SYS_ADMIN */
+    if (!fbcon->handle || (fbcon->bpp != pScrn->bitsPerPixel))
+        goto out_free_fb;
+
+    memset(&map_arg, 0, sizeof(map_arg));
+    map_arg.handle = fbcon->handle;
+    if (drmIoctl(drmmode->fd, DRM_IOCTL_MODE_MAP_DUMB, &map_arg))
+        goto out_close;
+
+    size = (size_t) fbcon->pitch * fbcon->height;
+    src = mmap(NULL, size, PROT_READ, MAP_SHARED, drmmode->fd,
+               map_arg.offset);
+    if (src == MAP_FAILED)
+        goto out_close;
+
+    dst[0] = dumb_bo_cpu_addr(pFront->dumb);
+    if (drmmode->shadow_enable || drmmode->exa_shadow_enabled)
+        dst[1] = drmmode->shadow_fb;
+    /* The screen pixmap uses the front bo's pitch for the shadow too */
+    dst_pitch = dumb_bo_pitch(pFront->dumb);
+
+    width = min(fbcon->width, pScrn->virtualX);
+    height = min(fbcon->height, pScrn->virtualY);
+
+    /* fbcon is usually in uncached vram, read it only once */
+    for (y = 0; y < height; y++)
+    {
+        const uint8_t *line = src + y * fbcon->pitch;
+
+        for (i = 0; i < 2; i++)
+        {
+            if (dst[i])
+                loongson_blt(dst[i] + y * dst_pitch, line,
+                             width * fbcon->bpp / 8);
+        }
+    }
+
+    /* Don't show garbage where fbcon was smaller than the screen */
+    for (i = 0; i < 2; i++)
+    {
+        if (!dst[i])
+            continue;
+
+        if (width < pScrn->virtualX)
+        {
+            for (y = 0; y < height; y++)
+                memset(dst[i] + y * dst_pitch + width * fbcon->bpp / 8, 0,
+                       (pScrn->virtualX - width) * fbcon->bpp / 8);
+        }
+
+        for (y = height; y < pScrn->virtualY; y++)
+            memset(dst[i] + y * dst_pitch, 0,
+                   pScrn->virtualX * fbcon->bpp / 8);
+    }
+
+    munmap(src, size);
+
+    ret = TRUE;
+
+out_close:
+    memset(&close_arg, 0, sizeof(close_arg));
+    close_arg.handle = fbcon->handle;
+    drmIoctl(drmmode->fd, DRM_IOCTL_GEM_CLOSE, &close_arg);
+out_free_fb:
+    drmModeFreeFB(fbcon);
+
+    return ret;
+}
+
 void
 drmmode_copy_fb(ScrnInfoPtr pScrn, drmmode_ptr drmmode)
 {
-#ifdef GLAMOR_HAS_GBM
     xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(pScrn);
     ScreenPtr pScreen = xf86ScrnToScreen(pScrn);
-    PixmapPtr src, dst;
     int fbcon_id = 0;
-    GCPtr gc;
     int i;
 
     for (i = 0; i < xf86_config->num_crtc; i++) {
@@ -1129,26 +1421,42 @@ drmmode_copy_fb(ScrnInfoPtr pScrn, drmmode_ptr drmmode)
         return;
     }
 
-    src = create_pixmap_for_fbcon(drmmode, pScrn, fbcon_id);
-    if (!src)
-        return;
+#ifdef GLAMOR_HAS_GBM
+    if (drmmode->glamor_enabled)
+    {
+        PixmapPtr src, dst;
+        GCPtr gc;
+
+        src = create_pixmap_for_fbcon(drmmode, pScrn, fbcon_id);
+        if (!src)
+            return;
 
-    dst = pScreen->GetScreenPixmap(pScreen);
+        dst = pScreen->GetScreenPixmap(pScreen);
 
-    gc = GetScratchGC(pScrn->depth, pScreen);
-    ValidateGC(&dst->drawable, gc);
+        gc = GetScratchGC(pScrn->depth, pScreen);
+        ValidateGC(&dst->drawable, gc);
 
-    (*gc->ops->CopyArea)(&src->drawable, &dst->drawable, gc, 0, 0,
-                         pScrn->virtualX, pScrn->virtualY, 0, 0);
+        (*gc->ops->CopyArea)(&src->drawable, &dst->drawable, gc, 0, 0,
+                             pScrn->virtualX, pScrn->virtualY, 0, 0);
 
-    FreeScratchGC(gc);
+        FreeScratchGC(gc);
 
-    pScreen->canDoBGNoneRoot = TRUE;
+        pScreen->canDoBGNoneRoot = TRUE;
 
-    if (drmmode->fbcon_pixmap)
-        pScrn->pScreen->DestroyPixmap(drmmode->fbcon_pixmap);
-    drmmode->fbcon_pixmap = NULL;
+        if (drmmode->fbcon_pixmap)
+            pScrn->pScreen->DestroyPixmap(drmmode->fbcon_pixmap);
+        drmmode->fbcon_pixmap = NULL;
+
+        return;
+    }
 #endif
+
+    if (drmmode_copy_fb_cpu(pScrn, drmmode, fbcon_id))
+    {
+        xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+                   "Copied the console fb %d into the front bo\n", fbcon_id);
+        pScreen->canDoBGNoneRoot = TRUE;
+    }
 }
 
 
@@ -1204,6 +1512,43 @@ static const char *rotation_to_str(Rotation rotation)
     }
 }
 
+/*
+ * Whether the primary plane can scan out the front buffer with 'rotation'
+ * applied, instead of the server rendering into a rotated shadow.
+ */
+static Bool drmmode_crtc_can_rotate(xf86CrtcPtr crtc, Rotation rotation)
+{
+    loongsonPtr lsp = loongsonPTR(crtc->scrn);
+    drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+
+    if (!lsp->atomic_modeset || crtc->transformPresent)
+        return FALSE;
+
+    if (!drmmode_crtc->props_plane[DRMMODE_PLANE_ROTATION].prop_id)
+        return FALSE;
+
+    if (rotation == RR_Rotate_0)
+        return FALSE;
+
+    return (rotation & ~drmmode_crtc->plane_rotations) == 0;
+}
+
+static void drmmode_crtc_use_plane_rotation(xf86CrtcPtr crtc, Bool use)
+{
+    drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+
+    if (use)
+    {
+        drmmode_crtc->plane_rotation = crtc->rotation;
+        crtc->driverIsPerformingTransform |= XF86DriverTransformOutput;
+    }
+    else
+    {
+        drmmode_crtc->plane_rotation = RR_Rotate_0;
+        crtc->driverIsPerformingTransform &= ~XF86DriverTransformOutput;
+    }
+}
+
 /*
  * drmmode_set_mode_major() is the only user of drmmode->fb_id and will
  * create it if necessary.
@@ -1221,16 +1566,29 @@ Bool drmmode_set_mode_major(xf86CrtcPtr crtc,
     drmmode_ptr drmmode = drmmode_crtc->drmmode;
     char outputs[128];
     int saved_x, saved_y;
-    Rotation saved_rotation;
+    Rotation saved_rotation, saved_plane_rotation;
+    int saved_transform;
     DisplayModeRec saved_mode;
     Bool ret = TRUE;
     Bool can_test;
+    Bool hw_rotate;
     int i;
 
+    LS_PROBE3(set_mode_major_entry,
+              mode ? mode->HDisplay : 0, mode ? mode->VDisplay : 0, rotation);
+
+    /* The cursor gets reloaded after the modeset, always pass it on */
+    drmmode_crtc->cursor_set_handle = 0;
+
     saved_mode = crtc->mode;
     saved_x = crtc->x;
     saved_y = crtc->y;
     saved_rotation = crtc->rotation;
+    saved_plane_rotation = drmmode_crtc->plane_rotation;
+    saved_transform = crtc->driverIsPerformingTransform;
+
+    /* Rotation, pitch and scanout formats may all change below */
+    drmmode_crtc_config_changed(drmmode);
 
     xf86DrvMsg(pScrn->scrnIndex, X_INFO,
                "%s: saved mode: %s, %d, %d, rotation: %s\n",
@@ -1247,6 +1605,15 @@ Bool drmmode_set_mode_major(xf86CrtcPtr crtc,
                    "%s: mode to be set: %s, pos: (%d, %d), rotation: %s\n",
                    __func__, mode->name, x, y, rotation_to_str(rotation));
 
+        /*
+         * With XF86DriverTransformOutput set, xf86CrtcRotate() frees the
+         * shadow instead of allocating one and the primary plane's
+         * rotation property does the transform, see plane_add_props().
+         */
+        hw_rotate = drmmode_crtc_can_rotate(crtc, rotation);
+ retry:
+        drmmode_crtc_use_plane_rotation(crtc, hw_rotate);
+
         if (!xf86CrtcRotate(crtc))
         {
             xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
@@ -1263,6 +1630,16 @@ Bool drmmode_set_mode_major(xf86CrtcPtr crtc,
         can_test = drmmode_crtc_can_test_mode(crtc);
         if (drmmode_crtc_set_mode(crtc, can_test))
         {
+            /* The plane advertised the transform but refused this mode */
+            if (hw_rotate)
+            {
+                xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+                           "%s: plane rotation rejected, using shadow\n",
+                           __func__);
+                hw_rotate = FALSE;
+                goto retry;
+            }
+
             xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
                        "%s: failed to set mode: %s\n", __func__, strerror(errno));
             ret = FALSE;
@@ -1312,6 +1689,8 @@ Bool drmmode_set_mode_major(xf86CrtcPtr crtc,
         crtc->y = saved_y;
         crtc->rotation = saved_rotation;
         crtc->mode = saved_mode;
+        drmmode_crtc->plane_rotation = saved_plane_rotation;
+        crtc->driverIsPerformingTransform = saved_transform;
     }
     else
     {
@@ -1326,6 +1705,8 @@ Bool drmmode_set_mode_major(xf86CrtcPtr crtc,
 
     xf86Msg(X_INFO, "\n");
 
+    LS_PROBE1(set_mode_major_return, ret);
+
     return ret;
 }
 
@@ -1336,13 +1717,140 @@ static void drmmode_set_cursor_colors(xf86CrtcPtr crtc, int bg, int fg)
 }
 
 
-static void
-drmmode_set_cursor_position(xf86CrtcPtr crtc, int x, int y)
+static int drmmode_cursor_move_commit(xf86CrtcPtr crtc);
+
+/*
+ * The legacy cursor ioctls keep their own copy of the position, which
+ * drmModeSetCursor2 puts the new image at. Atomic moves don't update it,
+ * so every legacy move goes through here to know whether it is current.
+ */
+static void drmmode_cursor_move_legacy(xf86CrtcPtr crtc, int x, int y)
 {
     drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
     drmmode_ptr drmmode = drmmode_crtc->drmmode;
 
     drmModeMoveCursor(drmmode->fd, drmmode_crtc->mode_crtc->crtc_id, x, y);
+    drmmode_crtc->cursor_legacy_stale = FALSE;
+}
+
+/*
+ * A cursor plane commit in flight makes a flip on the same CRTC fail
+ * with EBUSY, so while anyone flips the cursor goes the legacy way.
+ */
+static Bool
+drmmode_cursor_may_commit(xf86CrtcPtr crtc)
+{
+    drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+    drmmode_ptr drmmode = drmmode_crtc->drmmode;
+
+    return drmmode_crtc->cursor_plane_id &&
+           !drmmode_crtc->flipping_active &&
+           !drmmode->present_flipping &&
+           !drmmode->dri2_flipping &&
+           !drmmode->shadow_flip_enable;
+}
+
+static void drmmode_cursor_move_handler(uint64_t msc, uint64_t usec, void *data)
+{
+    xf86CrtcPtr crtc = data;
+    drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+
+    drmmode_crtc->cursor_move_pending = FALSE;
+
+    if (!drmmode_crtc->cursor_move_queued)
+        return;
+
+    drmmode_crtc->cursor_move_queued = FALSE;
+
+    /* Only the latest position of this frame matters */
+    if (!drmmode_cursor_may_commit(crtc) || drmmode_cursor_move_commit(crtc))
+        drmmode_cursor_move_legacy(crtc, drmmode_crtc->cursor_x,
+                                   drmmode_crtc->cursor_y);
+}
+
+static void drmmode_cursor_move_abort(void *data)
+{
+    xf86CrtcPtr crtc = data;
+    drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+
+    drmmode_crtc->cursor_move_pending = FALSE;
+    drmmode_crtc->cursor_move_queued = FALSE;
+}
+
+/*
+ * Move the cursor plane with a non-blocking commit. Its completion event
+ * tells us when the next position may go out.
+ */
+static int drmmode_cursor_move_commit(xf86CrtcPtr crtc)
+{
+    drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+    drmmode_ptr drmmode = drmmode_crtc->drmmode;
+    drmmode_prop_info_ptr props = drmmode_crtc->props_cursor;
+    drmModeAtomicReq *req;
+    uint32_t seq;
+    int ret = 0;
+
+    if (drmmode_crtc->dpms_mode != DPMSModeOn)
+        return -EINVAL;
+
+    req = drmModeAtomicAlloc();
+    if (!req)
+        return -ENOMEM;
+
+    seq = ms_drm_queue_alloc(crtc, crtc, drmmode_cursor_move_handler,
+                             drmmode_cursor_move_abort);
+    if (!seq) {
+        drmModeAtomicFree(req);
+        return -ENOMEM;
+    }
+
+    if (drmModeAtomicAddProperty(req, drmmode_crtc->cursor_plane_id,
+                                 props[DRMMODE_PLANE_CRTC_X].prop_id,
+                                 (int64_t) drmmode_crtc->cursor_x) <= 0 ||
+        drmModeAtomicAddProperty(req, drmmode_crtc->cursor_plane_id,
+                                 props[DRMMODE_PLANE_CRTC_Y].prop_id,
+                                 (int64_t) drmmode_crtc->cursor_y) <= 0)
+        ret = -ENOMEM;
+
+    if (ret == 0)
+        ret = drmModeAtomicCommit(drmmode->fd, req,
+                                  DRM_MODE_ATOMIC_NONBLOCK |
+                                  DRM_MODE_PAGE_FLIP_EVENT,
+                                  (void *) (uintptr_t) seq);
+
+    drmModeAtomicFree(req);
+
+    if (ret) {
+        ms_drm_abort_seq(crtc->scrn, seq);
+        return ret;
+    }
+
+    drmmode_crtc->cursor_move_pending = TRUE;
+    drmmode_crtc->cursor_legacy_stale = TRUE;
+
+    return 0;
+}
+
+static void
+drmmode_set_cursor_position(xf86CrtcPtr crtc, int x, int y)
+{
+    drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+
+    if (drmmode_cursor_may_commit(crtc)) {
+        drmmode_crtc->cursor_x = x;
+        drmmode_crtc->cursor_y = y;
+
+        /* A commit is in flight, its event sends the latest position */
+        if (drmmode_crtc->cursor_move_pending) {
+            drmmode_crtc->cursor_move_queued = TRUE;
+            return;
+        }
+
+        if (drmmode_cursor_move_commit(crtc) == 0)
+            return;
+    }
+
+    drmmode_cursor_move_legacy(crtc, x, y);
 }
 
 
@@ -1360,6 +1868,17 @@ drmmode_set_cursor(xf86CrtcPtr crtc)
         return TRUE;
     }
 
+    /* The kernel shows this image with this hotspot already */
+    if ((drmmode_crtc->cursor_set_handle == handle) &&
+        (drmmode_crtc->cursor_set_xhot == cursor->bits->xhot) &&
+        (drmmode_crtc->cursor_set_yhot == cursor->bits->yhot))
+        return TRUE;
+
+    /* Or the new image shows up where the last legacy move left it */
+    if (drmmode_crtc->cursor_legacy_stale)
+        drmmode_cursor_move_legacy(crtc, drmmode_crtc->cursor_x,
+                                   drmmode_crtc->cursor_y);
+
     ret = drmModeSetCursor2(drmmode->fd, drmmode_crtc->mode_crtc->crtc_id,
                             handle, ms->cursor_width, ms->cursor_height,
                             cursor->bits->xhot, cursor->bits->yhot);
@@ -1381,19 +1900,91 @@ drmmode_set_cursor(xf86CrtcPtr crtc)
         drmmode_crtc->drmmode->sw_cursor = TRUE;
     }
 
-    if (ret)
+    if (ret) {
+        drmmode_crtc->cursor_set_handle = 0;
         /* fallback to swcursor */
         return FALSE;
+    }
+
+    drmmode_crtc->cursor_set_handle = handle;
+    drmmode_crtc->cursor_set_xhot = cursor->bits->xhot;
+    drmmode_crtc->cursor_set_yhot = cursor->bits->yhot;
+
     return TRUE;
 }
 
 static void drmmode_hide_cursor(xf86CrtcPtr crtc);
 
-/*
- * The load_cursor_argb_check driver hook.
- *
- * Sets the hardware cursor by calling the drmModeSetCursor2 ioctl.
- * On failure, returns FALSE indicating that the X server should fall
+/* FNV-1a, a hit still gets compared, see drmmode_load_cursor_argb_check */
+static uint64_t drmmode_cursor_hash(const CARD32 *image, int count)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        hash ^= image[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+/*
+ * Pick the slot for a new cursor image: an empty one (allocating its bo),
+ * else the least recently used one which is not on screen right now.
+ */
+static struct drmmode_cursor_slot *
+drmmode_cursor_cache_evict(xf86CrtcPtr crtc)
+{
+    loongsonPtr ms = loongsonPTR(crtc->scrn);
+    drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+    struct drmmode_cursor_slot *lru = NULL;
+    int i;
+
+    for (i = 0; i < DRMMODE_CURSOR_CACHE_SIZE; i++)
+    {
+        struct drmmode_cursor_slot *slot = &drmmode_crtc->cursor_cache[i];
+
+        if (!slot->bo)
+        {
+            slot->bo = dumb_bo_create(ms->fd, ms->cursor_width,
+                                      ms->cursor_height, 32);
+            if (slot->bo)
+                return slot;
+            break;
+        }
+
+        if (!slot->valid)
+            return slot;
+
+        if (slot->bo == drmmode_crtc->cursor_bo)
+            continue;
+
+        if (!lru || (slot->last_used < lru->last_used))
+            lru = slot;
+    }
+
+    /* Out of memory or a single slot, overwrite the one on screen */
+    if (!lru)
+    {
+        for (i = 0; i < DRMMODE_CURSOR_CACHE_SIZE; i++)
+        {
+            if (drmmode_crtc->cursor_cache[i].bo == drmmode_crtc->cursor_bo)
+                return &drmmode_crtc->cursor_cache[i];
+        }
+    }
+
+    return lru;
+}
+
+/*
+ * The load_cursor_argb_check driver hook.
+ *
+ * Every crtc keeps the last few cursor images in their own bos, so going
+ * back to a recent cursor only switches the bo handed to the kernel.
+ * Sets the hardware cursor by calling the drmModeSetCursor2 ioctl.
+ * On failure, returns FALSE indicating that the X server should fall
  * back to software cursors.
  */
 static Bool
@@ -1401,14 +1992,50 @@ drmmode_load_cursor_argb_check(xf86CrtcPtr crtc, CARD32 *image)
 {
     loongsonPtr ms = loongsonPTR(crtc->scrn);
     drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+    int count = ms->cursor_width * ms->cursor_height;
+    struct drmmode_cursor_slot *slot = NULL;
+    uint64_t hash;
     int i;
-    uint32_t *ptr;
 
-    /* cursor should be mapped already */
-    ptr = (uint32_t *) dumb_bo_cpu_addr(drmmode_crtc->cursor_bo);
+    hash = drmmode_cursor_hash(image, count);
+
+    for (i = 0; i < DRMMODE_CURSOR_CACHE_SIZE; i++)
+    {
+        struct drmmode_cursor_slot *tmp = &drmmode_crtc->cursor_cache[i];
+
+        /* Valid slots are mapped, rule out a collision on the pixels */
+        if (tmp->valid && (tmp->hash == hash) &&
+            !memcmp(dumb_bo_cpu_addr(tmp->bo), image, count * 4))
+        {
+            slot = tmp;
+            break;
+        }
+    }
+
+    if (!slot)
+    {
+        slot = drmmode_cursor_cache_evict(crtc);
+        if (!slot)
+            return FALSE;
+
+        slot->valid = FALSE;
+
+        /* Rewriting what the kernel shows, some drivers only look at set */
+        if (dumb_bo_handle(slot->bo) == drmmode_crtc->cursor_set_handle)
+            drmmode_crtc->cursor_set_handle = 0;
+
+        /* Mapped at startup, or here on first use with FastStartup */
+        if (dumb_bo_map(ms->fd, slot->bo))
+            return FALSE;
+
+        loongson_blt(dumb_bo_cpu_addr(slot->bo), image, count * 4);
+
+        slot->hash = hash;
+        slot->valid = TRUE;
+    }
 
-    for (i = 0; i < ms->cursor_width * ms->cursor_height; i++)
-        ptr[i] = image[i];      // cpu_to_le32(image[i]);
+    slot->last_used = ++drmmode_crtc->cursor_tick;
+    drmmode_crtc->cursor_bo = slot->bo;
 
     if (drmmode_crtc->cursor_up)
         return drmmode_set_cursor(crtc);
@@ -1423,6 +2050,7 @@ drmmode_hide_cursor(xf86CrtcPtr crtc)
     drmmode_ptr drmmode = drmmode_crtc->drmmode;
 
     drmmode_crtc->cursor_up = FALSE;
+    drmmode_crtc->cursor_set_handle = 0;
     drmModeSetCursor(drmmode->fd, drmmode_crtc->mode_crtc->crtc_id, 0,
                      ms->cursor_width, ms->cursor_height);
 }
@@ -1645,6 +2273,8 @@ static void drmmode_crtc_destroy(xf86CrtcPtr crtc)
         return;
 
     drmmode_prop_info_free(drmmode_crtc->props_plane, DRMMODE_PLANE__COUNT);
+    if (drmmode_crtc->cursor_plane_id)
+        drmmode_prop_info_free(drmmode_crtc->props_cursor, DRMMODE_PLANE__COUNT);
     xorg_list_for_each_entry_safe(iterator, next, &drmmode_crtc->mode_list, entry) {
         drm_mode_destroy(crtc, iterator);
     }
@@ -1707,7 +2337,8 @@ is_plane_assigned(ScrnInfoPtr scrn, int plane_id)
     for (c = 0; c < xf86_config->num_crtc; c++) {
         xf86CrtcPtr iter = xf86_config->crtc[c];
         drmmode_crtc_private_ptr drmmode_crtc = iter->driver_private;
-        if (drmmode_crtc->plane_id == plane_id)
+        if (drmmode_crtc->plane_id == plane_id ||
+            drmmode_crtc->cursor_plane_id == plane_id)
             return TRUE;
     }
 
@@ -1775,6 +2406,116 @@ populate_format_modifiers(xf86CrtcPtr crtc, const drmModePlane *kplane,
     return TRUE;
 }
 
+static struct drmmode_prop_enum_info_rec plane_type_enums[] = {
+    [DRMMODE_PLANE_TYPE_PRIMARY] = {
+        .name = "Primary",
+    },
+    [DRMMODE_PLANE_TYPE_OVERLAY] = {
+        .name = "Overlay",
+    },
+    [DRMMODE_PLANE_TYPE_CURSOR] = {
+        .name = "Cursor",
+    },
+};
+
+static const struct drmmode_prop_info_rec plane_props[] = {
+    [DRMMODE_PLANE_TYPE] = {
+        .name = "type",
+        .enum_values = plane_type_enums,
+        .num_enum_values = DRMMODE_PLANE_TYPE__COUNT,
+    },
+    [DRMMODE_PLANE_FB_ID] = { .name = "FB_ID", },
+    [DRMMODE_PLANE_CRTC_ID] = { .name = "CRTC_ID", },
+    [DRMMODE_PLANE_IN_FORMATS] = { .name = "IN_FORMATS", },
+    [DRMMODE_PLANE_SRC_X] = { .name = "SRC_X", },
+    [DRMMODE_PLANE_SRC_Y] = { .name = "SRC_Y", },
+    [DRMMODE_PLANE_SRC_W] = { .name = "SRC_W", },
+    [DRMMODE_PLANE_SRC_H] = { .name = "SRC_H", },
+    [DRMMODE_PLANE_CRTC_X] = { .name = "CRTC_X", },
+    [DRMMODE_PLANE_CRTC_Y] = { .name = "CRTC_Y", },
+    [DRMMODE_PLANE_CRTC_W] = { .name = "CRTC_W", },
+    [DRMMODE_PLANE_CRTC_H] = { .name = "CRTC_H", },
+    [DRMMODE_PLANE_ROTATION] = { .name = "rotation", },
+};
+
+static const struct {
+    const char *name;
+    Rotation rotation;
+} plane_rotation_names[] = {
+    { "rotate-0", RR_Rotate_0 },
+    { "rotate-90", RR_Rotate_90 },
+    { "rotate-180", RR_Rotate_180 },
+    { "rotate-270", RR_Rotate_270 },
+    { "reflect-x", RR_Reflect_X },
+    { "reflect-y", RR_Reflect_Y },
+};
+
+/*
+ * The "rotation" property is a bitmask and its id differs from plane to
+ * plane, so look it up on the chosen primary plane itself rather than
+ * trusting the id drmmode_prop_info_update() found on the first plane.
+ */
+static void drmmode_crtc_probe_rotation(xf86CrtcPtr crtc)
+{
+    drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+    drmmode_ptr drmmode = drmmode_crtc->drmmode;
+    drmModeObjectProperties *props;
+    uint32_t i, k;
+    int j;
+
+    drmmode_crtc->props_plane[DRMMODE_PLANE_ROTATION].prop_id = 0;
+    drmmode_crtc->plane_rotations = 0;
+    drmmode_crtc->plane_rotation = RR_Rotate_0;
+
+    if (!drmmode_crtc->plane_id)
+        return;
+
+    props = drmModeObjectGetProperties(drmmode->fd, drmmode_crtc->plane_id,
+                                       DRM_MODE_OBJECT_PLANE);
+    if (!props)
+        return;
+
+    for (i = 0; i < props->count_props; i++)
+    {
+        drmModePropertyPtr prop = drmModeGetProperty(drmmode->fd,
+                                                     props->props[i]);
+        if (!prop)
+            continue;
+
+        if (strcmp(prop->name, "rotation") ||
+            !(prop->flags & DRM_MODE_PROP_BITMASK))
+        {
+            drmModeFreeProperty(prop);
+            continue;
+        }
+
+        for (j = 0; j < prop->count_enums; j++)
+        {
+            for (k = 0; k < ARRAY_SIZE(plane_rotation_names); k++)
+            {
+                if (!strcmp(prop->enums[j].name, plane_rotation_names[k].name))
+                    drmmode_crtc->plane_rotations |= plane_rotation_names[k].rotation;
+            }
+        }
+
+        drmmode_crtc->props_plane[DRMMODE_PLANE_ROTATION].prop_id = prop->prop_id;
+        drmModeFreeProperty(prop);
+        break;
+    }
+
+    drmModeFreeObjectProperties(props);
+
+    if (drmmode_crtc->plane_rotations & ~RR_Rotate_0)
+        xf86DrvMsg(drmmode->scrn->scrnIndex, X_INFO,
+                   "Primary plane %u rotation:%s%s%s%s%s\n",
+                   drmmode_crtc->plane_id,
+                   (drmmode_crtc->plane_rotations & RR_Rotate_90) ? " 90" : "",
+                   (drmmode_crtc->plane_rotations & RR_Rotate_180) ? " 180" : "",
+                   (drmmode_crtc->plane_rotations & RR_Rotate_270) ? " 270" : "",
+                   (drmmode_crtc->plane_rotations & RR_Reflect_X) ? " reflect-x" : "",
+                   (drmmode_crtc->plane_rotations & RR_Reflect_Y) ? " reflect-y" : "");
+}
+
 static void drmmode_crtc_create_planes(xf86CrtcPtr crtc, int num)
 {
     drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
@@ -1784,37 +2525,7 @@ static void drmmode_crtc_create_planes(xf86CrtcPtr crtc, int num)
     drmModeObjectProperties *props;
     uint32_t i, type, blob_id;
     int current_crtc, best_plane = 0;
-
-    static struct drmmode_prop_enum_info_rec plane_type_enums[] = {
-        [DRMMODE_PLANE_TYPE_PRIMARY] = {
-            .name = "Primary",
-        },
-        [DRMMODE_PLANE_TYPE_OVERLAY] = {
-            .name = "Overlay",
-        },
-        [DRMMODE_PLANE_TYPE_CURSOR] = {
-            .name = "Cursor",
-        },
-    };
-
-    static const struct drmmode_prop_info_rec plane_props[] = {
-        [DRMMODE_PLANE_TYPE] = {
-            .name = "type",
-            .enum_values = plane_type_enums,
-            .num_enum_values = DRMMODE_PLANE_TYPE__COUNT,
-        },
-        [DRMMODE_PLANE_FB_ID] = { .name = "FB_ID", },
-        [DRMMODE_PLANE_CRTC_ID] = { .name = "CRTC_ID", },
-        [DRMMODE_PLANE_IN_FORMATS] = { .name = "IN_FORMATS", },
-        [DRMMODE_PLANE_SRC_X] = { .name = "SRC_X", },
-        [DRMMODE_PLANE_SRC_Y] = { .name = "SRC_Y", },
-        [DRMMODE_PLANE_SRC_W] = { .name = "SRC_W", },
-        [DRMMODE_PLANE_SRC_H] = { .name = "SRC_H", },
-        [DRMMODE_PLANE_CRTC_X] = { .name = "CRTC_X", },
-        [DRMMODE_PLANE_CRTC_Y] = { .name = "CRTC_Y", },
-        [DRMMODE_PLANE_CRTC_W] = { .name = "CRTC_W", },
-        [DRMMODE_PLANE_CRTC_H] = { .name = "CRTC_H", },
-    };
+    Bool primary_found = FALSE, cursor_own = FALSE;
 
     struct drmmode_prop_info_rec tmp_props[DRMMODE_PLANE__COUNT];
 
@@ -1837,6 +2548,9 @@ static void drmmode_crtc_create_planes(xf86CrtcPtr crtc, int num)
     for (i = 0; i < kplane_res->count_planes; i++) {
         int plane_id;
 
+        if (primary_found && cursor_own)
+            break;
+
         kplane = drmModeGetPlane(drmmode->fd, kplane_res->planes[i]);
         if (!kplane)
             continue;
@@ -1863,7 +2577,32 @@ static void drmmode_crtc_create_planes(xf86CrtcPtr crtc, int num)
         /* Only primary planes are important for atomic page-flipping */
         type = drmmode_prop_get_value(&tmp_props[DRMMODE_PLANE_TYPE],
                                       props, DRMMODE_PLANE_TYPE__COUNT);
-        if (type != DRMMODE_PLANE_TYPE_PRIMARY) {
+
+        /*
+         * The cursor plane moves the hw cursor, see
+         * drmmode_set_cursor_position. A plane only this CRTC can use, or
+         * one already on it, beats the first one that merely could be.
+         */
+        if (type == DRMMODE_PLANE_TYPE_CURSOR && !cursor_own) {
+            current_crtc = drmmode_prop_get_value(&tmp_props[DRMMODE_PLANE_CRTC_ID],
+                                                  props, 0);
+            cursor_own = kplane->possible_crtcs == (1 << num) ||
+                         current_crtc == drmmode_crtc->mode_crtc->crtc_id;
+
+            if (cursor_own && drmmode_crtc->cursor_plane_id) {
+                drmmode_prop_info_free(drmmode_crtc->props_cursor,
+                                       DRMMODE_PLANE__COUNT);
+                drmmode_crtc->cursor_plane_id = 0;
+            }
+
+            if (!drmmode_crtc->cursor_plane_id &&
+                drmmode_prop_info_copy(drmmode_crtc->props_cursor, tmp_props,
+                                       DRMMODE_PLANE__COUNT, 1))
+                drmmode_crtc->cursor_plane_id = plane_id;
+        }
+
+        /* Past the primary on this CRTC, only the cursor is still missing */
+        if (type != DRMMODE_PLANE_TYPE_PRIMARY || primary_found) {
             drmModeFreePlane(kplane);
             drmModeFreeObjectProperties(props);
             continue;
@@ -1884,7 +2623,8 @@ static void drmmode_crtc_create_planes(xf86CrtcPtr crtc, int num)
             drmmode_prop_info_copy(drmmode_crtc->props_plane, tmp_props,
                                    DRMMODE_PLANE__COUNT, 1);
             drmModeFreeObjectProperties(props);
-            break;
+            primary_found = TRUE;
+            continue;
         }
 
         if (!best_plane) {
@@ -1913,10 +2653,223 @@ static void drmmode_crtc_create_planes(xf86CrtcPtr crtc, int num)
         drmModeFreePlane(best_kplane);
     }
 
+    drmmode_crtc_probe_rotation(crtc);
+
     drmmode_prop_info_free(tmp_props, DRMMODE_PLANE__COUNT);
     drmModeFreePlaneResources(kplane_res);
 }
 
+/*
+ * Collect the overlay planes which can scan out NV12 or YUYV, for the Xv
+ * adaptor. drmmode_crtc_create_planes() only keeps the primary planes.
+ *
+ * Only planes which can reach one of this screen's CRTCs are kept. With
+ * ZaphodHeads every screen sees the same planes, so each plane is also
+ * claimed on the entity and goes to the first screen that can use it.
+ */
+static void drmmode_overlay_planes_init(ScrnInfoPtr pScrn, drmmode_ptr drmmode)
+{
+    xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(pScrn);
+    drmModePlaneRes *kplane_res;
+    uint32_t crtc_mask = 0;
+    uint32_t i, j;
+    int c;
+
+    for (c = 0; c < xf86_config->num_crtc; c++)
+    {
+        drmmode_crtc_private_ptr drmmode_crtc =
+            xf86_config->crtc[c]->driver_private;
+
+        crtc_mask |= 1 << drmmode_crtc->crtc_index;
+    }
+
+    kplane_res = drmModeGetPlaneResources(drmmode->fd);
+    if (!kplane_res)
+        return;
+
+    for (i = 0; i < kplane_res->count_planes; i++)
+    {
+        struct drmmode_overlay_plane *overlay;
+        drmModeObjectProperties *props;
+        drmModePlane *kplane;
+        uint32_t type;
+
+        if (drmmode->num_overlays == DRMMODE_MAX_OVERLAYS)
+            break;
+
+        kplane = drmModeGetPlane(drmmode->fd, kplane_res->planes[i]);
+        if (!kplane)
+            continue;
+
+        if (!(kplane->possible_crtcs & crtc_mask))
+        {
+            drmModeFreePlane(kplane);
+            continue;
+        }
+
+        props = drmModeObjectGetProperties(drmmode->fd, kplane->plane_id,
+                                           DRM_MODE_OBJECT_PLANE);
+        if (!props)
+        {
+            drmModeFreePlane(kplane);
+            continue;
+        }
+
+        overlay = &drmmode->overlays[drmmode->num_overlays];
+        memset(overlay, 0, sizeof(*overlay));
+
+        if (!drmmode_prop_info_copy(overlay->props, plane_props,
+                                    DRMMODE_PLANE__COUNT, 0))
+        {
+            drmModeFreeObjectProperties(props);
+            drmModeFreePlane(kplane);
+            break;
+        }
+
+        drmmode_prop_info_update(drmmode, overlay->props,
+                                 DRMMODE_PLANE__COUNT, props);
+        type = drmmode_prop_get_value(&overlay->props[DRMMODE_PLANE_TYPE],
+                                      props, DRMMODE_PLANE_TYPE__COUNT);
+
+        for (j = 0; j < kplane->count_formats; j++)
+        {
+            if (kplane->formats[j] == DRM_FORMAT_NV12)
+                overlay->has_nv12 = TRUE;
+            else if (kplane->formats[j] == DRM_FORMAT_YUYV)
+                overlay->has_yuyv = TRUE;
+        }
+
+        if ((type == DRMMODE_PLANE_TYPE_OVERLAY) &&
+            (overlay->has_nv12 || overlay->has_yuyv) &&
+            (!xf86IsEntityShared(pScrn->entityList[0]) ||
+             LS_EntityClaimPlane(pScrn, kplane->plane_id)))
+        {
+            overlay->plane_id = kplane->plane_id;
+            overlay->possible_crtcs = kplane->possible_crtcs;
+            drmmode->num_overlays++;
+
+            xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+                       "Overlay plane %u: crtcs 0x%x,%s%s\n",
+                       overlay->plane_id, overlay->possible_crtcs,
+                       overlay->has_nv12 ? " NV12" : "",
+                       overlay->has_yuyv ? " YUYV" : "");
+        }
+        else
+        {
+            drmmode_prop_info_free(overlay->props, DRMMODE_PLANE__COUNT);
+        }
+
+        drmModeFreeObjectProperties(props);
+        drmModeFreePlane(kplane);
+    }
+
+    drmModeFreePlaneResources(kplane_res);
+}
+
+void drmmode_overlay_planes_fini(drmmode_ptr drmmode)
+{
+    int i;
+
+    for (i = 0; i < drmmode->num_overlays; i++)
+        drmmode_prop_info_free(drmmode->overlays[i].props,
+                               DRMMODE_PLANE__COUNT);
+
+    drmmode->num_overlays = 0;
+}
+
+static int overlay_add_prop(drmModeAtomicReq *req,
+                            struct drmmode_overlay_plane *overlay,
+                            enum drmmode_plane_property prop,
+                            uint64_t val)
+{
+    int ret;
+
+    ret = drmModeAtomicAddProperty(req, overlay->plane_id,
+                                   overlay->props[prop].prop_id, val);
+    return (ret <= 0) ? -1 : 0;
+}
+
+/*
+ * Show fb_id on the overlay, or turn it off if fb_id is 0. 'src' is in
+ * pixels of the fb, 'dst' in pixels relative to the crtc. The crtc does
+ * the scaling and the color conversion.
+ */
+int drmmode_overlay_commit(drmmode_ptr drmmode,
+                           struct drmmode_overlay_plane *overlay,
+                           xf86CrtcPtr crtc,
+                           uint32_t fb_id,
+                           BoxPtr src,
+                           BoxPtr dst,
+                           uint32_t flags)
+{
+    drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+    drmModeAtomicReq *req;
+    int ret = 0;
+
+    req = drmModeAtomicAlloc();
+    if (!req)
+        return -ENOMEM;
+
+    ret |= overlay_add_prop(req, overlay, DRMMODE_PLANE_FB_ID, fb_id);
+    ret |= overlay_add_prop(req, overlay, DRMMODE_PLANE_CRTC_ID,
+                            fb_id ? drmmode_crtc->mode_crtc->crtc_id : 0);
+
+    if (fb_id)
+    {
+        ret |= overlay_add_prop(req, overlay, DRMMODE_PLANE_SRC_X,
+                                (uint64_t) src->x1 << 16);
+        ret |= overlay_add_prop(req, overlay, DRMMODE_PLANE_SRC_Y,
+                                (uint64_t) src->y1 << 16);
+        ret |= overlay_add_prop(req, overlay, DRMMODE_PLANE_SRC_W,
+                                (uint64_t) (src->x2 - src->x1) << 16);
+        ret |= overlay_add_prop(req, overlay, DRMMODE_PLANE_SRC_H,
+                                (uint64_t) (src->y2 - src->y1) << 16);
+        ret |= overlay_add_prop(req, overlay, DRMMODE_PLANE_CRTC_X, dst->x1);
+        ret |= overlay_add_prop(req, overlay, DRMMODE_PLANE_CRTC_Y, dst->y1);
+        ret |= overlay_add_prop(req, overlay, DRMMODE_PLANE_CRTC_W,
+                                dst->x2 - dst->x1);
+        ret |= overlay_add_prop(req, overlay, DRMMODE_PLANE_CRTC_H,
+                                dst->y2 - dst->y1);
+    }
+
+    if (ret == 0)
+        ret = drmModeAtomicCommit(drmmode->fd, req, flags, NULL);
+
+    drmModeAtomicFree(req);
+
+    return ret;
+}
+
+static uint32_t drmmode_crtc_find_prop_id(int fd,
+                                          uint32_t crtc_id,
+                                          const char *name)
+{
+    drmModeObjectPropertiesPtr props;
+    uint32_t prop_id = 0;
+    uint32_t i;
+
+    props = drmModeObjectGetProperties(fd, crtc_id, DRM_MODE_OBJECT_CRTC);
+    if (props == NULL)
+        return 0;
+
+    for (i = 0; (i < props->count_props) && (prop_id == 0); i++)
+    {
+        drmModePropertyPtr prop = drmModeGetProperty(fd, props->props[i]);
+
+        if (prop == NULL)
+            continue;
+
+        if (strcmp(prop->name, name) == 0)
+            prop_id = prop->prop_id;
+
+        drmModeFreeProperty(prop);
+    }
+
+    drmModeFreeObjectProperties(props);
+
+    return prop_id;
+}
+
 static unsigned int drmmode_crtc_init(ScrnInfoPtr pScrn,
                                       struct drmmode_rec *pDrmMode,
                                       drmModeResPtr mode_res,
@@ -1951,6 +2904,7 @@ static unsigned int drmmode_crtc_init(ScrnInfoPtr pScrn,
     drmmode_crtc->mode_crtc = drmModeGetCrtc(devFD, crtcID);
     drmmode_crtc->drmmode = pDrmMode;
     drmmode_crtc->vblank_pipe = drmmode_crtc_vblank_pipe(num);
+    drmmode_crtc->crtc_index = num;
     pCrtc->driver_private = drmmode_crtc;
 
     xf86DrvMsg(pScrn->scrnIndex, X_INFO,
@@ -1998,6 +2952,15 @@ static unsigned int drmmode_crtc_init(ScrnInfoPtr pScrn,
         drmmode_crtc_create_planes(pCrtc, num);
     }
 
+    if (pDrmMode->vrr_support && (pDrmMode->vrr_prop_id == 0))
+    {
+        pDrmMode->vrr_prop_id = drmmode_crtc_find_prop_id(devFD, crtcID,
+                                                          "VRR_ENABLED");
+        if (pDrmMode->vrr_prop_id == 0)
+            xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+                       "%s: kernel has no VRR_ENABLED property\n", __func__);
+    }
+
     /* Hide any cursors which may be active from previous users */
     ret = drmModeSetCursor(devFD, drmmode_crtc->mode_crtc->crtc_id, 0, 0, 0);
     if (ret == 0)
@@ -2077,6 +3040,121 @@ drmmode_clones_init(ScrnInfoPtr scrn, drmmode_ptr drmmode, drmModeResPtr mode_re
 }
 
 
+/*
+ * Anything cached against the current CRTC configuration (the Present
+ * flip verdicts for now) is stale once this has been called.
+ */
+void drmmode_crtc_config_changed(drmmode_ptr drmmode)
+{
+    drmmode->crtc_config_gen++;
+}
+
+
+/*
+ * Clients opt in to variable refresh by setting _VARIABLE_REFRESH to a
+ * non-zero CARD32 on their window, the same contract as other drivers.
+ */
+Bool drmmode_window_wants_vrr(drmmode_ptr drmmode, WindowPtr pWin)
+{
+    PropertyPtr pProp;
+
+    if (!drmmode->vrr_support || (pWin == NULL))
+        return FALSE;
+
+    if (dixLookupProperty(&pProp, pWin, drmmode->vrr_atom,
+                          serverClient, DixReadAccess) != Success)
+        return FALSE;
+
+    return (pProp->format == 32) && (pProp->size == 1) &&
+           (*(uint32_t *) pProp->data != 0);
+}
+
+static Bool drmmode_crtc_vrr_capable(xf86CrtcPtr crtc)
+{
+    xf86CrtcConfigPtr config = XF86_CRTC_CONFIG_PTR(crtc->scrn);
+    int i;
+
+    for (i = 0; i < config->num_output; i++)
+    {
+        xf86OutputPtr output = config->output[i];
+        drmmode_output_private_ptr drmmode_output = output->driver_private;
+
+        if ((output->crtc == crtc) && drmmode_output->vrr_capable)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+static void drmmode_crtc_set_vrr(xf86CrtcPtr crtc, Bool enabled)
+{
+    drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+    drmmode_ptr drmmode = drmmode_crtc->drmmode;
+    int ret;
+
+    if (drmmode_crtc->vrr_enabled == enabled)
+        return;
+
+    if (enabled && !drmmode_crtc_vrr_capable(crtc))
+        return;
+
+    /* VRR_ENABLED is a plain crtc property, no atomic commit needed */
+    ret = drmModeObjectSetProperty(drmmode->fd,
+                                   drmmode_crtc->mode_crtc->crtc_id,
+                                   DRM_MODE_OBJECT_CRTC,
+                                   drmmode->vrr_prop_id,
+                                   enabled);
+    if (ret == 0)
+        drmmode_crtc->vrr_enabled = enabled;
+    else
+        xf86DrvMsg(crtc->scrn->scrnIndex, X_WARNING,
+                   "%s: failed to %s VRR: %s\n", __func__,
+                   enabled ? "enable" : "disable", strerror(errno));
+}
+
+/*
+ * Only one window can flip at a time and it covers the whole screen,
+ * so VRR is switched for every crtc at once.
+ */
+void drmmode_set_screen_vrr(ScrnInfoPtr pScrn, Bool enabled)
+{
+    loongsonPtr lsp = loongsonPTR(pScrn);
+    struct drmmode_rec * const pDrmMode = &lsp->drmmode;
+    xf86CrtcConfigPtr config = XF86_CRTC_CONFIG_PTR(pScrn);
+    int i;
+
+    if (!pDrmMode->vrr_support || (pDrmMode->vrr_prop_id == 0))
+        return;
+
+    if (!enabled)
+        pDrmMode->vrr_window = None;
+
+    for (i = 0; i < config->num_crtc; i++)
+    {
+        xf86CrtcPtr crtc = config->crtc[i];
+
+        if (enabled && !ls_is_crtc_on(crtc))
+            continue;
+
+        drmmode_crtc_set_vrr(crtc, enabled);
+    }
+}
+
+/*
+ * Switch VRR for a flip of @pWin, and remember the window so VRR can be
+ * turned off when it goes away, DRI2 clients never unflip.
+ */
+void drmmode_set_window_vrr(ScrnInfoPtr pScrn, WindowPtr pWin)
+{
+    loongsonPtr lsp = loongsonPTR(pScrn);
+    struct drmmode_rec * const pDrmMode = &lsp->drmmode;
+    Bool enabled = drmmode_window_wants_vrr(pDrmMode, pWin);
+
+    drmmode_set_screen_vrr(pScrn, enabled);
+
+    if (enabled)
+        pDrmMode->vrr_window = pWin->drawable.id;
+}
 
 
 void drmmode_validate_leases(ScrnInfoPtr scrn)
@@ -2125,6 +3203,7 @@ void drmmode_validate_leases(ScrnInfoPtr scrn)
 
 Bool drmmode_pre_init(ScrnInfoPtr pScrn, drmmode_ptr drmmode, int cpp)
 {
+    loongsonPtr lsp = loongsonPTR(pScrn);
     int i;
     int ret;
     uint64_t value = 0;
@@ -2206,6 +3285,9 @@ Bool drmmode_pre_init(ScrnInfoPtr pScrn, drmmode_ptr drmmode, int cpp)
     /* workout clones */
     drmmode_clones_init(pScrn, drmmode, mode_res);
 
+    if (lsp->atomic_modeset)
+        drmmode_overlay_planes_init(pScrn, drmmode);
+
     drmModeFreeResources(mode_res);
     /* XF86_CRTC_VERSION >= 5 */
     xf86ProviderSetup(pScrn, NULL, "loongson");
@@ -58,6 +58,7 @@ enum drmmode_plane_property {
     DRMMODE_PLANE_CRTC_Y,
     DRMMODE_PLANE_CRTC_W,
     DRMMODE_PLANE_CRTC_H,
+    DRMMODE_PLANE_ROTATION,
     DRMMODE_PLANE__COUNT
 };
 
@@ -79,6 +80,50 @@ enum drmmode_crtc_property {
     DRMMODE_CRTC__COUNT
 };
 
+/*
+ * Verdict of the Present flip checks for a given pixmap. Only valid as long
+ * as the CRTC configuration generation it was computed under is current.
+ */
+#define DRMMODE_FLIP_CACHE_SIZE     16
+
+/*
+ * Option "ShadowPageFlip": the shadow is copied into whichever of the two
+ * scanout bos isn't being displayed, which is then flipped to at vblank.
+ */
+struct drmmode_shadow_flip {
+    /* bo[0] is the front bo, bo[1] is owned by loongson_shadow.c */
+    struct DrmModeBO *bo[2];
+    PixmapPtr pixmap[2];
+    /* Index of the bo being scanned out */
+    int scanout;
+    Bool pending;
+    /* Where the other bo lags behind the one being scanned out */
+    RegionRec prev_damage;
+    /* Damage not copied yet because a flip was still in flight */
+    RegionRec pending_damage;
+};
+
+#define DRMMODE_MAX_OVERLAYS        4
+
+/* An overlay plane for the Xv adaptor, see loongson_video.c */
+struct drmmode_overlay_plane {
+    uint32_t plane_id;
+    /* Bitmask of kernel crtc indices, as in drmModePlane */
+    uint32_t possible_crtcs;
+    Bool has_nv12;
+    Bool has_yuyv;
+    struct drmmode_prop_info_rec props[DRMMODE_PLANE__COUNT];
+    /* The Xv port displaying on it, NULL while free */
+    void *owner;
+};
+
+struct drmmode_flip_verdict {
+    unsigned long serial;
+    uint32_t crtc_gen;
+    Bool can_flip;
+    int reason;
+};
+
 struct drmmode_rec {
     int fd;
     unsigned fb_id;
@@ -92,7 +137,17 @@ struct drmmode_rec {
 #ifdef HAVE_LIBUDEV
     struct udev_monitor *uevent_monitor;
     InputHandlerProc uevent_handler;
+    /* Hotplug uevents are collected until this fires */
+    OsTimerPtr uevent_timer;
+    Bool uevent_pending;
+    /* An event without CONNECTOR=, look at every connector */
+    Bool uevent_rescan;
 #endif
+    /*
+     * Set while handling uevents: the kernel has already probed, detect
+     * only re-reads the stale connectors and without forcing a probe.
+     */
+    Bool detect_current;
     drmEventContext event_context;
 
     struct DrmModeBO *front_bo;
@@ -107,9 +162,14 @@ struct drmmode_rec {
     enum ExaAccelType exa_acc_type;
     Bool shadow_enable;
     Bool shadow_present;
+    /** Is Option "ShadowPageFlip" enabled? */
+    Bool shadow_flip_enable;
+    struct drmmode_shadow_flip shadow_flip;
 
     /** Is Option "PageFlip" enabled? */
     Bool pageflip;
+    /** Is Option "SwapDamage" enabled? */
+    Bool swap_damage;
     void *shadow_fb;
     /* SCREEN SPECIFIC_PRIVATE_KEYS */
     DevPrivateKeyRec pixmapPrivateKeyRec;
@@ -125,6 +185,28 @@ struct drmmode_rec {
     Bool present_flipping;
     Bool flip_bo_import_failed;
 
+    /** Is Option "FastStartup" enabled? */
+    Bool fast_startup;
+    /* The front bo being mapped on a helper thread, see loongson_scanout.c */
+    struct ls_front_map *front_map;
+
+    /** Is Option "VariableRefresh" enabled? */
+    Bool vrr_support;
+    /* VRR_ENABLED crtc property, 0 if the kernel doesn't have it */
+    uint32_t vrr_prop_id;
+    Atom vrr_atom;
+    /* XID of the window Present last found flippable, None when gone */
+    XID flip_window;
+    /* XID of the window VRR got enabled for, None while it is off */
+    XID vrr_window;
+
+    int num_overlays;
+    struct drmmode_overlay_plane overlays[DRMMODE_MAX_OVERLAYS];
+
+    /* Bumped on modeset, dpms and hotplug, invalidates the flip cache */
+    uint32_t crtc_config_gen;
+    struct drmmode_flip_verdict flip_cache[DRMMODE_FLIP_CACHE_SIZE];
+
     Bool dri2_enable;
     Bool present_enable;
 };
@@ -159,18 +241,47 @@ typedef struct {
     uint64_t *modifiers;
 } drmmode_format_rec, *drmmode_format_ptr;
 
+#define DRMMODE_CURSOR_CACHE_SIZE   4
+
+/* A cursor bo holding the image whose hash is 'hash' */
+struct drmmode_cursor_slot {
+    struct dumb_bo *bo;
+    uint64_t hash;
+    Bool valid;
+    unsigned long last_used;
+};
+
 struct drmmode_crtc_private_rec {
     drmmode_ptr drmmode;
     drmModeCrtcPtr mode_crtc;
     uint32_t vblank_pipe;
     int dpms_mode;
+    /* The bo of the cursor slot in use, see drmmode_load_cursor_argb_check */
     struct dumb_bo *cursor_bo;
     Bool cursor_up;
+    struct drmmode_cursor_slot cursor_cache[DRMMODE_CURSOR_CACHE_SIZE];
+    unsigned long cursor_tick;
+    /* What the kernel was last told, to skip identical drmModeSetCursor2 */
+    uint32_t cursor_set_handle;
+    int cursor_set_xhot;
+    int cursor_set_yhot;
+    /* With atomic, cursor moves go to this plane, one commit per vblank */
+    uint32_t cursor_plane_id;
+    struct drmmode_prop_info_rec props_cursor[DRMMODE_PLANE__COUNT];
+    Bool cursor_move_pending;
+    Bool cursor_move_queued;
+    /* The kernel's legacy cursor position lags behind the plane's */
+    Bool cursor_legacy_stale;
+    int cursor_x;
+    int cursor_y;
     uint16_t lut_r[256], lut_g[256], lut_b[256];
 
     struct drmmode_prop_info_rec props[DRMMODE_CRTC__COUNT];
     struct drmmode_prop_info_rec props_plane[DRMMODE_PLANE__COUNT];
     uint32_t plane_id;
+    /* Transforms the primary plane can do, and the one it is set to */
+    Rotation plane_rotations;
+    Rotation plane_rotation;
     drmmode_mode_ptr current_mode;
     uint32_t num_formats;
     drmmode_format_rec *formats;
@@ -200,6 +311,12 @@ struct drmmode_crtc_private_rec {
 
     Bool enable_flipping;
     Bool flipping_active;
+
+    /* Current value of the VRR_ENABLED property */
+    Bool vrr_enabled;
+
+    /* Index in the kernel's crtc list, for possible_crtcs masks */
+    int crtc_index;
 };
 
 typedef struct drmmode_crtc_private_rec * drmmode_crtc_private_ptr;
@@ -226,6 +343,21 @@ typedef struct {
     int enc_mask;
     int enc_clone_mask;
     xf86CrtcPtr current_crtc;
+    /* The sink advertises adaptive sync */
+    Bool vrr_capable;
+    /* A uevent named this connector, re-read it on the next detect */
+    Bool stale;
+    /* ...and not just for a property, so probe it for modes and EDID */
+    Bool reprobe;
+    /* EDID blob of the last connector read, bumps edid_epoch on change */
+    uint32_t edid_prop_id;
+    uint32_t edid_blob_id;
+    uint32_t edid_epoch;
+    /* What get_modes returned last time, valid for modes_epoch/modes_hash */
+    DisplayModePtr modes_cache;
+    Bool modes_valid;
+    uint32_t modes_epoch;
+    uint32_t modes_hash;
 } drmmode_output_private_rec, *drmmode_output_private_ptr;
 
 typedef struct {
@@ -247,11 +379,15 @@ typedef struct _msSpritePriv {
 
 Bool drmmode_is_format_supported(ScrnInfoPtr scrn, uint32_t format,
                                  uint64_t modifier);
+uint32_t drmmode_get_formats(ScrnInfoPtr scrn, uint32_t **formats);
+uint32_t drmmode_get_modifiers(ScrnInfoPtr scrn, uint32_t format,
+                               uint64_t **modifiers, Bool enabled_crtc_only);
 
 Bool drmmode_SharedPixmapPresentOnVBlank(PixmapPtr frontTarget, xf86CrtcPtr crtc,
                                          drmmode_ptr drmmode);
 Bool drmmode_SharedPixmapFlip(PixmapPtr frontTarget, xf86CrtcPtr crtc,
                               drmmode_ptr drmmode);
+void drmmode_SharedPixmapCancelFenceWait(PixmapPtr ppix, drmmode_ptr drmmode);
 
 extern Bool drmmode_pre_init(ScrnInfoPtr pScrn, drmmode_ptr drmmode, int cpp);
 
@@ -278,6 +414,21 @@ Bool drmmode_set_mode_major(xf86CrtcPtr crtc, DisplayModePtr mode,
 
 void drmmode_validate_leases(ScrnInfoPtr scrn);
 
+void drmmode_crtc_config_changed(drmmode_ptr drmmode);
+
+Bool drmmode_window_wants_vrr(drmmode_ptr drmmode, WindowPtr pWin);
+void drmmode_set_screen_vrr(ScrnInfoPtr pScrn, Bool enabled);
+void drmmode_set_window_vrr(ScrnInfoPtr pScrn, WindowPtr pWin);
+
+void drmmode_overlay_planes_fini(drmmode_ptr drmmode);
+int drmmode_overlay_commit(drmmode_ptr drmmode,
+                           struct drmmode_overlay_plane *overlay,
+                           xf86CrtcPtr crtc,
+                           uint32_t fb_id,
+                           BoxPtr src,
+                           BoxPtr dst,
+                           uint32_t flags);
+
 
 Bool drmmode_prop_info_copy(struct drmmode_prop_info_rec *dst,
                             const struct drmmode_prop_info_rec *src,
@@ -551,6 +551,87 @@ static void drmmode_output_update_properties(xf86OutputPtr output)
 }
 
 
+/*
+ * vrr_capable is immutable for a given sink but changes with whatever
+ * gets plugged in, so refresh it together with the connector.
+ */
+static void drmmode_output_update_vrr(drmmode_ptr drmmode,
+                                      drmmode_output_private_ptr drmmode_output)
+{
+    drmModeConnectorPtr koutput = drmmode_output->mode_output;
+    int idx;
+
+    idx = koutput_get_prop_idx(drmmode->fd, koutput,
+                               DRM_MODE_PROP_RANGE, "vrr_capable");
+
+    drmmode_output->vrr_capable = (idx > -1) && (koutput->prop_values[idx] != 0);
+}
+
+static void drmmode_output_flush_modes(drmmode_output_private_ptr drmmode_output)
+{
+    while (drmmode_output->modes_cache)
+        xf86DeleteMode(&drmmode_output->modes_cache,
+                       drmmode_output->modes_cache);
+
+    drmmode_output->modes_valid = FALSE;
+}
+
+/*
+ * Fetch the connector. A uevent that only reports a property change
+ * leaves modes and EDID alone, so the current state is good enough for
+ * it. Anything else, a change of connection status, or a connector that
+ * shows up connected without modes gets a full probe: the sink may have
+ * been swapped behind a KVM without the status ever changing.
+ */
+static drmModeConnectorPtr
+drmmode_output_fetch(drmmode_ptr drmmode,
+                     drmmode_output_private_ptr drmmode_output,
+                     drmModeConnection prev_connection)
+{
+    drmModeConnectorPtr koutput;
+    int i;
+
+    if (drmmode->detect_current && !drmmode_output->reprobe)
+    {
+        koutput = drmModeGetConnectorCurrent(drmmode->fd,
+                                             drmmode_output->output_id);
+        if (koutput && (koutput->connection == prev_connection) &&
+            ((koutput->connection != DRM_MODE_CONNECTED) ||
+             (koutput->count_modes > 0)))
+            goto out;
+
+        drmModeFreeConnector(koutput);
+    }
+
+    koutput = drmModeGetConnector(drmmode->fd, drmmode_output->output_id);
+    if (!koutput)
+        return NULL;
+
+out:
+    if (drmmode_output->edid_prop_id == 0)
+    {
+        int id = koutput_get_prop_id(drmmode->fd, koutput,
+                                     DRM_MODE_PROP_BLOB, "EDID");
+        if (id > 0)
+            drmmode_output->edid_prop_id = id;
+    }
+
+    for (i = 0; i < koutput->count_props; i++)
+    {
+        if (koutput->props[i] != drmmode_output->edid_prop_id)
+            continue;
+
+        if (koutput->prop_values[i] != drmmode_output->edid_blob_id)
+        {
+            drmmode_output->edid_blob_id = koutput->prop_values[i];
+            drmmode_output->edid_epoch++;
+        }
+        break;
+    }
+
+    return koutput;
+}
+
 xf86OutputStatus drmmode_output_detect(xf86OutputPtr output)
 {
     /**
@@ -561,6 +642,7 @@ xf86OutputStatus drmmode_output_detect(xf86OutputPtr output)
     /* go to the hw and retrieve a new output struct */
     drmmode_output_private_ptr drmmode_output = output->driver_private;
     drmmode_ptr drmmode = drmmode_output->drmmode;
+    drmModeConnection prev_connection = DRM_MODE_UNKNOWNCONNECTION;
     xf86OutputStatus status;
 
     if (drmmode_output->output_id == -1)
@@ -571,21 +653,34 @@ xf86OutputStatus drmmode_output_detect(xf86OutputPtr output)
         return XF86OutputStatusDisconnected;
     }
 
+    /* Nothing happened to it since the last look */
+    if (drmmode->detect_current && !drmmode_output->stale &&
+        drmmode_output->mode_output)
+        goto done;
+
+    if (drmmode_output->mode_output)
+        prev_connection = drmmode_output->mode_output->connection;
+
     drmModeFreeConnector(drmmode_output->mode_output);
 
-    drmmode_output->mode_output =
-        drmModeGetConnector(drmmode->fd, drmmode_output->output_id);
+    drmmode_output->mode_output = drmmode_output_fetch(drmmode, drmmode_output,
+                                                       prev_connection);
+    drmmode_output->stale = FALSE;
+    drmmode_output->reprobe = FALSE;
 
     if (!drmmode_output->mode_output)
     {
         drmmode_output->output_id = -1;
+        drmmode_output_flush_modes(drmmode_output);
         xf86DrvMsg(pScrn->scrnIndex, X_INFO,
                    "%s is disconnected\n", output->name);
         return XF86OutputStatusDisconnected;
     }
 
     drmmode_output_update_properties(output);
+    drmmode_output_update_vrr(drmmode, drmmode_output);
 
+done:
     switch (drmmode_output->mode_output->connection)
     {
     case DRM_MODE_CONNECTED:
@@ -595,6 +690,11 @@ xf86OutputStatus drmmode_output_detect(xf86OutputPtr output)
         break;
     case DRM_MODE_DISCONNECTED:
         status = XF86OutputStatusDisconnected;
+        /*
+         * The server drops the EDID of disconnected outputs, a cache hit
+         * after the reconnect must not skip setting it again.
+         */
+        drmmode_output_flush_modes(drmmode_output);
         xf86DrvMsg(pScrn->scrnIndex, X_INFO,
                    "%s is disconnected\n", output->name);
         break;
@@ -758,6 +858,23 @@ static void drmmode_output_attach_tile(xf86OutputPtr output)
 }
 
 
+/* FNV-1a over the kernel's mode list, it changes without the EDID too */
+static uint32_t drmmode_output_modes_hash(drmModeConnectorPtr koutput)
+{
+    const uint8_t *p = (const uint8_t *) koutput->modes;
+    size_t len = koutput->count_modes * sizeof(drmModeModeInfo);
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        hash ^= p[i];
+        hash *= 16777619u;
+    }
+
+    return hash ^ koutput->count_modes;
+}
+
 static DisplayModePtr drmmode_output_get_modes(xf86OutputPtr output)
 {
     drmmode_output_private_ptr drmmode_output = output->driver_private;
@@ -767,9 +884,25 @@ static DisplayModePtr drmmode_output_get_modes(xf86OutputPtr output)
     DisplayModePtr Modes = NULL, Mode;
     xf86MonPtr mon = NULL;
 
+    uint32_t hash;
+
     if (!koutput)
         return NULL;
 
+    /*
+     * Neither the EDID nor the kernel's modes changed, so the parsed EDID
+     * (still in output->MonInfo), the tile and the GTF modes are as well.
+     * The server owns and prunes what we return, hand out a copy.
+     */
+    hash = drmmode_output_modes_hash(koutput);
+    if (drmmode_output->modes_valid &&
+        (output->MonInfo || !drmmode_output->edid_blob) &&
+        (drmmode_output->modes_epoch == drmmode_output->edid_epoch) &&
+        (drmmode_output->modes_hash == hash))
+    {
+        return xf86DuplicateModes(output->scrn, drmmode_output->modes_cache);
+    }
+
     drmModeFreePropertyBlob(drmmode_output->edid_blob);
 
     /* look for an EDID property */
@@ -801,7 +934,15 @@ static DisplayModePtr drmmode_output_get_modes(xf86OutputPtr output)
         Modes = xf86ModesAdd(Modes, Mode);
     }
 
-    return drmmode_output_add_gtf_modes(output, Modes);
+    Modes = drmmode_output_add_gtf_modes(output, Modes);
+
+    drmmode_output_flush_modes(drmmode_output);
+    drmmode_output->modes_cache = xf86DuplicateModes(output->scrn, Modes);
+    drmmode_output->modes_epoch = drmmode_output->edid_epoch;
+    drmmode_output->modes_hash = hash;
+    drmmode_output->modes_valid = TRUE;
+
+    return Modes;
 }
 
 
@@ -813,6 +954,7 @@ static void drmmode_output_destroy(xf86OutputPtr output)
 
     drmModeFreePropertyBlob(drmmode_output->edid_blob);
     drmModeFreePropertyBlob(drmmode_output->tile_blob);
+    drmmode_output_flush_modes(drmmode_output);
 
     for (i = 0; i < drmmode_output->num_props; i++)
     {
@@ -914,6 +1056,9 @@ unsigned int drmmode_output_init(ScrnInfoPtr pScrn,
             drmmode_output = output->driver_private;
             drmmode_output->output_id = mode_res->connectors[num];
             drmmode_output->mode_output = koutput;
+            /* A new connector object, maybe with another sink behind it */
+            drmmode_output->edid_prop_id = 0;
+            drmmode_output->edid_epoch++;
             output->non_desktop = nonDesktop;
             return 1;
         }
@@ -961,6 +1106,7 @@ unsigned int drmmode_output_init(ScrnInfoPtr pScrn,
     drmmode_output->mode_output = koutput;
     drmmode_output->mode_encoders = kencoders;
     drmmode_output->drmmode = drmmode;
+    drmmode_output_update_vrr(drmmode, drmmode_output);
     output->mm_width = koutput->mmWidth;
     output->mm_height = koutput->mmHeight;
 
@@ -3,6 +3,7 @@
 #endif
 
 #include <errno.h>
+#include <stdlib.h>
 #include <sys/mman.h>
 #include <unistd.h>
 #include <malloc.h>
@@ -20,75 +21,58 @@
 #include "loongson_options.h"
 #include "loongson_entity.h"
 #include "drmmode_output.h"
+#include "loongson_debug.h"
 
 #ifdef HAVE_LIBUDEV
 
 #define DRM_MODE_LINK_STATUS_GOOD       0
 #define DRM_MODE_LINK_STATUS_BAD        1
 
-static void drmmode_handle_uevents(int fd, void *closure)
-{
-    drmmode_ptr drmmode = closure;
-    ScrnInfoPtr scrn = drmmode->scrn;
-    struct udev_device *dev;
-    drmModeResPtr mode_res;
-    xf86CrtcConfigPtr  config = XF86_CRTC_CONFIG_PTR(scrn);
-    int i, j;
-    Bool found = FALSE;
-    Bool changed = FALSE;
-
-    while ((dev = udev_monitor_receive_device(drmmode->uevent_monitor))) {
-        udev_device_unref(dev);
-        found = TRUE;
-    }
-    if (!found)
-        return;
-
-    /* Try to re-set the mode on all the connectors with a BAD link-state:
-     * This may happen if a link degrades and a new modeset is necessary, using
-     * different link-training parameters. If the kernel found that the current
-     * mode is not achievable anymore, it should have pruned the mode before
-     * sending the hotplug event. Try to re-set the currently-set mode to keep
-     * the display alive, this will fail if the mode has been pruned.
-     * In any case, we will send randr events for the Desktop Environment to
-     * deal with it, if it wants to.
-     */
-    for (i = 0; i < config->num_output; i++) {
-        xf86OutputPtr output = config->output[i];
-        drmmode_output_private_ptr drmmode_output = output->driver_private;
-
-        drmmode_output_detect(output);
-
-        /* Get an updated view of the properties for the current connector and
-         * look for the link-status property
-         */
-        for (j = 0; j < drmmode_output->num_props; j++) {
-            drmmode_prop_ptr p = &drmmode_output->props[j];
+/*
+ * Hotplug events come in bursts (a KVM switch, an MST hub), collect them
+ * for a while and answer them all with a single RandR update.
+ */
+#define DRMMODE_UEVENT_BATCH_MS         50
 
-            if (!strcmp(p->mode_prop->name, "link-status")) {
-                if (p->value == DRM_MODE_LINK_STATUS_BAD) {
-                    xf86CrtcPtr crtc = output->crtc;
-                    if (!crtc)
-                        continue;
+static void drmmode_uevent_mark_connector(drmmode_ptr drmmode,
+                                          uint32_t connector_id,
+                                          Bool reprobe)
+{
+    xf86CrtcConfigPtr config = XF86_CRTC_CONFIG_PTR(drmmode->scrn);
+    int i;
 
-                    /* the connector got a link failure, re-set the current mode */
-                    drmmode_set_mode_major(crtc, &crtc->mode, crtc->rotation,
-                                           crtc->x, crtc->y);
+    for (i = 0; i < config->num_output; i++)
+    {
+        drmmode_output_private_ptr drmmode_output;
 
-                    xf86DrvMsg(scrn->scrnIndex, X_WARNING,
-                               "hotplug event: connector %u's link-state is BAD, "
-                               "tried resetting the current mode. You may be left"
-                               "with a black screen if this fails...\n",
-                               drmmode_output->mode_output->connector_id);
-                }
-                break;
-            }
+        drmmode_output = config->output[i]->driver_private;
+        if ((uint32_t) drmmode_output->output_id == connector_id)
+        {
+            drmmode_output->stale = TRUE;
+            drmmode_output->reprobe |= reprobe;
+            return;
         }
     }
 
+    /* A connector we don't know about yet */
+    drmmode->uevent_rescan = TRUE;
+}
+
+/*
+ * Look for connectors which came or went. Only needed for events that
+ * don't name a connector, MST for example adds and removes them.
+ */
+static Bool drmmode_uevent_rescan(ScrnInfoPtr scrn, drmmode_ptr drmmode)
+{
+    xf86CrtcConfigPtr config = XF86_CRTC_CONFIG_PTR(scrn);
+    drmModeResPtr mode_res;
+    Bool changed = FALSE;
+    Bool found;
+    int i, j;
+
     mode_res = drmModeGetResources(drmmode->fd);
     if (!mode_res)
-        goto out;
+        return FALSE;
 
     if (mode_res->count_crtcs != config->num_crtc) {
         /* this triggers with Zaphod mode where we don't currently support connector hotplug or MST. */
@@ -140,19 +124,127 @@ static void drmmode_handle_uevents(int fd, void *closure)
         drmmode_output_init(scrn, drmmode, mode_res, i, TRUE, 0);
     }
 
-    if (changed) {
-        RRSetChanged(xf86ScrnToScreen(scrn));
-        RRTellChanged(xf86ScrnToScreen(scrn));
+out_free_res:
+    drmModeFreeResources(mode_res);
+
+    return changed;
+}
+
+static CARD32 drmmode_uevent_timer(OsTimerPtr timer, CARD32 now, void *arg)
+{
+    drmmode_ptr drmmode = arg;
+    ScrnInfoPtr scrn = drmmode->scrn;
+    ScreenPtr pScreen = xf86ScrnToScreen(scrn);
+    xf86CrtcConfigPtr config = XF86_CRTC_CONFIG_PTR(scrn);
+    Bool rescan = drmmode->uevent_rescan;
+    int i, j;
+
+    drmmode->uevent_pending = FALSE;
+    drmmode->uevent_rescan = FALSE;
+
+    drmmode_crtc_config_changed(drmmode);
+
+    drmmode->detect_current = TRUE;
+
+    /* Try to re-set the mode on all the connectors with a BAD link-state:
+     * This may happen if a link degrades and a new modeset is necessary, using
+     * different link-training parameters. If the kernel found that the current
+     * mode is not achievable anymore, it should have pruned the mode before
+     * sending the hotplug event. Try to re-set the currently-set mode to keep
+     * the display alive, this will fail if the mode has been pruned.
+     * In any case, we will send randr events for the Desktop Environment to
+     * deal with it, if it wants to.
+     */
+    for (i = 0; i < config->num_output; i++) {
+        xf86OutputPtr output = config->output[i];
+        drmmode_output_private_ptr drmmode_output = output->driver_private;
+
+        if (rescan) {
+            drmmode_output->stale = TRUE;
+            drmmode_output->reprobe = TRUE;
+        }
+
+        if (!drmmode_output->stale)
+            continue;
+
+        drmmode_output_detect(output);
+
+        /* Get an updated view of the properties for the current connector and
+         * look for the link-status property
+         */
+        for (j = 0; j < drmmode_output->num_props; j++) {
+            drmmode_prop_ptr p = &drmmode_output->props[j];
+
+            if (!strcmp(p->mode_prop->name, "link-status")) {
+                if (p->value == DRM_MODE_LINK_STATUS_BAD) {
+                    xf86CrtcPtr crtc = output->crtc;
+                    if (!crtc)
+                        continue;
+
+                    /* the connector got a link failure, re-set the current mode */
+                    drmmode_set_mode_major(crtc, &crtc->mode, crtc->rotation,
+                                           crtc->x, crtc->y);
+
+                    xf86DrvMsg(scrn->scrnIndex, X_WARNING,
+                               "hotplug event: connector %u's link-state is BAD, "
+                               "tried resetting the current mode. You may be left"
+                               "with a black screen if this fails...\n",
+                               drmmode_output->mode_output->connector_id);
+                }
+                break;
+            }
+        }
     }
 
-out_free_res:
+    if (rescan && drmmode_uevent_rescan(scrn, drmmode)) {
+        RRSetChanged(pScreen);
+        RRTellChanged(pScreen);
+    }
 
     /* Check to see if a lessee has disappeared */
     drmmode_validate_leases(scrn);
 
-    drmModeFreeResources(mode_res);
-out:
-    RRGetInfo(xf86ScrnToScreen(scrn), TRUE);
+    /* Outputs which are not stale answer from what we already have */
+    RRGetInfo(pScreen, TRUE);
+
+    drmmode->detect_current = FALSE;
+
+    return 0;
+}
+
+static void drmmode_handle_uevents(int fd, void *closure)
+{
+    drmmode_ptr drmmode = closure;
+    struct udev_device *dev;
+    Bool found = FALSE;
+
+    while ((dev = udev_monitor_receive_device(drmmode->uevent_monitor))) {
+        const char *hotplug = udev_device_get_property_value(dev, "HOTPLUG");
+        const char *connector = udev_device_get_property_value(dev, "CONNECTOR");
+        const char *property = udev_device_get_property_value(dev, "PROPERTY");
+
+        if (hotplug && connector && !strcmp(hotplug, "1")) {
+            DEBUG_MSG("hotplug: connector %s, property %s",
+                      connector, property ? property : "none");
+
+            /* PROPERTY= only says a connector property changed */
+            drmmode_uevent_mark_connector(drmmode, strtoul(connector, NULL, 10),
+                                          property == NULL);
+        } else {
+            /* Not specific about what changed, could also be a lease going away */
+            drmmode->uevent_rescan = TRUE;
+        }
+
+        udev_device_unref(dev);
+        found = TRUE;
+    }
+    if (!found || drmmode->uevent_pending)
+        return;
+
+    drmmode->uevent_pending = TRUE;
+    drmmode->uevent_timer = TimerSet(drmmode->uevent_timer, 0,
+                                     DRMMODE_UEVENT_BATCH_MS,
+                                     drmmode_uevent_timer, drmmode);
 }
 
 #undef DRM_MODE_LINK_STATUS_BAD
@@ -205,6 +297,10 @@ void drmmode_uevent_fini(ScrnInfoPtr scrn, drmmode_ptr drmmode)
 
         xf86RemoveGeneralHandler(drmmode->uevent_handler);
 
+        TimerFree(drmmode->uevent_timer);
+        drmmode->uevent_timer = NULL;
+        drmmode->uevent_pending = FALSE;
+
         udev_monitor_unref(drmmode->uevent_monitor);
         udev_unref(u);
     }
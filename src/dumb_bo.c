@@ -83,7 +83,7 @@ struct dumb_bo *dumb_bo_create(int fd,
 }
 
 
-int dumb_bo_map(int fd, struct dumb_bo * const bo)
+static int dumb_bo_map_flags(int fd, struct dumb_bo * const bo, int flags)
 {
     struct drm_mode_map_dumb arg;
     int ret;
@@ -103,7 +103,8 @@ int dumb_bo_map(int fd, struct dumb_bo * const bo)
         return ret;
     }
 
-    map = mmap(0, bo->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, arg.offset);
+    map = mmap(0, bo->size, PROT_READ | PROT_WRITE, MAP_SHARED | flags,
+               fd, arg.offset);
     if (map == MAP_FAILED)
     {
         return -errno;
@@ -113,6 +114,17 @@ int dumb_bo_map(int fd, struct dumb_bo * const bo)
     return 0;
 }
 
+int dumb_bo_map(int fd, struct dumb_bo * const bo)
+{
+    return dumb_bo_map_flags(fd, bo, 0);
+}
+
+/* Map and fault in every page now, instead of on first touch */
+int dumb_bo_map_populate(int fd, struct dumb_bo * const bo)
+{
+    return dumb_bo_map_flags(fd, bo, MAP_POPULATE);
+}
+
 void dumb_bo_unmap(struct dumb_bo * const bo)
 {
     if (bo->ptr)
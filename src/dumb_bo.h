@@ -37,6 +37,7 @@ struct dumb_bo *dumb_bo_create(int fd,
                                unsigned int height,
                                unsigned int bpp);
 int dumb_bo_map(int fd, struct dumb_bo * const bo);
+int dumb_bo_map_populate(int fd, struct dumb_bo * const bo);
 void dumb_bo_unmap(struct dumb_bo * const bo);
 int dumb_bo_destroy(int fd, struct dumb_bo * const bo);
 uint32_t dumb_bo_pitch(struct dumb_bo * const bo);
@@ -32,6 +32,7 @@
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <sys/stat.h>
 
 #include <xf86.h>
@@ -43,8 +44,11 @@
 
 #include "driver.h"
 #include "etnaviv_dri3.h"
+#include "loongson_dri3.h"
 #include "loongson_debug.h"
+#include "loongson_stats.h"
 #include "loongson_pixmap.h"
+#include "loongson_exa.h"
 
 static Bool etnaviv_dri3_authorise(struct EtnavivRec *pGpu, int fd)
 {
@@ -136,13 +140,24 @@ static int etnaviv_dri3_open(ScreenPtr pScreen, RRProviderPtr provider, int *o)
     return Success;
 }
 
+/*
+ * The GPU renders (super) tiled, and the EXA copy path knows how to
+ * detile those, so they are fine for buffers which only get composited.
+ */
+static const uint64_t etnaviv_dri3_modifiers[] = {
+    DRM_FORMAT_MOD_LINEAR,
+    DRM_FORMAT_MOD_VIVANTE_TILED,
+    DRM_FORMAT_MOD_VIVANTE_SUPER_TILED,
+};
+
 static PixmapPtr etnaviv_dri3_pixmap_from_fd(ScreenPtr pScreen,
                                              int dmabuf_fd,
                                              CARD16 width,
                                              CARD16 height,
                                              CARD16 stride,
                                              CARD8 depth,
-                                             CARD8 bpp)
+                                             CARD8 bpp,
+                                             uint64_t modifier)
 {
     ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
     loongsonPtr lsp = loongsonPTR(pScrn);
@@ -151,6 +166,7 @@ static PixmapPtr etnaviv_dri3_pixmap_from_fd(ScreenPtr pScreen,
     struct exa_pixmap_priv *priv = NULL;
     PixmapPtr pPixmap = NULL;
     Bool ret;
+    LS_STATS_BEGIN(t);
 
     TRACE_ENTER();
 
@@ -189,19 +205,51 @@ static PixmapPtr etnaviv_dri3_pixmap_from_fd(ScreenPtr pScreen,
 
     priv->etna_bo = ebo;
     priv->pitch = stride;
-    priv->fd = dmabuf_fd;
+    /* The server closes the client's fd, keep our own as the export */
+    priv->fd = fcntl(dmabuf_fd, F_DUPFD_CLOEXEC, 0);
     priv->is_dumb = FALSE;
     priv->width = width;
     priv->height = height;
+    priv->modifier = modifier;
+    priv->tiling_info = modifier;
 
-    /* TODO; get it for the bo */
-    priv->tiling_info = DRM_FORMAT_MOD_VIVANTE_TILED;
-
-    priv->tiling_info = DRM_FORMAT_MOD_VIVANTE_SUPER_TILED;
+    LS_STATS_END(LS_STAT_DRI3_IMPORT, t, (uint64_t)stride * height);
 
     return pPixmap;
 }
 
+static PixmapPtr etnaviv_dri3_pixmap_from_fds(ScreenPtr pScreen,
+                                              CARD8 num_fds,
+                                              const int *fds,
+                                              CARD16 width,
+                                              CARD16 height,
+                                              const CARD32 *strides,
+                                              const CARD32 *offsets,
+                                              CARD8 depth,
+                                              CARD8 bpp,
+                                              uint64_t modifier)
+{
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+
+    /* Clients without modifier support render super tiled */
+    if (modifier == DRM_FORMAT_MOD_INVALID)
+        modifier = DRM_FORMAT_MOD_VIVANTE_SUPER_TILED;
+
+    if ((num_fds != 1) || offsets[0] || (strides[0] > UINT16_MAX) ||
+        !LS_DRI3_IsModifierSupported(etnaviv_dri3_modifiers,
+                                     ARRAY_SIZE(etnaviv_dri3_modifiers),
+                                     modifier))
+    {
+        xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+                   "DRI3: num_fds=%d, offsets[0]=%u, modifier=0x%" PRIx64
+                   " not supported\n", num_fds, offsets[0], modifier);
+        return NullPixmap;
+    }
+
+    return etnaviv_dri3_pixmap_from_fd(pScreen, fds[0], width, height,
+                                       strides[0], depth, bpp, modifier);
+}
+
 static struct etna_bo *
 etna_bo_from_pixmap(ScreenPtr pScreen, PixmapPtr pPixmap)
 {
@@ -245,7 +293,9 @@ static int etnaviv_dri3_fd_from_pixmap(ScreenPtr pScreen,
         return -1;
     }
 
-    prime_fd = etna_bo_dmabuf(bo);
+    prime_fd = loongson_exa_dup_dmabuf_fd(pScrn, pPixmap);
+    if (prime_fd < 0)
+        return -1;
 
     *stride = pPixmap->devKind;
     *size = etna_bo_size(bo);
@@ -255,11 +305,36 @@ static int etnaviv_dri3_fd_from_pixmap(ScreenPtr pScreen,
     return prime_fd;
 }
 
+static Bool etnaviv_dri3_get_modifiers(ScreenPtr pScreen,
+                                       uint32_t format,
+                                       uint32_t *num_modifiers,
+                                       uint64_t **modifiers)
+{
+    return LS_DRI3_GetModifiers(pScreen, format,
+                                etnaviv_dri3_modifiers,
+                                ARRAY_SIZE(etnaviv_dri3_modifiers),
+                                num_modifiers, modifiers);
+}
+
+static Bool etnaviv_dri3_get_drawable_modifiers(DrawablePtr draw,
+                                                uint32_t format,
+                                                uint32_t *num_modifiers,
+                                                uint64_t **modifiers)
+{
+    return LS_DRI3_GetDrawableModifiers(draw, format,
+                                        etnaviv_dri3_modifiers,
+                                        ARRAY_SIZE(etnaviv_dri3_modifiers),
+                                        num_modifiers, modifiers);
+}
+
 static dri3_screen_info_rec etnaviv_dri3_info = {
-    .version = 0,
+    .version = 2,
     .open = etnaviv_dri3_open,
-    .pixmap_from_fd = etnaviv_dri3_pixmap_from_fd,
+    .pixmap_from_fds = etnaviv_dri3_pixmap_from_fds,
     .fd_from_pixmap = etnaviv_dri3_fd_from_pixmap,
+    .get_formats = LS_DRI3_GetFormats,
+    .get_modifiers = etnaviv_dri3_get_modifiers,
+    .get_drawable_modifiers = etnaviv_dri3_get_drawable_modifiers,
 };
 
 
@@ -43,6 +43,9 @@
 #include "loongson_options.h"
 #include "loongson_pixmap.h"
 #include "loongson_debug.h"
+#include "loongson_stats.h"
+#include "loongson_exa_trace.h"
+#include "loongson_usdt.h"
 
 #include "common.xml.h"
 
@@ -117,6 +120,8 @@ static Bool etnaviv_exa_prepare_access(PixmapPtr pPix, int index)
     struct exa_pixmap_priv *priv = exaGetPixmapDriverPrivate(pPix);
     void *ptr = NULL;
 
+    LS_EXA_TRACE(Access, LS_EXA_TRACE_PREPARE_ACCESS, pPix, index);
+
     if (pPix->devPrivate.ptr)
     {
         DEBUG_MSG("Pixmap %p: already prepared\n", pPix);
@@ -130,6 +135,9 @@ static Bool etnaviv_exa_prepare_access(PixmapPtr pPix, int index)
         return FALSE;
     }
 
+    /* Shared buffers may still be rendered to by a client */
+    LS_SyncPrepareAccess(pPix, index);
+
     if (priv->bo)
     {
         int ret = dumb_bo_map(pDrmMode->fd, priv->bo);
@@ -192,6 +200,8 @@ static void etnaviv_exa_finish_access(PixmapPtr pPixmap, int index)
     if (!priv)
         return;
 
+    LS_EXA_TRACE(Access, LS_EXA_TRACE_FINISH_ACCESS, pPixmap, index);
+
     if (priv && priv->bo)
     {
         // dumb_bo_unmap(priv->bo);
@@ -243,6 +253,10 @@ static void ms_exa_solid(PixmapPtr pPixmap, int x1, int y1, int x2, int y2)
     ScreenPtr screen = pPixmap->drawable.pScreen;
     GCPtr gc = GetScratchGC(pPixmap->drawable.depth, screen);
     ChangeGCVal val[3];
+    LS_STATS_BEGIN(t);
+
+    LS_EXA_TRACE(Solid, pPixmap, exa_prepare_args.solid.alu,
+                 exa_prepare_args.solid.fg, x1, y1, x2, y2);
 
     val[0].val = exa_prepare_args.solid.alu;
     val[1].val = exa_prepare_args.solid.planemask;
@@ -255,6 +269,9 @@ static void ms_exa_solid(PixmapPtr pPixmap, int x1, int y1, int x2, int y2)
     etnaviv_exa_finish_access(pPixmap, 0);
 
     FreeScratchGC(gc);
+
+    LS_STATS_END(LS_STAT_SOLID, t, (uint64_t)(x2 - x1) * (y2 - y1) *
+                 pPixmap->drawable.bitsPerPixel / 8);
 }
 
 
@@ -510,6 +527,7 @@ static void etnaviv_exa_do_copy(PixmapPtr pDstPixmap,
     struct exa_pixmap_priv *src_priv;
     ChangeGCVal val[2];
     GCPtr gc;
+    LS_STATS_BEGIN(t);
 
     gc = GetScratchGC(pDstPixmap->drawable.depth, screen);
 
@@ -518,11 +536,23 @@ static void etnaviv_exa_do_copy(PixmapPtr pDstPixmap,
     ChangeGC(NullClient, gc, GCFunction | GCPlaneMask, val);
     ValidateGC(&pDstPixmap->drawable, gc);
 
-    etnaviv_exa_prepare_access(pSrcPixmap, 0);
-    etnaviv_exa_prepare_access(pDstPixmap, 0);
+    etnaviv_exa_prepare_access(pSrcPixmap, EXA_PREPARE_SRC);
+    etnaviv_exa_prepare_access(pDstPixmap, EXA_PREPARE_DEST);
 
     src_priv = exaGetPixmapDriverPrivate(pSrcPixmap);
 
+    LS_PROBE2(etnaviv_copy_entry,
+              width * height * (pDstPixmap->drawable.bitsPerPixel / 8),
+              src_priv->tiling_info);
+
+    LS_EXA_TRACE(Copy, pSrcPixmap, pDstPixmap,
+                 src_priv->tiling_info == DRM_FORMAT_MOD_VIVANTE_TILED ?
+                 LS_EXA_TRACE_ETNAVIV_TILED :
+                 src_priv->tiling_info == DRM_FORMAT_MOD_VIVANTE_SUPER_TILED ?
+                 LS_EXA_TRACE_ETNAVIV_SUPER_TILED : LS_EXA_TRACE_LINEAR,
+                 exa_prepare_args.copy.alu,
+                 srcX, srcY, dstX, dstY, width, height);
+
     /* TODO: check its format */
     if (src_priv->tiling_info == DRM_FORMAT_MOD_VIVANTE_TILED)
     {
@@ -537,11 +567,9 @@ static void etnaviv_exa_do_copy(PixmapPtr pDstPixmap,
     }
     else if (src_priv->tiling_info == DRM_FORMAT_MOD_VIVANTE_SUPER_TILED)
     {
-        struct etna_bo *etna_bo;
-
-        etna_bo = src_priv->etna_bo;
-        etna_bo_cpu_prep(etna_bo, DRM_ETNA_PREP_READ);
-
+        /* prepare_access above already waited, and only if the client
+         * was still rendering to it
+         */
         miDoCopy(&pSrcPixmap->drawable,
                  &pDstPixmap->drawable,
                  gc,
@@ -550,8 +578,6 @@ static void etnaviv_exa_do_copy(PixmapPtr pDstPixmap,
                  dstX, dstY,
                  etnaviv_blit_supertile_n_to_n,
                  0, 0);
-
-        etna_bo_cpu_fini(etna_bo);
     }
     else
     {
@@ -565,10 +591,18 @@ static void etnaviv_exa_do_copy(PixmapPtr pDstPixmap,
                  0, 0);
     }
 
-    etnaviv_exa_finish_access(pDstPixmap, 0);
-    etnaviv_exa_finish_access(pSrcPixmap, 0);
+    etnaviv_exa_finish_access(pDstPixmap, EXA_PREPARE_DEST);
+    etnaviv_exa_finish_access(pSrcPixmap, EXA_PREPARE_SRC);
 
     FreeScratchGC(gc);
+
+    LS_PROBE(etnaviv_copy_return);
+
+    LS_STATS_END((src_priv->tiling_info == DRM_FORMAT_MOD_VIVANTE_TILED ||
+                  src_priv->tiling_info == DRM_FORMAT_MOD_VIVANTE_SUPER_TILED) ?
+                 LS_STAT_RESOLVE : LS_STAT_COPY, t,
+                 (uint64_t)width * height *
+                 pDstPixmap->drawable.bitsPerPixel / 8);
 }
 
 
@@ -616,6 +650,11 @@ static void ms_exa_composite(PixmapPtr pDst, int srcX, int srcY,
     PixmapPtr pSrc = exa_prepare_args.composite.pSrc;
     PixmapPtr pMask = exa_prepare_args.composite.pMask;
     int op = exa_prepare_args.composite.op;
+    LS_STATS_BEGIN(t);
+
+    LS_EXA_TRACE(Composite, op, pSrcPicture, pMaskPicture, pDstPicture,
+                 pSrc, pMask, pDst, srcX, srcY, maskX, maskY,
+                 dstX, dstY, width, height);
 
     if (pMask)
     {
@@ -635,6 +674,9 @@ static void ms_exa_composite(PixmapPtr pDst, int srcX, int srcY,
     {
         etnaviv_exa_finish_access(pMask, 0);
     }
+
+    LS_STATS_END(LS_STAT_COMPOSITE, t, (uint64_t)width * height *
+                 pDst->drawable.bitsPerPixel / 8);
 }
 
 static void ms_exa_composite_done(PixmapPtr pPixmap)
@@ -688,6 +730,7 @@ etnaviv_exa_upload_to_screen(PixmapPtr pPix,
     int cpp;
     int i;
     Bool ret;
+    LS_STATS_BEGIN(t);
 
     if (!priv)
     {
@@ -695,6 +738,8 @@ etnaviv_exa_upload_to_screen(PixmapPtr pPix,
         return FALSE;
     }
 
+    LS_EXA_TRACE(Upload, pPix, x, y, w, h);
+
     cpp = (pPix->drawable.bitsPerPixel + 7) / 8;
 
     ret = etnaviv_exa_prepare_access(pPix, 0);
@@ -723,6 +768,8 @@ etnaviv_exa_upload_to_screen(PixmapPtr pPix,
 
     etnaviv_exa_finish_access(pPix, 0);
 
+    LS_STATS_END(LS_STAT_UPLOAD, t, (uint64_t)w * h * cpp);
+
     return TRUE;
 }
 
@@ -773,6 +820,7 @@ etnaviv_exa_download_from_screen(PixmapPtr pPix,
     unsigned int len;
     int cpp;
     int i;
+    LS_STATS_BEGIN(t);
 
     if (!priv)
     {
@@ -780,6 +828,8 @@ etnaviv_exa_download_from_screen(PixmapPtr pPix,
         return FALSE;
     }
 
+    LS_EXA_TRACE(Download, pPix, x, y, w, h);
+
     cpp = (pPix->drawable.bitsPerPixel + 7) / 8;
 
     etnaviv_exa_prepare_access(pPix, 0);
@@ -804,17 +854,18 @@ etnaviv_exa_download_from_screen(PixmapPtr pPix,
 
     etnaviv_exa_finish_access(pPix, 0);
 
+    LS_STATS_END(LS_STAT_DOWNLOAD, t, (uint64_t)w * h * cpp);
+
     return TRUE;
 }
 
 static void etnaviv_exa_wait_marker(ScreenPtr pScreen, int marker)
 {
-    // TODO:
+    /* No GPU work of our own, shared BOs wait in prepare_access */
 }
 
 static int etnaviv_exa_mark_sync(ScreenPtr pScreen)
 {
-    // TODO: return latest request(marker).
     return 0;
 }
 
@@ -889,7 +940,7 @@ static void etnaviv_exa_destroy_pixmap(ScreenPtr pScreen, void *driverPriv)
 
     if (priv->fd > 0)
     {
-        drmClose(priv->fd);
+        close(priv->fd);
         priv->fd = -1;
     }
 
@@ -29,6 +29,7 @@
 #endif
 
 #include "etnaviv_resolve.h"
+#include "loongson_usdt.h"
 
 /*
     from: 4x32 pixel
@@ -131,6 +132,9 @@ Bool etnaviv_supertile_to_linear_generic(uint32_t *src_bits,
     int remain_y = height & 63;
     int i, j;
 
+    LS_PROBE3(etnaviv_supertile_resolve_entry,
+              width, height, width * height * 4);
+
     dst_bits += dst_stride * dst_y + dst_x;
     src_bits += src_stride * src_y + src_x;
 
@@ -179,5 +183,7 @@ Bool etnaviv_supertile_to_linear_generic(uint32_t *src_bits,
         }
     }
 
+    LS_PROBE(etnaviv_supertile_resolve_return);
+
     return TRUE;
 }
@@ -34,6 +34,7 @@
 
 #include "loongson_debug.h"
 #include "etnaviv_resolve.h"
+#include "loongson_usdt.h"
 #include "write_bmp.h"
 
 /* TODO: provide a none simd version */
@@ -51,6 +52,8 @@ Bool lsx_resolve_etnaviv_tile_4x4(uint32_t *src_bits,
 {
     TRACE_ENTER();
 
+    LS_PROBE3(etnaviv_tile_resolve_entry, width, height, width * height * 4);
+
 #ifdef HAVE_LSX
     int src_stride_tiled = src_stride * 4;
     int dst_stride_tiled = dst_stride * 4;
@@ -95,6 +98,8 @@ Bool lsx_resolve_etnaviv_tile_4x4(uint32_t *src_bits,
     }
 #endif
 
+    LS_PROBE(etnaviv_tile_resolve_return);
+
     TRACE_EXIT();
 
     return TRUE;
@@ -877,6 +882,9 @@ Bool etnaviv_supertile_to_linear_lsx(uint32_t *src_bits,
     int dst_stride_bytes = dst_stride * 4;
     int i, j;
 
+    LS_PROBE3(etnaviv_supertile_resolve_entry,
+              width, height, width * height * 4);
+
     dst_bits += dst_stride * dst_y + dst_x;
     src_bits += src_stride * src_y + src_x;
 
@@ -921,5 +929,7 @@ Bool etnaviv_supertile_to_linear_lsx(uint32_t *src_bits,
         }
     }
 
+    LS_PROBE(etnaviv_supertile_resolve_return);
+
     return TRUE;
 }
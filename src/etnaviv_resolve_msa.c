@@ -30,6 +30,7 @@
 
 #include <msa.h>
 #include "etnaviv_resolve.h"
+#include "loongson_usdt.h"
 
 
 /*
@@ -665,6 +666,9 @@ Bool etnaviv_supertile_to_linear_msa(uint32_t *src_bits,
     int remain_y = height & 63;
     int i, j;
 
+    LS_PROBE3(etnaviv_supertile_resolve_entry,
+              width, height, width * height * 4);
+
     dst_bits += dst_stride * dst_y + dst_x;
     src_bits += src_stride * src_y + src_x;
 
@@ -714,5 +718,7 @@ Bool etnaviv_supertile_to_linear_msa(uint32_t *src_bits,
         }
     }
 
+    LS_PROBE(etnaviv_supertile_resolve_return);
+
     return TRUE;
 }
@@ -42,6 +42,8 @@
 #include "loongson_options.h"
 #include "loongson_pixmap.h"
 #include "loongson_debug.h"
+#include "loongson_stats.h"
+#include "loongson_exa_trace.h"
 
 
 static struct ms_exa_prepare_args fake_exa_prepare_args = {{0}};
@@ -99,6 +101,12 @@ static Bool fake_exa_prepare_access(PixmapPtr pPix, int index)
     struct exa_pixmap_priv *priv = exaGetPixmapDriverPrivate(pPix);
     int ret;
 
+    LS_EXA_TRACE(Access, LS_EXA_TRACE_PREPARE_ACCESS, pPix, index);
+
+    /* Client buffers are accessed through their dma-buf */
+    if (priv->dmabuf_import)
+        return LS_DmaBufPrepareAccess(pPix, index);
+
     if (pPix->devPrivate.ptr)
     {
         DEBUG_MSG("%s: already prepared\n", __func__);
@@ -106,6 +114,9 @@ static Bool fake_exa_prepare_access(PixmapPtr pPix, int index)
         return TRUE;
     }
 
+    /* Exported buffers may still be rendered to by a client */
+    LS_SyncPrepareAccess(pPix, index);
+
     if (priv->bo)
     {
         ret = dumb_bo_map(pDrmMode->fd, priv->bo);
@@ -150,6 +161,14 @@ static void fake_exa_finish_access(PixmapPtr pPixmap, int index)
     if (!priv)
         return;
 
+    LS_EXA_TRACE(Access, LS_EXA_TRACE_FINISH_ACCESS, pPixmap, index);
+
+    if (priv->dmabuf_import)
+    {
+        LS_DmaBufFinishAccess(pPixmap, index);
+        return;
+    }
+
     if (priv->pBuf)
     {
         pPixmap->devPrivate.ptr = NULL;
@@ -213,6 +232,10 @@ static void ms_exa_solid(PixmapPtr pPixmap, int x1, int y1, int x2, int y2)
     ScreenPtr screen = pPixmap->drawable.pScreen;
     GCPtr gc = GetScratchGC(pPixmap->drawable.depth, screen);
     ChangeGCVal val[3];
+    LS_STATS_BEGIN(t);
+
+    LS_EXA_TRACE(Solid, pPixmap, fake_exa_prepare_args.solid.alu,
+                 fake_exa_prepare_args.solid.fg, x1, y1, x2, y2);
 
     val[0].val = fake_exa_prepare_args.solid.alu;
     val[1].val = fake_exa_prepare_args.solid.planemask;
@@ -225,6 +248,9 @@ static void ms_exa_solid(PixmapPtr pPixmap, int x1, int y1, int x2, int y2)
     fake_exa_finish_access(pPixmap, 0);
 
     FreeScratchGC(gc);
+
+    LS_STATS_END(LS_STAT_SOLID, t, (uint64_t)(x2 - x1) * (y2 - y1) *
+                 pPixmap->drawable.bitsPerPixel / 8);
 }
 
 
@@ -259,6 +285,11 @@ static void ms_exa_copy(PixmapPtr pDstPixmap, int srcX, int srcY,
     ScreenPtr screen = pDstPixmap->drawable.pScreen;
     ChangeGCVal val[2];
     GCPtr gc;
+    LS_STATS_BEGIN(t);
+
+    LS_EXA_TRACE(Copy, pSrcPixmap, pDstPixmap, LS_EXA_TRACE_LINEAR,
+                 fake_exa_prepare_args.copy.alu,
+                 srcX, srcY, dstX, dstY, width, height);
 
     gc = GetScratchGC(pDstPixmap->drawable.depth, screen);
 
@@ -277,6 +308,9 @@ static void ms_exa_copy(PixmapPtr pDstPixmap, int srcX, int srcY,
     fake_exa_finish_access(pSrcPixmap, 0);
 
     FreeScratchGC(gc);
+
+    LS_STATS_END(LS_STAT_COPY, t, (uint64_t)width * height *
+                 pDstPixmap->drawable.bitsPerPixel / 8);
 }
 
 static void ms_exa_copy_done(PixmapPtr pPixmap)
@@ -327,6 +361,11 @@ static void ms_exa_composite(PixmapPtr pDst, int srcX, int srcY,
     PixmapPtr pSrc = fake_exa_prepare_args.composite.pSrc;
     PixmapPtr pMask = fake_exa_prepare_args.composite.pMask;
     int op = fake_exa_prepare_args.composite.op;
+    LS_STATS_BEGIN(t);
+
+    LS_EXA_TRACE(Composite, op, pSrcPicture, pMaskPicture, pDstPicture,
+                 pSrc, pMask, pDst, srcX, srcY, maskX, maskY,
+                 dstX, dstY, width, height);
 
     if (pMask)
     {
@@ -346,6 +385,9 @@ static void ms_exa_composite(PixmapPtr pDst, int srcX, int srcY,
     {
         fake_exa_finish_access(pMask, 0);
     }
+
+    LS_STATS_END(LS_STAT_COMPOSITE, t, (uint64_t)width * height *
+                 pDst->drawable.bitsPerPixel / 8);
 }
 
 static void ms_exa_composite_done(PixmapPtr pPixmap)
@@ -398,10 +440,13 @@ static Bool fake_exa_upload_to_screen(PixmapPtr pPix,
     unsigned int len;
     int cpp;
     int i;
+    LS_STATS_BEGIN(t);
 
     if (priv == NULL)
         return FALSE;
 
+    LS_EXA_TRACE(Upload, pPix, x, y, w, h);
+
     cpp = (pPix->drawable.bitsPerPixel + 7) / 8;
 
     fake_exa_prepare_access(pPix, 0);
@@ -421,6 +466,8 @@ static Bool fake_exa_upload_to_screen(PixmapPtr pPix,
 
     fake_exa_finish_access(pPix, 0);
 
+    LS_STATS_END(LS_STAT_UPLOAD, t, (uint64_t)w * h * cpp);
+
     return TRUE;
 }
 
@@ -468,6 +515,9 @@ static Bool fake_exa_download_from_screen(PixmapPtr pPix,
     unsigned int src_stride;
     unsigned int len;
     int i;
+    LS_STATS_BEGIN(t);
+
+    LS_EXA_TRACE(Download, pPix, x, y, w, h);
 
     fake_exa_prepare_access(pPix, 0);
 
@@ -495,12 +545,14 @@ static Bool fake_exa_download_from_screen(PixmapPtr pPix,
 
     fake_exa_finish_access(pPix, 0);
 
+    LS_STATS_END(LS_STAT_DOWNLOAD, t, (uint64_t)w * h * cpp);
+
     return TRUE;
 }
 
 static void fake_exa_wait_marker(ScreenPtr pScreen, int marker)
 {
-    // TODO:
+    /* No GPU work of our own, shared BOs wait in prepare_access */
 }
 
 /**
@@ -517,7 +569,6 @@ static void fake_exa_wait_marker(ScreenPtr pScreen, int marker)
  */
 static int fake_exa_mark_sync(ScreenPtr pScreen)
 {
-    // TODO: return latest request(marker).
     return 0;
 }
 
@@ -79,12 +79,6 @@ Bool gsgpu_set_pixmap_bo(ScrnInfoPtr pScrn,
     struct gsgpu_bo_info bo_info;
     int ret;
 
-    if (priv->fd > 0)
-    {
-        // destroy old backing memory, and update it with new.
-        close(priv->fd);
-    }
-
     if (priv->gbo)
     {
         if (priv->gbo == gbo)
@@ -92,6 +86,9 @@ Bool gsgpu_set_pixmap_bo(ScrnInfoPtr pScrn,
             xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
                        "%s: pixmap bo is already setted\n", __func__);
 
+            if (prime_fd > 0)
+                close(prime_fd);
+
             return TRUE;
         }
 
@@ -117,6 +114,12 @@ Bool gsgpu_set_pixmap_bo(ScrnInfoPtr pScrn,
                    pPixmap, priv->tiling_info);
     }
 
+    // destroy old backing memory, and update it with new.
+    LS_DmaBufRelease(priv);
+
+    if (priv->fd > 0)
+        close(priv->fd);
+
     priv->gbo = gbo;
     priv->fd = prime_fd;
 
@@ -52,6 +52,10 @@
 #include "loongson_prime.h"
 #include "loongson_pixmap.h"
 #include "loongson_debug.h"
+#include "loongson_dri2_pool.h"
+#include "loongson_stats.h"
+#include "loongson_usdt.h"
+#include "loongson_dri2_damage.h"
 
 
 enum gsgpu_dri2_frame_event_type {
@@ -76,11 +80,15 @@ struct gsgpu_dri2_frame_event {
     void *event_data;
     DRI2BufferPtr front;
     DRI2BufferPtr back;
+    /* when the client asked for the swap, for the frame timing stats */
+    uint64_t request_us;
 };
 
 struct gsgpu_dri2_buffer_private {
     int refcnt;
     PixmapPtr pixmap;
+    /* the drawable whose pool the pixmap goes back to */
+    XID drawable_id;
 };
 
 static DevPrivateKeyRec gsgpu_dri2_client_key;
@@ -187,7 +195,9 @@ gsgpu_dri2_create_buffer2(ScreenPtr pScreen,
     PixmapPtr pPixmap = NULL;
     DRI2Buffer2Ptr buffer;
     struct gsgpu_dri2_buffer_private *private;
+    Bool pooled = FALSE;
     Bool res;
+    LS_STATS_BEGIN(t);
 
     TRACE_ENTER();
 
@@ -246,11 +256,16 @@ gsgpu_dri2_create_buffer2(ScreenPtr pScreen,
             return NULL;
         }
 
-        pPixmap = pScreen->CreatePixmap(pScreen,
-                                        pixmap_width,
-                                        pixmap_height,
-                                        pixmap_cpp,
-                                        0);
+        pPixmap = LS_DRI2PoolTake(drawable, attachment, pixmap_cpp,
+                                  &buffer->name, &buffer->pitch);
+        if (pPixmap)
+            pooled = TRUE;
+        else
+            pPixmap = pScreen->CreatePixmap(pScreen,
+                                            pixmap_width,
+                                            pixmap_height,
+                                            pixmap_cpp,
+                                            0);
         if (pPixmap == NULL)
         {
             free(private);
@@ -267,21 +282,29 @@ gsgpu_dri2_create_buffer2(ScreenPtr pScreen,
      */
     buffer->flags = 0;
 
-    res = gsgpu_get_flink_name(lsp->fd, pPixmap, &buffer->name);
-    if (res == FALSE)
+    if (!pooled)
     {
-        xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-                   "Failed to get DRI2 name for pixmap\n");
-        pScreen->DestroyPixmap(pPixmap);
-        free(private);
-        free(buffer);
-        return NULL;
+        res = gsgpu_get_flink_name(lsp->fd, pPixmap, &buffer->name);
+        if (res == FALSE)
+        {
+            xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+                       "Failed to get DRI2 name for pixmap\n");
+            pScreen->DestroyPixmap(pPixmap);
+            free(private);
+            free(buffer);
+            return NULL;
+        }
+
+        buffer->pitch = pPixmap->devKind;
     }
 
-    buffer->pitch = pPixmap->devKind;
     buffer->driverPrivate = private;
     private->refcnt = 1;
     private->pixmap = pPixmap;
+    private->drawable_id = drawable->id;
+
+    LS_STATS_END(LS_STAT_DRI2_IMPORT, t,
+                 (uint64_t)buffer->pitch * pPixmap->drawable.height);
 
     TRACE_EXIT();
 
@@ -332,7 +355,9 @@ static void gsgpu_dri2_destroy_buffer2(ScreenPtr pScreen,
         struct gsgpu_dri2_buffer_private *private = buffer->driverPrivate;
         if (--private->refcnt == 0)
         {
-             if (private->pixmap)
+            if (private->pixmap &&
+                !LS_DRI2PoolPut(private->drawable_id, buffer->attachment,
+                                private->pixmap, buffer->name, buffer->pitch))
                 pScreen->DestroyPixmap(private->pixmap);
 
             free(private);
@@ -532,16 +557,34 @@ static void gsgpu_dri2_blit_swap(DrawablePtr drawable,
                                  DRI2BufferPtr dst,
                                  DRI2BufferPtr src)
 {
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(drawable->pScreen);
+    loongsonPtr lsp = loongsonPTR(pScrn);
+    struct drmmode_rec * const pDrmMode = &lsp->drmmode;
+    struct gsgpu_dri2_buffer_private *src_priv = src->driverPrivate;
     BoxRec box;
     RegionRec region;
 
-    box.x1 = 0;
-    box.y1 = 0;
-    box.x2 = drawable->width;
-    box.y2 = drawable->height;
-    REGION_INIT(pScreen, &region, &box, 0);
+    if (!pDrmMode->swap_damage ||
+        !LS_DRI2SwapDamage(drawable, src_priv->pixmap, &region))
+    {
+        box.x1 = 0;
+        box.y1 = 0;
+        box.x2 = drawable->width;
+        box.y2 = drawable->height;
+        REGION_INIT(pScreen, &region, &box, 0);
+    }
+
+    if (REGION_NOTEMPTY(pScreen, &region))
+        gsgpu_dri2_copy_region(drawable, &region, dst, src);
+
+    REGION_UNINIT(pScreen, &region);
+    LS_DRI2SwapDone(drawable);
 
-    gsgpu_dri2_copy_region(drawable, &region, dst, src);
+    /* A variable refresh client which fell back to blits */
+    if ((pDrmMode->present_flipping == FALSE) &&
+        (drawable->type == DRAWABLE_WINDOW) &&
+        drmmode_window_wants_vrr(pDrmMode, (WindowPtr) drawable))
+        drmmode_set_screen_vrr(pScrn, FALSE);
 }
 
 struct gsgpu_dri2_vblank_event {
@@ -608,11 +651,15 @@ static Bool gsgpu_dri2_schedule_flip(struct gsgpu_dri2_frame_event * info)
     event->event_complete = info->event_complete;
     event->event_data = info->event_data;
 
+    /* can_flip() made sure this is a window covering the whole screen */
+    drmmode_set_window_vrr(scrn, (WindowPtr) draw);
+
     if (ms_do_pageflip(screen, back_priv->pixmap, event,
                        drmmode_crtc->vblank_pipe, FALSE,
                        gsgpu_dri2_flip_handler,
                        gsgpu_dri2_flip_abort,
-                       "DRI2-flip"))
+                       "DRI2-flip", info->request_us,
+                       info->frame))
     {
         pDrmMode->dri2_flipping = TRUE;
         return TRUE;
@@ -723,8 +770,13 @@ static void gsgpu_dri2_exchange_buffers(DrawablePtr draw,
     msPixmapPrivPtr back_pix = msGetPixmapPriv(pDrmMode, back_priv->pixmap);
     msPixmapPrivRec tmp_pix;
     RegionRec region;
+    Bool partial;
     int tmp;
 
+    /* What the new front changes, worked out while it is still the back */
+    partial = pDrmMode->swap_damage &&
+              LS_DRI2SwapDamage(draw, back_priv->pixmap, &region);
+
     /* Swap BO names so DRI works */
     tmp = front->name;
     front->name = back->name;
@@ -747,12 +799,18 @@ static void gsgpu_dri2_exchange_buffers(DrawablePtr draw,
     /* Post damage on the front buffer so that listeners, such
      * as DisplayLink know take a copy and shove it over the USB.
      */
-    region.extents.x1 = region.extents.y1 = 0;
-    region.extents.x2 = front_priv->pixmap->drawable.width;
-    region.extents.y2 = front_priv->pixmap->drawable.height;
-    region.data = NULL;
+    if (!partial)
+    {
+        region.extents.x1 = region.extents.y1 = 0;
+        region.extents.x2 = front_priv->pixmap->drawable.width;
+        region.extents.y2 = front_priv->pixmap->drawable.height;
+        region.data = NULL;
+    }
     DamageRegionAppend(&front_priv->pixmap->drawable, &region);
     DamageRegionProcessPending(&front_priv->pixmap->drawable);
+    REGION_UNINIT(screen, &region);
+
+    LS_DRI2SwapDone(draw);
 }
 
 static void gsgpu_dri2_frame_event_handler(uint64_t msc,
@@ -772,6 +830,10 @@ static void gsgpu_dri2_frame_event_handler(uint64_t msc,
         return;
     }
 
+    /* Flips count once they land, see ls_pageflip_handler_cb */
+    if (frame_info->type != MS_DRI2_QUEUE_FLIP)
+        LS_StatsFrameMsc(frame_info->crtc, frame_info->frame, msc);
+
     switch (frame_info->type)
     {
     case MS_DRI2_QUEUE_FLIP:
@@ -783,6 +845,8 @@ static void gsgpu_dri2_frame_event_handler(uint64_t msc,
                                         frame_info->back);
             break;
         }
+        /* A flip is queued one frame ahead of the swap's target */
+        LS_StatsFrameMsc(frame_info->crtc, frame_info->frame - 1, msc);
         /* else fall through to blit */
     case MS_DRI2_QUEUE_SWAP:
         gsgpu_dri2_blit_swap(drawable, frame_info->front, frame_info->back);
@@ -960,15 +1024,16 @@ static int gsgpu_dri2_schedule_wait_msc(ClientPtr client,
  * can send any swap complete events that have been requested.
  */
 static int
-gsgpu_dri2_schedule_swap(ClientPtr client,
-                         DrawablePtr draw,
-                         DRI2BufferPtr front,
-                         DRI2BufferPtr back,
-                         CARD64 *target_msc,
-                         CARD64 divisor,
-                         CARD64 remainder,
-                         DRI2SwapEventPtr func,
-                         void *data)
+gsgpu_dri2_do_schedule_swap(ClientPtr client,
+                            DrawablePtr draw,
+                            DRI2BufferPtr front,
+                            DRI2BufferPtr back,
+                            CARD64 *target_msc,
+                            CARD64 divisor,
+                            CARD64 remainder,
+                            DRI2SwapEventPtr func,
+                            void *data,
+                            uint64_t request_us)
 {
     ScreenPtr screen = draw->pScreen;
     ScrnInfoPtr scrn = xf86ScreenToScrn(screen);
@@ -1000,6 +1065,7 @@ gsgpu_dri2_schedule_swap(ClientPtr client,
     frame_info->back = back;
     frame_info->crtc = crtc;
     frame_info->type = MS_DRI2_QUEUE_SWAP;
+    frame_info->request_us = request_us;
 
     if (!gsgpu_dri2_add_frame_event(frame_info))
     {
@@ -1125,6 +1191,32 @@ gsgpu_dri2_schedule_swap(ClientPtr client,
     return TRUE;
 }
 
+static int
+gsgpu_dri2_schedule_swap(ClientPtr client,
+                         DrawablePtr draw,
+                         DRI2BufferPtr front,
+                         DRI2BufferPtr back,
+                         CARD64 *target_msc,
+                         CARD64 divisor,
+                         CARD64 remainder,
+                         DRI2SwapEventPtr func,
+                         void *data)
+{
+    uint64_t request_us = LS_STATS_NOW_US();
+    int ret;
+
+    LS_PROBE2(dri2_schedule_swap_entry, *target_msc,
+              draw->width * draw->height * (draw->bitsPerPixel / 8));
+
+    ret = gsgpu_dri2_do_schedule_swap(client, draw, front, back, target_msc,
+                                      divisor, remainder, func, data,
+                                      request_us);
+
+    LS_PROBE2(dri2_schedule_swap_return, ret, *target_msc);
+
+    return ret;
+}
+
 static int gsgpu_dri2_frame_event_client_gone(void *data, XID id)
 {
     struct gsgpu_dri2_resource *resource = data;
@@ -1206,6 +1298,18 @@ Bool gsgpu_dri2_screen_init(ScreenPtr pScreen)
         return FALSE;
     }
 
+    if (!LS_DRI2PoolInit())
+    {
+        xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+                   "Cannot register the DRI2 buffer pool\n");
+    }
+
+    if (!LS_DRI2DamageInit())
+    {
+        xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+                   "Cannot register the DRI2 swap damage tracking\n");
+    }
+
     if (serverGeneration != gsgpu_dri2_server_generation)
     {
         gsgpu_dri2_server_generation = serverGeneration;
@@ -40,7 +40,9 @@
 #include "gsgpu_dri3.h"
 #include "gsgpu_bo_helper.h"
 #include "loongson_debug.h"
+#include "loongson_stats.h"
 #include "loongson_pixmap.h"
+#include "loongson_exa.h"
 
 static int LS_IsRenderNode(int fd, struct stat *st)
 {
@@ -163,8 +165,10 @@ static PixmapPtr gsgpu_dri3_pixmap_from_fd(ScreenPtr pScreen,
     ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
     loongsonPtr lsp = loongsonPTR(pScrn);
     struct gsgpu_bo *gbo = NULL;
+    struct exa_pixmap_priv *priv;
     PixmapPtr pPixmap;
     Bool ret;
+    LS_STATS_BEGIN(t);
 
     TRACE_ENTER();
 
@@ -201,7 +205,9 @@ static PixmapPtr gsgpu_dri3_pixmap_from_fd(ScreenPtr pScreen,
         return NULL;
     }
 
-    ret = gsgpu_set_pixmap_bo(pScrn, pPixmap, gbo, fd);
+    /* The server closes the client's fd, keep our own as the export */
+    ret = gsgpu_set_pixmap_bo(pScrn, pPixmap, gbo,
+                              fcntl(fd, F_DUPFD_CLOEXEC, 0));
     if (ret == FALSE)
     {
         pScreen->DestroyPixmap(pPixmap);
@@ -210,6 +216,11 @@ static PixmapPtr gsgpu_dri3_pixmap_from_fd(ScreenPtr pScreen,
         return NULL;
     }
 
+    priv = exaGetPixmapDriverPrivate(pPixmap);
+    priv->dmabuf_import = (priv->fd > 0);
+
+    LS_STATS_END(LS_STAT_DRI3_IMPORT, t, (uint64_t)stride * height);
+
     TRACE_EXIT();
     return pPixmap;
 }
@@ -222,8 +233,7 @@ static int gsgpu_dri3_fd_from_pixmap(ScreenPtr pScreen,
     ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
     struct gsgpu_bo *gbo;
     struct gsgpu_bo_info bo_info;
-    uint32_t prime_fd;
-    int ret;
+    int prime_fd;
 
     TRACE_ENTER();
 
@@ -241,12 +251,12 @@ static int gsgpu_dri3_fd_from_pixmap(ScreenPtr pScreen,
         return -1;
     }
 
-    ret = gsgpu_bo_export(gbo, gsgpu_bo_handle_type_dma_buf_fd, &prime_fd);
-    if (ret != 0)
+    prime_fd = loongson_exa_dup_dmabuf_fd(pScrn, pixmap);
+    if (prime_fd < 0)
     {
         xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-                   "Failed to get dmabuf fd from gsgpu bo: %d\n", ret);
-        return ret;
+                   "Failed to get dmabuf fd from gsgpu bo\n");
+        return -1;
     }
 
     *stride = pixmap->devKind;
@@ -42,11 +42,14 @@
 #include "loongson_options.h"
 #include "loongson_pixmap.h"
 #include "loongson_debug.h"
+#include "loongson_stats.h"
 #include "gsgpu_dri3.h"
 #include "gsgpu_exa.h"
 #include "gsgpu_bo_helper.h"
 #include "gsgpu_resolve.h"
 #include "loongson_blt.h"
+#include "loongson_exa_trace.h"
+#include "loongson_usdt.h"
 
 #define GSGPU_BO_ALIGN_SIZE (16 * 1024)
 
@@ -105,6 +108,12 @@ static Bool gsgpu_exa_prepare_access(PixmapPtr pPix, int index)
     struct exa_pixmap_priv *priv = exaGetPixmapDriverPrivate(pPix);
     int ret;
 
+    LS_EXA_TRACE(Access, LS_EXA_TRACE_PREPARE_ACCESS, pPix, index);
+
+    /* Client buffers are accessed through their dma-buf */
+    if (priv->dmabuf_import)
+        return LS_DmaBufPrepareAccess(pPix, index);
+
     if (pPix->devPrivate.ptr)
     {
         // xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
@@ -113,6 +122,9 @@ static Bool gsgpu_exa_prepare_access(PixmapPtr pPix, int index)
         return TRUE;
     }
 
+    /* Exported buffers may still be rendered to by a client */
+    LS_SyncPrepareAccess(pPix, index);
+
     if (priv->bo)
     {
         ret = dumb_bo_map(pDrmMode->fd, priv->bo);
@@ -168,6 +180,14 @@ static void gsgpu_exa_finish_access(PixmapPtr pPixmap, int index)
     if (!priv)
         return;
 
+    LS_EXA_TRACE(Access, LS_EXA_TRACE_FINISH_ACCESS, pPixmap, index);
+
+    if (priv->dmabuf_import)
+    {
+        LS_DmaBufFinishAccess(pPixmap, index);
+        return;
+    }
+
     /* recongize that if a bo is dumb or don't have a priv,
      * it is likely that it is front bo or shadow of front bo,
      * x server will access it through its life time, no need
@@ -341,6 +361,10 @@ static void ms_exa_solid(PixmapPtr pPixmap, int x1, int y1, int x2, int y2)
     ScreenPtr screen = pPixmap->drawable.pScreen;
     GCPtr gc = GetScratchGC(pPixmap->drawable.depth, screen);
     ChangeGCVal val[3];
+    LS_STATS_BEGIN(t);
+
+    LS_EXA_TRACE(Solid, pPixmap, gsgpu_exa_prepare_args.solid.alu,
+                 gsgpu_exa_prepare_args.solid.fg, x1, y1, x2, y2);
 
     val[0].val = gsgpu_exa_prepare_args.solid.alu;
     val[1].val = gsgpu_exa_prepare_args.solid.planemask;
@@ -353,6 +377,9 @@ static void ms_exa_solid(PixmapPtr pPixmap, int x1, int y1, int x2, int y2)
     gsgpu_exa_finish_access(pPixmap, 0);
 
     FreeScratchGC(gc);
+
+    LS_STATS_END(LS_STAT_SOLID, t, (uint64_t)(x2 - x1) * (y2 - y1) *
+                 pPixmap->drawable.bitsPerPixel / 8);
 }
 
 
@@ -455,6 +482,11 @@ static void gsgpu_exa_do_copy(PixmapPtr pDstPixmap,
     miCopyProc pFnCopyProc = swCopyNtoN;
     ChangeGCVal val[2];
     GCPtr gc;
+    LS_STATS_BEGIN(t);
+
+    LS_PROBE2(gsgpu_copy_entry,
+              width * height * (pDstPixmap->drawable.bitsPerPixel / 8),
+              pSrcPriv->tiling_info);
 
 #if defined(GSGPU_DEBUG_EXA_COPY)
     xf86Msg(X_WARNING, "pSrcPixmap(%p): srcX=%d, srcY=%d, dstX=%d, dstY=%d\n",
@@ -482,6 +514,12 @@ static void gsgpu_exa_do_copy(PixmapPtr pDstPixmap,
     else if (pSrcPriv->tiling_info == GSGPU_SURF_MODE_LINEAR)
         pFnCopyProc = swCopyNtoN;
 
+    LS_EXA_TRACE(Copy, pSrcPixmap, pDstPixmap,
+                 pFnCopyProc == gsgpu_resolve_n_to_n ?
+                 LS_EXA_TRACE_GSGPU_TILED4 : LS_EXA_TRACE_LINEAR,
+                 gsgpu_exa_prepare_args.copy.alu,
+                 srcX, srcY, dstX, dstY, width, height);
+
     miDoCopy(&pSrcPixmap->drawable, &pDstPixmap->drawable, gc,
              srcX, srcY, width, height, dstX, dstY, pFnCopyProc, 0, 0);
 
@@ -489,6 +527,13 @@ static void gsgpu_exa_do_copy(PixmapPtr pDstPixmap,
     gsgpu_exa_finish_access(pSrcPixmap, 0);
 
     FreeScratchGC(gc);
+
+    LS_PROBE(gsgpu_copy_return);
+
+    LS_STATS_END(pFnCopyProc == gsgpu_resolve_n_to_n ?
+                 LS_STAT_RESOLVE : LS_STAT_COPY, t,
+                 (uint64_t)width * height *
+                 pDstPixmap->drawable.bitsPerPixel / 8);
 }
 
 static void gsgpu_exa_copy_done(PixmapPtr pPixmap)
@@ -535,6 +580,11 @@ static void ms_exa_composite(PixmapPtr pDst, int srcX, int srcY,
     PixmapPtr pSrc = gsgpu_exa_prepare_args.composite.pSrc;
     PixmapPtr pMask = gsgpu_exa_prepare_args.composite.pMask;
     int op = gsgpu_exa_prepare_args.composite.op;
+    LS_STATS_BEGIN(t);
+
+    LS_EXA_TRACE(Composite, op, pSrcPicture, pMaskPicture, pDstPicture,
+                 pSrc, pMask, pDst, srcX, srcY, maskX, maskY,
+                 dstX, dstY, width, height);
 
     if (pMask)
     {
@@ -554,6 +604,9 @@ static void ms_exa_composite(PixmapPtr pDst, int srcX, int srcY,
     {
         gsgpu_exa_finish_access(pMask, 0);
     }
+
+    LS_STATS_END(LS_STAT_COMPOSITE, t, (uint64_t)width * height *
+                 pDst->drawable.bitsPerPixel / 8);
 }
 
 static void ms_exa_composite_done(PixmapPtr pPixmap)
@@ -608,6 +661,9 @@ static Bool gsgpu_exa_upload_to_screen(PixmapPtr pPix,
     unsigned int len;
     int cpp;
     int i;
+    LS_STATS_BEGIN(t);
+
+    LS_EXA_TRACE(Upload, pPix, x, y, w, h);
 
     cpp = (pPix->drawable.bitsPerPixel + 7) / 8;
 
@@ -631,6 +687,8 @@ static Bool gsgpu_exa_upload_to_screen(PixmapPtr pPix,
 
     gsgpu_exa_finish_access(pPix, 0);
 
+    LS_STATS_END(LS_STAT_UPLOAD, t, (uint64_t)w * h * cpp);
+
     return TRUE;
 }
 
@@ -647,6 +705,9 @@ static Bool gsgpu_exa_download_from_screen(PixmapPtr pPix,
     unsigned int len;
     int cpp;
     int i;
+    LS_STATS_BEGIN(t);
+
+    LS_EXA_TRACE(Download, pPix, x, y, w, h);
 
     cpp = (pPix->drawable.bitsPerPixel + 7) / 8;
 
@@ -670,13 +731,15 @@ static Bool gsgpu_exa_download_from_screen(PixmapPtr pPix,
 
     gsgpu_exa_finish_access(pPix, 0);
 
+    LS_STATS_END(LS_STAT_DOWNLOAD, t, (uint64_t)w * h * cpp);
+
     return TRUE;
 }
 
 
 static void gsgpu_exa_wait_marker(ScreenPtr pScreen, int marker)
 {
-    // TODO:
+    /* No GPU work of our own, shared BOs wait in prepare_access */
 }
 
 /**
@@ -693,7 +756,6 @@ static void gsgpu_exa_wait_marker(ScreenPtr pScreen, int marker)
  */
 static int gsgpu_exa_mark_sync(ScreenPtr pScreen)
 {
-    // TODO: return latest request(marker).
     return 0;
 }
 
@@ -706,6 +768,8 @@ static void gsgpu_exa_destroy_pixmap(ScreenPtr pScreen, void *driverPriv)
     if (!pPriv)
         return;
 
+    LS_DmaBufRelease(pPriv);
+
     if (pPriv->fd > 0)
     {
         close(pPriv->fd);
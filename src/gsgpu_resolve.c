@@ -36,6 +36,7 @@
 #endif
 
 #include "gsgpu_resolve.h"
+#include "loongson_usdt.h"
 
 /* TODO: provide a none simd version */
 
@@ -58,6 +59,9 @@ Bool lsx_resolve_gsgpu_tile_4x4(uint32_t *src_bits,
     uint8_t *pix_src, *pix_dst;
     __m128i v0, v1, v2, v3, v4, v5, v6, v7;
 
+    LS_PROBE3(gsgpu_tile_resolve_entry, width, height,
+              width * height * (dst_bpp / 8));
+
     l = src_x & 0x3;
     if (l)
     {
@@ -676,6 +680,8 @@ Bool lsx_resolve_gsgpu_tile_4x4(uint32_t *src_bits,
             }
         }
     }
+
+    LS_PROBE(gsgpu_tile_resolve_return);
 #endif
 
     return TRUE;
@@ -227,3 +227,91 @@ COPY_LESS_THAN_2:
     memcpy(pDst, pSrc, w);
 #endif
 }
+
+#ifdef HAVE_LASX
+
+#define LASX_LOAD(p)        __lasx_xvld((const void *)(p), 0)
+#define LASX_STORE(v, p)    __lasx_xvst((v), (void *)(p), 0)
+
+/* reverse the 8 words of a vector: inside each 128-bit lane, then the lanes */
+static inline __m256i lasx_rev_w(__m256i v)
+{
+    v = __lasx_xvshuf4i_w(v, 0x1B);
+    return __lasx_xvpermi_q(v, v, 0x01);
+}
+
+/*
+ * Same contract as lsx_rotate_blt_u32, with w and h multiples of 8: the
+ * 8x8 blocks are transposed as two 4x4 transposes per 128-bit lane and
+ * the lanes are then swapped into place with xvpermi.q.
+ */
+void lasx_rotate_blt_u32(void *pDst, long dst_pitch,
+                         const void *pSrc, long step_x, long step_y,
+                         int w, int h)
+{
+    long src_pitch = (step_x < 0) ? -step_x : step_x;
+    int x, y, k;
+
+    if (step_x == -4)
+    {
+        for (y = 0; y < h; y++)
+        {
+            uint8_t *d = (uint8_t *)pDst + y * dst_pitch;
+            const uint8_t *s = (const uint8_t *)pSrc + y * step_y;
+
+            for (x = 0; x < w; x += 8)
+                LASX_STORE(lasx_rev_w(LASX_LOAD(s - (x + 7) * 4)), d + x * 4);
+        }
+        return;
+    }
+
+    for (y = 0; y < h; y += 8)
+    {
+        for (x = 0; x < w; x += 8)
+        {
+            uint8_t *d = (uint8_t *)pDst + y * dst_pitch + x * 4;
+            const uint8_t *s = (const uint8_t *)pSrc + x * step_x + y * step_y;
+            __m256i r[8], t[8], q[8], c[8];
+
+            if (step_x < 0)
+                s += 7 * step_x;
+            if (step_y < 0)
+                s += 7 * step_y;
+
+            for (k = 0; k < 8; k++)
+                r[k] = LASX_LOAD(s + k * src_pitch);
+
+            for (k = 0; k < 8; k += 4)
+            {
+                t[k] = __lasx_xvilvl_w(r[k + 1], r[k]);
+                t[k + 1] = __lasx_xvilvh_w(r[k + 1], r[k]);
+                t[k + 2] = __lasx_xvilvl_w(r[k + 3], r[k + 2]);
+                t[k + 3] = __lasx_xvilvh_w(r[k + 3], r[k + 2]);
+
+                /* q[k + n]: column n in the low lane, column n + 4 high */
+                q[k] = __lasx_xvilvl_d(t[k + 2], t[k]);
+                q[k + 1] = __lasx_xvilvh_d(t[k + 2], t[k]);
+                q[k + 2] = __lasx_xvilvl_d(t[k + 3], t[k + 1]);
+                q[k + 3] = __lasx_xvilvh_d(t[k + 3], t[k + 1]);
+            }
+
+            /* c[k] is source column k, top to bottom */
+            for (k = 0; k < 4; k++)
+            {
+                c[k] = __lasx_xvpermi_q(q[k + 4], q[k], 0x20);
+                c[k + 4] = __lasx_xvpermi_q(q[k + 4], q[k], 0x31);
+            }
+
+            if (step_x < 0)
+            {
+                for (k = 0; k < 8; k++)
+                    c[k] = lasx_rev_w(c[k]);
+            }
+
+            for (k = 0; k < 8; k++)
+                LASX_STORE(c[(step_y > 0) ? k : 7 - k], d + k * dst_pitch);
+        }
+    }
+}
+
+#endif
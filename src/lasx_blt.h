@@ -29,4 +29,8 @@
 
 void lasx_blt_one_line_u8(void *pDst, const void *pSrc, long unsigned int len);
 
+void lasx_rotate_blt_u32(void *pDst, long dst_pitch,
+                         const void *pSrc, long step_x, long step_y,
+                         int w, int h);
+
 #endif
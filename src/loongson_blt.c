@@ -43,6 +43,20 @@
 
 void (*loongson_blt)(void *pDst, const void *pSrc, long unsigned int len);
 
+typedef void (*loongson_rotate_blocks_fn)(void *pDst, long dst_pitch,
+                                          const void *pSrc,
+                                          long step_x, long step_y,
+                                          int w, int h);
+
+/* Box sides the rotate kernels need to be a multiple of, 1 for plain C */
+static loongson_rotate_blocks_fn loongson_rotate_blocks_u16;
+static loongson_rotate_blocks_fn loongson_rotate_blocks_u32;
+static int loongson_rotate_block_u16 = 1;
+static int loongson_rotate_block_u32 = 1;
+
+/* Small enough that the source rows of a tile stay in L1 while transposing */
+#define LOONGSON_ROTATE_TILE    32
+
 
 #if defined(__loongarch__)
 static int loongarch_detect_cpu_features(void)
@@ -79,11 +93,135 @@ static void loongson_memcpy(void *pDst,
     memcpy(pDst, pSrc, len);
 }
 
+static void loongson_rotate_rect(uint8_t *pDst, long dst_pitch,
+                                 const uint8_t *pSrc,
+                                 long step_x, long step_y,
+                                 int w, int h, int cpp)
+{
+    int x, y;
+
+    for (y = 0; y < h; y++)
+    {
+        const uint8_t *s = pSrc + y * step_y;
+
+        if (cpp == 4)
+        {
+            uint32_t *d = (uint32_t *)(pDst + y * dst_pitch);
+
+            for (x = 0; x < w; x++, s += step_x)
+                d[x] = *(const uint32_t *)s;
+        }
+        else
+        {
+            uint16_t *d = (uint16_t *)(pDst + y * dst_pitch);
+
+            for (x = 0; x < w; x++, s += step_x)
+                d[x] = *(const uint16_t *)s;
+        }
+    }
+}
+
+static void loongson_rotate_rect_u16(void *pDst, long dst_pitch,
+                                     const void *pSrc,
+                                     long step_x, long step_y,
+                                     int w, int h)
+{
+    loongson_rotate_rect(pDst, dst_pitch, pSrc, step_x, step_y, w, h, 2);
+}
+
+static void loongson_rotate_rect_u32(void *pDst, long dst_pitch,
+                                     const void *pSrc,
+                                     long step_x, long step_y,
+                                     int w, int h)
+{
+    loongson_rotate_rect(pDst, dst_pitch, pSrc, step_x, step_y, w, h, 4);
+}
+
+/*
+ * Copy a w x h box of 16 or 32 bpp pixels into pDst, where moving one
+ * pixel right in the destination moves 'step_x' bytes in the source and
+ * moving one row down moves 'step_y' bytes. pSrc is the source of the
+ * first destination pixel. This covers the 90/180/270 degree rotations
+ * and the reflections, the box is walked in tiles so that transposing
+ * does not stream through a whole source column per destination row.
+ */
+void loongson_rotate_blt(void *pDst, long dst_pitch,
+                         const void *pSrc, long step_x, long step_y,
+                         int w, int h, int cpp)
+{
+    loongson_rotate_blocks_fn blocks;
+    int block;
+    int tx, ty;
+
+    /* Unreflected rows, plain copies */
+    if (step_x == cpp)
+    {
+        for (ty = 0; ty < h; ty++)
+            loongson_blt((uint8_t *)pDst + ty * dst_pitch,
+                         (const uint8_t *)pSrc + ty * step_y, w * cpp);
+        return;
+    }
+
+    if (cpp == 4)
+    {
+        blocks = loongson_rotate_blocks_u32;
+        block = loongson_rotate_block_u32;
+    }
+    else
+    {
+        blocks = loongson_rotate_blocks_u16;
+        block = loongson_rotate_block_u16;
+    }
+
+    for (ty = 0; ty < h; ty += LOONGSON_ROTATE_TILE)
+    {
+        int th = min(LOONGSON_ROTATE_TILE, h - ty);
+        int bh = th - th % block;
+
+        for (tx = 0; tx < w; tx += LOONGSON_ROTATE_TILE)
+        {
+            uint8_t *d = (uint8_t *)pDst + ty * dst_pitch + tx * cpp;
+            const uint8_t *s = (const uint8_t *)pSrc +
+                               tx * step_x + ty * step_y;
+            int tw = min(LOONGSON_ROTATE_TILE, w - tx);
+            int bw = tw - tw % block;
+
+            if (bw && bh)
+                blocks(d, dst_pitch, s, step_x, step_y, bw, bh);
+
+            /* The right and bottom edges the kernel can't cover */
+            if (tw > bw)
+                loongson_rotate_rect(d + bw * cpp, dst_pitch,
+                                     s + bw * step_x, step_x, step_y,
+                                     tw - bw, bh, cpp);
+            if (th > bh)
+                loongson_rotate_rect(d + bh * dst_pitch, dst_pitch,
+                                     s + bh * step_y, step_x, step_y,
+                                     tw, th - bh, cpp);
+        }
+    }
+}
+
 void loongson_init_blitter(void)
 {
+    loongson_rotate_blocks_u16 = loongson_rotate_rect_u16;
+    loongson_rotate_blocks_u32 = loongson_rotate_rect_u32;
+
+#ifdef HAVE_LSX
+    if (loongarch_have_feature(LOONGARCH_LSX))
+    {
+        loongson_rotate_blocks_u16 = lsx_rotate_blt_u16;
+        loongson_rotate_block_u16 = 8;
+        loongson_rotate_blocks_u32 = lsx_rotate_blt_u32;
+        loongson_rotate_block_u32 = 4;
+    }
+#endif
+
 #ifdef HAVE_LASX
     if (loongarch_have_feature(LOONGARCH_LASX))
     {
+        loongson_rotate_blocks_u32 = lasx_rotate_blt_u32;
+        loongson_rotate_block_u32 = 8;
         loongson_blt = lasx_blt_one_line_u8;
         xf86Msg(X_INFO, "LoongArch: have LASX and LSX support\n");
         return;
@@ -40,5 +40,9 @@ extern void (*loongson_blt)(void *pDst,
 
 Bool loongarch_have_feature(int feature);
 
+void loongson_rotate_blt(void *pDst, long dst_pitch,
+                         const void *pSrc, long step_x, long step_y,
+                         int w, int h, int cpp);
+
 void loongson_init_blitter(void);
 #endif
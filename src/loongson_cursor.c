@@ -100,7 +100,12 @@ Bool LS_CreateCursorBO(ScrnInfoPtr pScrn, struct drmmode_rec * const drmmode)
 
               return FALSE;
         }
+        /* The first slot of the cursor cache, the others come on demand */
+        memset(drmmode_crtc->cursor_cache, 0,
+               sizeof(drmmode_crtc->cursor_cache));
+        drmmode_crtc->cursor_cache[0].bo = pCursorBO;
         drmmode_crtc->cursor_bo = pCursorBO;
+        drmmode_crtc->cursor_set_handle = 0;
     }
     return TRUE;
 }
@@ -137,8 +142,19 @@ void LS_FreeCursorBO(ScrnInfoPtr pScrn, struct drmmode_rec * const pDrmMode)
     {
         xf86CrtcPtr pCrtc = xf86_config->crtc[i];
         drmmode_crtc_private_ptr drmmode_crtc = pCrtc->driver_private;
+        int j;
+
+        for (j = 0; j < DRMMODE_CURSOR_CACHE_SIZE; j++)
+        {
+            struct drmmode_cursor_slot *slot = &drmmode_crtc->cursor_cache[j];
+
+            if (slot->bo)
+                dumb_bo_destroy(pDrmMode->fd, slot->bo);
+
+            slot->bo = NULL;
+            slot->valid = FALSE;
+        }
 
-        dumb_bo_destroy(pDrmMode->fd, drmmode_crtc->cursor_bo);
         drmmode_crtc->cursor_bo = NULL;
         xf86DrvMsg(pScrn->scrnIndex, X_INFO,
                       "Cursor%d's BO freed.\n", i);
@@ -47,6 +47,10 @@
 #include "vblank.h"
 #include "loongson_pixmap.h"
 #include "loongson_dri2.h"
+#include "loongson_dri2_pool.h"
+#include "loongson_stats.h"
+#include "loongson_usdt.h"
+#include "loongson_dri2_damage.h"
 
 #ifdef GLAMOR_HAS_GBM
 
@@ -72,11 +76,15 @@ typedef struct ms_dri2_frame_event {
     void *event_data;
     DRI2BufferPtr front;
     DRI2BufferPtr back;
+    /* when the client asked for the swap, for the frame timing stats */
+    uint64_t request_us;
 } ms_dri2_frame_event_rec, *ms_dri2_frame_event_ptr;
 
 typedef struct {
     int refcnt;
     PixmapPtr pixmap;
+    /* the drawable whose pool the pixmap goes back to */
+    XID drawable_id;
 } ms_dri2_buffer_private_rec, *ms_dri2_buffer_private_ptr;
 
 static DevPrivateKeyRec ms_dri2_client_key;
@@ -135,6 +143,8 @@ ms_dri2_create_buffer2(ScreenPtr screen, DrawablePtr drawable,
     CARD32 size;
     CARD16 pitch;
     ms_dri2_buffer_private_ptr private;
+    Bool pooled = FALSE;
+    LS_STATS_BEGIN(t);
 
     buffer = calloc(1, sizeof *buffer);
     if (buffer == NULL)
@@ -187,11 +197,16 @@ ms_dri2_create_buffer2(ScreenPtr screen, DrawablePtr drawable,
             return NULL;
         }
 
-        pixmap = screen->CreatePixmap(screen,
-                                      pixmap_width,
-                                      pixmap_height,
-                                      pixmap_cpp,
-                                      0);
+        pixmap = LS_DRI2PoolTake(drawable, attachment, pixmap_cpp,
+                                 &buffer->name, &buffer->pitch);
+        if (pixmap)
+            pooled = TRUE;
+        else
+            pixmap = screen->CreatePixmap(screen,
+                                          pixmap_width,
+                                          pixmap_height,
+                                          pixmap_cpp,
+                                          0);
         if (pixmap == NULL) {
             free(private);
             free(buffer);
@@ -207,20 +222,26 @@ ms_dri2_create_buffer2(ScreenPtr screen, DrawablePtr drawable,
      */
     buffer->flags = 0;
 
-    buffer->name = ms->glamor.name_from_pixmap(pixmap, &pitch, &size);
-    buffer->pitch = pitch;
-    if (buffer->name == -1) {
-        xf86DrvMsg(scrn->scrnIndex, X_ERROR,
-                   "Failed to get DRI2 name for pixmap\n");
-        screen->DestroyPixmap(pixmap);
-        free(private);
-        free(buffer);
-        return NULL;
+    if (!pooled) {
+        buffer->name = ms->glamor.name_from_pixmap(pixmap, &pitch, &size);
+        buffer->pitch = pitch;
+        if (buffer->name == -1) {
+            xf86DrvMsg(scrn->scrnIndex, X_ERROR,
+                       "Failed to get DRI2 name for pixmap\n");
+            screen->DestroyPixmap(pixmap);
+            free(private);
+            free(buffer);
+            return NULL;
+        }
     }
 
     buffer->driverPrivate = private;
     private->refcnt = 1;
     private->pixmap = pixmap;
+    private->drawable_id = drawable->id;
+
+    LS_STATS_END(LS_STAT_DRI2_IMPORT, t,
+                 (uint64_t)buffer->pitch * pixmap->drawable.height);
 
     return buffer;
 }
@@ -252,7 +273,9 @@ static void ms_dri2_destroy_buffer2(ScreenPtr unused, DrawablePtr unused2,
         ms_dri2_buffer_private_ptr private = buffer->driverPrivate;
         if (--private->refcnt == 0) {
             ScreenPtr screen = private->pixmap->drawable.pScreen;
-            screen->DestroyPixmap(private->pixmap);
+            if (!LS_DRI2PoolPut(private->drawable_id, buffer->attachment,
+                                private->pixmap, buffer->name, buffer->pitch))
+                screen->DestroyPixmap(private->pixmap);
             free(private);
             free(buffer);
         }
@@ -430,16 +453,34 @@ ms_dri2_blit_swap(DrawablePtr drawable,
                   DRI2BufferPtr dst,
                   DRI2BufferPtr src)
 {
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(drawable->pScreen);
+    loongsonPtr lsp = loongsonPTR(pScrn);
+    struct drmmode_rec * const pDrmMode = &lsp->drmmode;
+    ms_dri2_buffer_private_ptr src_priv = src->driverPrivate;
     BoxRec box;
     RegionRec region;
 
-    box.x1 = 0;
-    box.y1 = 0;
-    box.x2 = drawable->width;
-    box.y2 = drawable->height;
-    REGION_INIT(pScreen, &region, &box, 0);
+    if (!pDrmMode->swap_damage ||
+        !LS_DRI2SwapDamage(drawable, src_priv->pixmap, &region))
+    {
+        box.x1 = 0;
+        box.y1 = 0;
+        box.x2 = drawable->width;
+        box.y2 = drawable->height;
+        REGION_INIT(pScreen, &region, &box, 0);
+    }
+
+    if (REGION_NOTEMPTY(pScreen, &region))
+        ms_dri2_copy_region(drawable, &region, dst, src);
+
+    REGION_UNINIT(pScreen, &region);
+    LS_DRI2SwapDone(drawable);
 
-    ms_dri2_copy_region(drawable, &region, dst, src);
+    /* A variable refresh client which fell back to blits */
+    if ((pDrmMode->present_flipping == FALSE) &&
+        (drawable->type == DRAWABLE_WINDOW) &&
+        drmmode_window_wants_vrr(pDrmMode, (WindowPtr) drawable))
+        drmmode_set_screen_vrr(pScrn, FALSE);
 }
 
 struct ms_dri2_vblank_event {
@@ -504,11 +545,15 @@ ms_dri2_schedule_flip(ms_dri2_frame_event_ptr info)
     event->event_complete = info->event_complete;
     event->event_data = info->event_data;
 
+    /* can_flip() made sure this is a window covering the whole screen */
+    drmmode_set_window_vrr(scrn, (WindowPtr) draw);
+
     if (ms_do_pageflip(screen, back_priv->pixmap, event,
                        drmmode_crtc->vblank_pipe, FALSE,
                        ms_dri2_flip_handler,
                        ms_dri2_flip_abort,
-                       "DRI2-flip"))
+                       "DRI2-flip", info->request_us,
+                       info->frame))
     {
         pDrmMode->dri2_flipping = TRUE;
         return TRUE;
@@ -621,8 +666,13 @@ ms_dri2_exchange_buffers(DrawablePtr draw, DRI2BufferPtr front,
     msPixmapPrivPtr back_pix = msGetPixmapPriv(pDrmMode, back_priv->pixmap);
     msPixmapPrivRec tmp_pix;
     RegionRec region;
+    Bool partial;
     int tmp;
 
+    /* What the new front changes, worked out while it is still the back */
+    partial = pDrmMode->swap_damage &&
+              LS_DRI2SwapDamage(draw, back_priv->pixmap, &region);
+
     /* Swap BO names so DRI works */
     tmp = front->name;
     front->name = back->name;
@@ -645,12 +695,18 @@ ms_dri2_exchange_buffers(DrawablePtr draw, DRI2BufferPtr front,
     /* Post damage on the front buffer so that listeners, such
      * as DisplayLink know take a copy and shove it over the USB.
      */
-    region.extents.x1 = region.extents.y1 = 0;
-    region.extents.x2 = front_priv->pixmap->drawable.width;
-    region.extents.y2 = front_priv->pixmap->drawable.height;
-    region.data = NULL;
+    if (!partial)
+    {
+        region.extents.x1 = region.extents.y1 = 0;
+        region.extents.x2 = front_priv->pixmap->drawable.width;
+        region.extents.y2 = front_priv->pixmap->drawable.height;
+        region.data = NULL;
+    }
     DamageRegionAppend(&front_priv->pixmap->drawable, &region);
     DamageRegionProcessPending(&front_priv->pixmap->drawable);
+    REGION_UNINIT(screen, &region);
+
+    LS_DRI2SwapDone(draw);
 }
 
 static void
@@ -670,6 +726,10 @@ ms_dri2_frame_event_handler(uint64_t msc,
         return;
     }
 
+    /* Flips count once they land, see ls_pageflip_handler_cb */
+    if (frame_info->type != MS_DRI2_QUEUE_FLIP)
+        LS_StatsFrameMsc(frame_info->crtc, frame_info->frame, msc);
+
     switch (frame_info->type) {
     case MS_DRI2_QUEUE_FLIP:
         if (can_flip(scrn, drawable, frame_info->front, frame_info->back) &&
@@ -677,6 +737,8 @@ ms_dri2_frame_event_handler(uint64_t msc,
             ms_dri2_exchange_buffers(drawable, frame_info->front, frame_info->back);
             break;
         }
+        /* A flip is queued one frame ahead of the swap's target */
+        LS_StatsFrameMsc(frame_info->crtc, frame_info->frame - 1, msc);
         /* else fall through to blit */
     case MS_DRI2_QUEUE_SWAP:
         ms_dri2_blit_swap(drawable, frame_info->front, frame_info->back);
@@ -845,10 +907,11 @@ ms_dri2_schedule_wait_msc(ClientPtr client, DrawablePtr draw, CARD64 target_msc,
  * can send any swap complete events that have been requested.
  */
 static int
-ms_dri2_schedule_swap(ClientPtr client, DrawablePtr draw,
-                      DRI2BufferPtr front, DRI2BufferPtr back,
-                      CARD64 *target_msc, CARD64 divisor,
-                      CARD64 remainder, DRI2SwapEventPtr func, void *data)
+ms_dri2_do_schedule_swap(ClientPtr client, DrawablePtr draw,
+                         DRI2BufferPtr front, DRI2BufferPtr back,
+                         CARD64 *target_msc, CARD64 divisor,
+                         CARD64 remainder, DRI2SwapEventPtr func, void *data,
+                         uint64_t request_us)
 {
     ScreenPtr screen = draw->pScreen;
     ScrnInfoPtr scrn = xf86ScreenToScrn(screen);
@@ -878,6 +941,7 @@ ms_dri2_schedule_swap(ClientPtr client, DrawablePtr draw,
     frame_info->back = back;
     frame_info->crtc = crtc;
     frame_info->type = MS_DRI2_QUEUE_SWAP;
+    frame_info->request_us = request_us;
 
     if (!ms_dri2_add_frame_event(frame_info)) {
         free(frame_info);
@@ -995,6 +1059,27 @@ ms_dri2_schedule_swap(ClientPtr client, DrawablePtr draw,
     return TRUE;
 }
 
+static int
+ms_dri2_schedule_swap(ClientPtr client, DrawablePtr draw,
+                      DRI2BufferPtr front, DRI2BufferPtr back,
+                      CARD64 *target_msc, CARD64 divisor,
+                      CARD64 remainder, DRI2SwapEventPtr func, void *data)
+{
+    uint64_t request_us = LS_STATS_NOW_US();
+    int ret;
+
+    LS_PROBE2(dri2_schedule_swap_entry, *target_msc,
+              draw->width * draw->height * (draw->bitsPerPixel / 8));
+
+    ret = ms_dri2_do_schedule_swap(client, draw, front, back, target_msc,
+                                   divisor, remainder, func, data,
+                                   request_us);
+
+    LS_PROBE2(dri2_schedule_swap_return, ret, *target_msc);
+
+    return ret;
+}
+
 static int
 ms_dri2_frame_event_client_gone(void *data, XID id)
 {
@@ -1080,6 +1165,14 @@ Bool loongson_dri2_screen_init(ScreenPtr pScreen)
     if (!dixRegisterPrivateKey(&ms_dri2_client_key, PRIVATE_CLIENT, sizeof(XID)))
         return FALSE;
 
+    if (!LS_DRI2PoolInit())
+        xf86DrvMsg(scrn->scrnIndex, X_WARNING,
+                   "Cannot register the DRI2 buffer pool\n");
+
+    if (!LS_DRI2DamageInit())
+        xf86DrvMsg(scrn->scrnIndex, X_WARNING,
+                   "Cannot register the DRI2 swap damage tracking\n");
+
     if (serverGeneration != ms_dri2_server_generation)
     {
         ms_dri2_server_generation = serverGeneration;
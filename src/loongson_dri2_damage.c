@@ -0,0 +1,380 @@
+/*
+ * Copyright (C) 2026 Loongson Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+#include <xf86.h>
+#include <damage.h>
+#include <resource.h>
+
+#include "driver.h"
+#include "loongson_debug.h"
+#include "loongson_dri2_damage.h"
+
+#define LS_DRI2_TILE_SIZE    64
+
+struct LS_DRI2SwapState
+{
+    /* what X drew on the front since the last swap */
+    DamagePtr pDamage;
+
+    int width;
+    int height;
+    int bpp;
+    int tiles_x;
+    int tiles_y;
+    /* checksum of each tile as shown on the front, row major */
+    uint64_t *hashes;
+    /* the window's serial number when the checksums were taken */
+    unsigned long serial;
+    Bool valid;
+};
+
+static RESTYPE ls_dri2_swap_state_type;
+static int ls_dri2_damage_generation;
+
+/*
+ * FNV-1a over 64 bit words. Each step is a bijection of the running
+ * value, so a tile which differs in a single word always hashes
+ * differently.
+ */
+static uint64_t LS_DRI2HashTile(const uint8_t *pSrc,
+                                int pitch,
+                                int bytes,
+                                int rows)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    int y, i;
+
+    for (y = 0; y < rows; y++)
+    {
+        const uint8_t *pRow = pSrc + (long) y * pitch;
+
+        for (i = 0; i + 8 <= bytes; i += 8)
+        {
+            uint64_t v;
+
+            memcpy(&v, pRow + i, sizeof(v));
+            h = (h ^ v) * 0x100000001b3ULL;
+        }
+
+        for (; i < bytes; i++)
+            h = (h ^ pRow[i]) * 0x100000001b3ULL;
+    }
+
+    return h;
+}
+
+static void LS_DRI2SwapDamageDestroy(DamagePtr pDamage, void *closure)
+{
+    struct LS_DRI2SwapState *state = closure;
+
+    state->pDamage = NULL;
+}
+
+static int LS_DRI2SwapStateGone(void *data, XID id)
+{
+    struct LS_DRI2SwapState *state = data;
+
+    if (state->pDamage)
+        DamageDestroy(state->pDamage);
+
+    free(state->hashes);
+    free(state);
+
+    return Success;
+}
+
+Bool LS_DRI2DamageInit(void)
+{
+    if (ls_dri2_damage_generation == serverGeneration)
+        return TRUE;
+
+    ls_dri2_swap_state_type = CreateNewResourceType(LS_DRI2SwapStateGone,
+                                                    "DRI2 Swap Damage");
+    if (!ls_dri2_swap_state_type)
+        return FALSE;
+
+    ls_dri2_damage_generation = serverGeneration;
+
+    return TRUE;
+}
+
+static struct LS_DRI2SwapState *LS_DRI2SwapStateLookup(XID id)
+{
+    void *ptr = NULL;
+
+    if (!ls_dri2_swap_state_type)
+        return NULL;
+
+    dixLookupResourceByType(&ptr, id, ls_dri2_swap_state_type,
+                            NULL, DixWriteAccess);
+
+    return ptr;
+}
+
+static struct LS_DRI2SwapState *LS_DRI2SwapStateGet(DrawablePtr drawable)
+{
+    struct LS_DRI2SwapState *state = LS_DRI2SwapStateLookup(drawable->id);
+
+    if (state || !ls_dri2_swap_state_type)
+        return state;
+
+    state = calloc(1, sizeof(*state));
+    if (state == NULL)
+        return NULL;
+
+    state->pDamage = DamageCreate(NULL,
+                                  LS_DRI2SwapDamageDestroy,
+                                  DamageReportNone,
+                                  TRUE,
+                                  drawable->pScreen,
+                                  state);
+    if (state->pDamage == NULL)
+    {
+        free(state);
+        return NULL;
+    }
+
+    DamageRegister(drawable, state->pDamage);
+
+    /* AddResource() frees the state itself on failure */
+    if (!AddResource(drawable->id, ls_dri2_swap_state_type, state))
+        return NULL;
+
+    return state;
+}
+
+/*
+ * Make sure the hash table matches the drawable, returns FALSE if it
+ * had to be (re)built and holds nothing to compare against yet.
+ */
+static Bool LS_DRI2SwapStateResize(struct LS_DRI2SwapState *state,
+                                   int width, int height, int bpp)
+{
+    int tiles_x, tiles_y;
+    uint64_t *hashes;
+
+    if (state->valid && (state->width == width) &&
+        (state->height == height) && (state->bpp == bpp))
+        return TRUE;
+
+    tiles_x = (width + LS_DRI2_TILE_SIZE - 1) / LS_DRI2_TILE_SIZE;
+    tiles_y = (height + LS_DRI2_TILE_SIZE - 1) / LS_DRI2_TILE_SIZE;
+
+    hashes = realloc(state->hashes, sizeof(uint64_t) * tiles_x * tiles_y);
+    if (hashes == NULL)
+    {
+        free(state->hashes);
+        state->hashes = NULL;
+        state->valid = FALSE;
+        return FALSE;
+    }
+
+    state->hashes = hashes;
+    state->width = width;
+    state->height = height;
+    state->bpp = bpp;
+    state->tiles_x = tiles_x;
+    state->tiles_y = tiles_y;
+    state->valid = FALSE;
+
+    return FALSE;
+}
+
+/*
+ * Work out the part of @drawable that the swap with @pBack changes, in
+ * drawable relative coordinates, and remember @pBack's content as what
+ * the front will show afterwards. Returns FALSE if the whole drawable
+ * has to be assumed changed, e.g. because the back buffer cannot be
+ * read by the CPU.
+ */
+Bool LS_DRI2SwapDamage(DrawablePtr drawable,
+                       PixmapPtr pBack,
+                       RegionPtr pRegion)
+{
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(drawable->pScreen);
+    loongsonPtr lsp = loongsonPTR(pScrn);
+    ExaDriverPtr pExaDrv = lsp->exaDrvPtr;
+    struct LS_DRI2SwapState *state;
+    const uint8_t *pSrc;
+    Bool mapped = FALSE;
+    Bool overlap;
+    Bool full;
+    int cpp, tx, ty;
+
+    if (drawable->type != DRAWABLE_WINDOW)
+        return FALSE;
+
+    /* Only EXA pixmaps can be mapped here, glamor ones live on the GPU */
+    if ((pExaDrv == NULL) || (pExaDrv->PrepareAccess == NULL))
+        return FALSE;
+
+    if ((pBack->drawable.width != drawable->width) ||
+        (pBack->drawable.height != drawable->height) ||
+        (pBack->drawable.bitsPerPixel < 8))
+    {
+        /* the front gets fully rewritten, forget what it showed */
+        state = LS_DRI2SwapStateLookup(drawable->id);
+        if (state)
+            state->valid = FALSE;
+        return FALSE;
+    }
+
+    state = LS_DRI2SwapStateGet(drawable);
+    if ((state == NULL) || (state->pDamage == NULL))
+        return FALSE;
+
+    /*
+     * A move, a clip or stacking change bumps the serial number. Parts
+     * of the front may show something else now without any rendering
+     * the damage could have seen, e.g. a background None window.
+     */
+    if (state->serial != drawable->serialNumber)
+    {
+        state->serial = drawable->serialNumber;
+        state->valid = FALSE;
+    }
+
+    full = !LS_DRI2SwapStateResize(state, drawable->width, drawable->height,
+                                   pBack->drawable.bitsPerPixel);
+    if (state->hashes == NULL)
+        return FALSE;
+
+    if (pBack->devPrivate.ptr == NULL)
+    {
+        if (!pExaDrv->PrepareAccess(pBack, EXA_PREPARE_SRC))
+        {
+            state->valid = FALSE;
+            return FALSE;
+        }
+        mapped = TRUE;
+    }
+
+    pSrc = pBack->devPrivate.ptr;
+    cpp = pBack->drawable.bitsPerPixel / 8;
+
+    RegionNull(pRegion);
+
+    for (ty = 0; ty < state->tiles_y; ty++)
+    {
+        int y1 = ty * LS_DRI2_TILE_SIZE;
+        int y2 = min(y1 + LS_DRI2_TILE_SIZE, state->height);
+        BoxRec run = { 0, y1, 0, y2 };
+        Bool in_run = FALSE;
+
+        for (tx = 0; tx < state->tiles_x; tx++)
+        {
+            int x1 = tx * LS_DRI2_TILE_SIZE;
+            int x2 = min(x1 + LS_DRI2_TILE_SIZE, state->width);
+            uint64_t *pHash = &state->hashes[ty * state->tiles_x + tx];
+            uint64_t h;
+
+            h = LS_DRI2HashTile(pSrc + (long) y1 * pBack->devKind + x1 * cpp,
+                                pBack->devKind, (x2 - x1) * cpp, y2 - y1);
+
+            if (!full && (h == *pHash))
+            {
+                /* close the run of changed tiles on this row */
+                if (in_run)
+                {
+                    RegionRec box;
+
+                    RegionInit(&box, &run, 1);
+                    RegionAppend(pRegion, &box);
+                    RegionUninit(&box);
+                    in_run = FALSE;
+                }
+                continue;
+            }
+
+            *pHash = h;
+
+            if (!in_run)
+            {
+                run.x1 = x1;
+                in_run = TRUE;
+            }
+            run.x2 = x2;
+        }
+
+        if (in_run)
+        {
+            RegionRec box;
+
+            RegionInit(&box, &run, 1);
+            RegionAppend(pRegion, &box);
+            RegionUninit(&box);
+        }
+    }
+
+    if (mapped && pExaDrv->FinishAccess)
+        pExaDrv->FinishAccess(pBack, EXA_PREPARE_SRC);
+
+    state->valid = TRUE;
+
+    RegionValidate(pRegion, &overlap);
+
+    /* Anything X rendered on the front meanwhile is overwritten as well */
+    RegionUnion(pRegion, pRegion, DamageRegion(state->pDamage));
+
+    DEBUG_MSG("drawable 0x%x: %d boxes changed%s",
+              (unsigned int) drawable->id,
+              RegionNumRects(pRegion), full ? " (full)" : "");
+
+    return TRUE;
+}
+
+/*
+ * The window's clip changed, so what its front shows can no longer be
+ * trusted to match the checksums.
+ */
+void LS_DRI2SwapInvalidate(WindowPtr pWin)
+{
+    struct LS_DRI2SwapState *state = LS_DRI2SwapStateLookup(pWin->drawable.id);
+
+    if (state)
+        state->valid = FALSE;
+}
+
+/*
+ * Called once the swap's copy or exchange has been done, so the damage
+ * it caused on the front does not count as X rendering next time.
+ */
+void LS_DRI2SwapDone(DrawablePtr drawable)
+{
+    struct LS_DRI2SwapState *state;
+
+    if (drawable->type != DRAWABLE_WINDOW)
+        return;
+
+    state = LS_DRI2SwapStateLookup(drawable->id);
+    if (state && state->pDamage)
+        DamageEmpty(state->pDamage);
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2026 Loongson Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef LOONGSON_DRI2_DAMAGE_H_
+#define LOONGSON_DRI2_DAMAGE_H_
+
+#include <xf86.h>
+#include <regionstr.h>
+
+/*
+ * DRI2 clients never tell us what they redrew before a swap, so the
+ * blit and the damage posted afterwards used to cover the whole window.
+ * Instead, keep a checksum per tile of what the window's front buffer
+ * shows, and on each swap compare the back buffer against it: only the
+ * tiles that differ, plus whatever X drew on the front in between, need
+ * to be copied or reported.
+ */
+
+Bool LS_DRI2DamageInit(void);
+
+Bool LS_DRI2SwapDamage(DrawablePtr drawable,
+                       PixmapPtr pBack,
+                       RegionPtr pRegion);
+
+void LS_DRI2SwapDone(DrawablePtr drawable);
+
+void LS_DRI2SwapInvalidate(WindowPtr pWin);
+
+#endif
@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2026 Loongson Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <xf86.h>
+#include <dri2.h>
+#include <resource.h>
+
+#include "loongson_debug.h"
+#include "loongson_dri2_pool.h"
+
+/* Enough for double buffering across one or two resize steps */
+#define LS_DRI2_POOL_SIZE    4
+
+struct LS_DRI2PoolEntry
+{
+    PixmapPtr pPixmap;
+    unsigned int attachment;
+    unsigned int name;
+    unsigned int pitch;
+};
+
+struct LS_DRI2Pool
+{
+    int num_entries;
+    /* oldest first */
+    struct LS_DRI2PoolEntry entries[LS_DRI2_POOL_SIZE];
+};
+
+static RESTYPE ls_dri2_pool_type;
+static int ls_dri2_pool_generation;
+
+static void LS_DRI2PoolRemove(struct LS_DRI2Pool *pool, int i)
+{
+    pool->num_entries--;
+    memmove(&pool->entries[i], &pool->entries[i + 1],
+            (pool->num_entries - i) * sizeof(pool->entries[0]));
+}
+
+/* The drawable is gone, and so are the buffers nobody took back */
+static int LS_DRI2PoolGone(void *data, XID id)
+{
+    struct LS_DRI2Pool *pool = data;
+    int i;
+
+    for (i = 0; i < pool->num_entries; i++)
+    {
+        PixmapPtr pPixmap = pool->entries[i].pPixmap;
+
+        pPixmap->drawable.pScreen->DestroyPixmap(pPixmap);
+    }
+
+    free(pool);
+
+    return Success;
+}
+
+Bool LS_DRI2PoolInit(void)
+{
+    if (ls_dri2_pool_generation == serverGeneration)
+        return TRUE;
+
+    ls_dri2_pool_type = CreateNewResourceType(LS_DRI2PoolGone,
+                                              "DRI2 Buffer Pool");
+    if (!ls_dri2_pool_type)
+        return FALSE;
+
+    ls_dri2_pool_generation = serverGeneration;
+
+    return TRUE;
+}
+
+static struct LS_DRI2Pool *LS_DRI2PoolLookup(XID id)
+{
+    void *ptr = NULL;
+
+    if (!ls_dri2_pool_type)
+        return NULL;
+
+    dixLookupResourceByType(&ptr, id, ls_dri2_pool_type,
+                            NULL, DixWriteAccess);
+
+    return ptr;
+}
+
+/*
+ * Return a pooled pixmap matching the drawable's current size, together
+ * with the name and pitch it was exported with, or NULL if the caller
+ * has to allocate one. The pool itself is created here, so that buffers
+ * of this drawable have somewhere to go once they are released.
+ *
+ * Entries left over from an earlier size (or from an earlier depth of
+ * the same attachment) can never be handed out again, so they are
+ * dropped here rather than waiting to age out of the pool.
+ */
+PixmapPtr LS_DRI2PoolTake(DrawablePtr drawable,
+                          unsigned int attachment,
+                          int depth,
+                          unsigned int *name,
+                          unsigned int *pitch)
+{
+    struct LS_DRI2Pool *pool = LS_DRI2PoolLookup(drawable->id);
+    int i;
+
+    if (pool == NULL)
+    {
+        if (!ls_dri2_pool_type)
+            return NULL;
+
+        pool = calloc(1, sizeof(*pool));
+        if (pool == NULL)
+            return NULL;
+
+        /* AddResource() frees the pool itself on failure */
+        AddResource(drawable->id, ls_dri2_pool_type, pool);
+
+        return NULL;
+    }
+
+    for (i = pool->num_entries - 1; i >= 0; i--)
+    {
+        struct LS_DRI2PoolEntry *entry = &pool->entries[i];
+        PixmapPtr pPixmap = entry->pPixmap;
+
+        if ((pPixmap->drawable.width != drawable->width) ||
+            (pPixmap->drawable.height != drawable->height) ||
+            ((entry->attachment == attachment) &&
+             (pPixmap->drawable.depth != depth)))
+        {
+            DEBUG_MSG("drawable 0x%x: drop stale %dx%d, name %u",
+                      (unsigned int) drawable->id,
+                      pPixmap->drawable.width, pPixmap->drawable.height,
+                      entry->name);
+
+            pPixmap->drawable.pScreen->DestroyPixmap(pPixmap);
+            LS_DRI2PoolRemove(pool, i);
+            continue;
+        }
+
+        if (entry->attachment != attachment)
+            continue;
+
+        *name = entry->name;
+        *pitch = entry->pitch;
+
+        LS_DRI2PoolRemove(pool, i);
+
+        DEBUG_MSG("drawable 0x%x: reuse %dx%d, name %u",
+                  (unsigned int) drawable->id,
+                  drawable->width, drawable->height, *name);
+
+        return pPixmap;
+    }
+
+    return NULL;
+}
+
+/*
+ * Hand a released buffer's pixmap (and the reference on it) to the
+ * drawable's pool, evicting the oldest entry when full. Returns FALSE
+ * if the drawable has no pool, in which case the caller still owns
+ * the pixmap.
+ */
+Bool LS_DRI2PoolPut(XID drawable_id,
+                    unsigned int attachment,
+                    PixmapPtr pPixmap,
+                    unsigned int name,
+                    unsigned int pitch)
+{
+    struct LS_DRI2Pool *pool;
+    struct LS_DRI2PoolEntry *entry;
+
+    if (attachment == DRI2BufferFrontLeft)
+        return FALSE;
+
+    pool = LS_DRI2PoolLookup(drawable_id);
+    if (pool == NULL)
+        return FALSE;
+
+    if (pool->num_entries == LS_DRI2_POOL_SIZE)
+    {
+        PixmapPtr pOldest = pool->entries[0].pPixmap;
+
+        pOldest->drawable.pScreen->DestroyPixmap(pOldest);
+        LS_DRI2PoolRemove(pool, 0);
+    }
+
+    entry = &pool->entries[pool->num_entries++];
+    entry->pPixmap = pPixmap;
+    entry->attachment = attachment;
+    entry->name = name;
+    entry->pitch = pitch;
+
+    return TRUE;
+}
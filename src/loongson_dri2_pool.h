@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2026 Loongson Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef LOONGSON_DRI2_POOL_H_
+#define LOONGSON_DRI2_POOL_H_
+
+#include <xf86.h>
+#include <dri2.h>
+
+/*
+ * Per-drawable pool of released DRI2 buffers. Mesa asks for a new set
+ * of back buffers after every resize and, for some clients, after every
+ * exchange; handing back a pixmap of the same size, depth and attachment
+ * saves the BO allocation, mapping and flink name export each time.
+ */
+
+Bool LS_DRI2PoolInit(void);
+
+PixmapPtr LS_DRI2PoolTake(DrawablePtr drawable,
+                          unsigned int attachment,
+                          int depth,
+                          unsigned int *name,
+                          unsigned int *pitch);
+
+Bool LS_DRI2PoolPut(XID drawable_id,
+                    unsigned int attachment,
+                    PixmapPtr pPixmap,
+                    unsigned int name,
+                    unsigned int pitch);
+
+#endif
@@ -30,6 +30,8 @@
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <inttypes.h>
+#include <string.h>
 #include <drm_fourcc.h>
 #include <sys/stat.h>
 
@@ -40,7 +42,9 @@
 #include "driver.h"
 #include "loongson_dri3.h"
 #include "loongson_debug.h"
+#include "loongson_stats.h"
 #include "loongson_pixmap.h"
+#include "loongson_exa.h"
 
 static int LS_IsRenderNode(int fd, struct stat *st)
 {
@@ -132,6 +136,14 @@ static int ms_exa_dri3_open_client(ClientPtr client,
 }
 
 
+/*
+ * The buffers imported here are dumb buffers which EXA reads and writes
+ * with the CPU, so linear is the only layout we can deal with.
+ */
+static const uint64_t ms_exa_modifiers[] = {
+    DRM_FORMAT_MOD_LINEAR,
+};
+
 static PixmapPtr ms_exa_pixmap_from_fds(ScreenPtr pScreen,
                                         CARD8 num_fds,
                                         const int *fds,
@@ -148,16 +160,27 @@ static PixmapPtr ms_exa_pixmap_from_fds(ScreenPtr pScreen,
     struct drmmode_rec * const pDrmmode = &lsp->drmmode;
     PixmapPtr pPixmap;
     struct dumb_bo *bo = NULL;
+    struct exa_pixmap_priv *priv;
     Bool ret;
+    LS_STATS_BEGIN(t);
 
     TRACE_ENTER();
 
-    /* modifier != DRM_FORMAT_MOD_INVALID */
-    if ((num_fds != 1) || offsets[0])
+    /* Dumb buffers are linear, which is also what an implicit
+     * (DRI3 1.0) buffer of ours means.
+     */
+    if (modifier == DRM_FORMAT_MOD_INVALID)
+        modifier = DRM_FORMAT_MOD_LINEAR;
+
+    /* Only single plane buffers with a modifier we advertised */
+    if ((num_fds != 1) || offsets[0] ||
+        !LS_DRI3_IsModifierSupported(ms_exa_modifiers,
+                                     ARRAY_SIZE(ms_exa_modifiers),
+                                     modifier))
     {
         xf86DrvMsg(pScrn->scrnIndex, X_INFO,
-        "DRI3: num_fds=%d, offsets[0]=%d, modifier=%ld, %lld\n",
-        num_fds, offsets[0], modifier, DRM_FORMAT_MOD_INVALID);
+                   "DRI3: num_fds=%d, offsets[0]=%u, modifier=0x%" PRIx64
+                   " not supported\n", num_fds, offsets[0], modifier);
 
         TRACE_EXIT();
         return NULL;
@@ -204,7 +227,10 @@ static PixmapPtr ms_exa_pixmap_from_fds(ScreenPtr pScreen,
         return NULL;
     }
 
-    ret = loongson_set_pixmap_dumb_bo(pScrn, pPixmap, bo, CREATE_PIXMAP_USAGE_SCANOUT, fds[0]);
+    /* The server closes the client's fd, keep our own as the export */
+    ret = loongson_set_pixmap_dumb_bo(pScrn, pPixmap, bo,
+                                      CREATE_PIXMAP_USAGE_SCANOUT,
+                                      fcntl(fds[0], F_DUPFD_CLOEXEC, 0));
     if (ret == FALSE)
     {
         pScreen->DestroyPixmap(pPixmap);
@@ -214,6 +240,12 @@ static PixmapPtr ms_exa_pixmap_from_fds(ScreenPtr pScreen,
         return NULL;;
     }
 
+    priv = exaGetPixmapDriverPrivate(pPixmap);
+    priv->modifier = modifier;
+    priv->dmabuf_import = (priv->fd > 0);
+
+    LS_STATS_END(LS_STAT_DRI3_IMPORT, t, (uint64_t)strides[0] * height);
+
     TRACE_EXIT();
     return pPixmap;
 }
@@ -223,11 +255,8 @@ static int ms_exa_egl_fd_from_pixmap(ScreenPtr pScreen,
         PixmapPtr pixmap, CARD16 *stride, CARD32 *size)
 {
     ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
-    loongsonPtr lsp = loongsonPTR(pScrn);
-    struct drmmode_rec * const pDrmMode = &lsp->drmmode;
     struct dumb_bo *bo;
     int prime_fd;
-    int ret;
 
     TRACE_ENTER();
 
@@ -239,16 +268,9 @@ static int ms_exa_egl_fd_from_pixmap(ScreenPtr pScreen,
         return -1;
     }
 
-    ret = drmPrimeHandleToFD(pDrmMode->fd,
-                             dumb_bo_handle(bo),
-                             DRM_CLOEXEC,
-                             &prime_fd);
-    if (ret)
-    {
-        xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-                "%s: failed to get dmabuf fd: %d\n", __func__, ret);
-        return ret;
-    }
+    prime_fd = loongson_exa_dup_dmabuf_fd(pScrn, pixmap);
+    if (prime_fd < 0)
+        return -1;
 
     *stride = dumb_bo_pitch(bo);
     *size = dumb_bo_size(bo);
@@ -267,11 +289,9 @@ static int ms_exa_egl_fds_from_pixmap(ScreenPtr pScreen,
                                       uint64_t *modifier)
 {
     ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
-    loongsonPtr lsp = loongsonPTR(pScrn);
-    struct drmmode_rec * const pDrmMode = &lsp->drmmode;
     struct dumb_bo *bo = dumb_bo_from_pixmap(pScreen, pixmap);
+    struct exa_pixmap_priv *priv = exaGetPixmapDriverPrivate(pixmap);
     int prime_fd;
-    int ret;
 
     if (bo == NULL)
     {
@@ -280,47 +300,168 @@ static int ms_exa_egl_fds_from_pixmap(ScreenPtr pScreen,
         return 0;
     }
 
-    ret = drmPrimeHandleToFD(pDrmMode->fd,
-                             dumb_bo_handle(bo),
-                             DRM_CLOEXEC,
-                             &prime_fd);
-    if (ret)
-    {
-        xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-                "%s: failed to get dmabuf fd: %d\n", __func__, ret);
-        return ret;
-    }
+    prime_fd = loongson_exa_dup_dmabuf_fd(pScrn, pixmap);
+    if (prime_fd < 0)
+        return 0;
 
     fds[0] = prime_fd;
     strides[0] = dumb_bo_pitch(bo);
     offsets[0] = 0;
-    *modifier = DRM_FORMAT_MOD_LINEAR;
+    *modifier = priv->modifier;
 
     return 1;
 }
 
-static Bool ms_exa_get_formats(ScreenPtr screen,
-        CARD32 *num_formats, CARD32 **formats)
+Bool LS_DRI3_IsModifierSupported(const uint64_t *supported,
+                                 uint32_t num_supported,
+                                 uint64_t modifier)
+{
+    uint32_t i;
+
+    for (i = 0; i < num_supported; i++)
+    {
+        if (supported[i] == modifier)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/*
+ * A window can only be flipped to when it covers the whole screen,
+ * so only then does the scanout plane get to read the client's buffer
+ * directly.
+ */
+static Bool LS_DRI3_DrawableIsFlippable(DrawablePtr draw)
+{
+    ScreenPtr pScreen = draw->pScreen;
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+    loongsonPtr lsp = loongsonPTR(pScrn);
+
+    if (draw->type != DRAWABLE_WINDOW)
+        return FALSE;
+
+    if (!lsp->drmmode.pageflip || !pScrn->vtSema)
+        return FALSE;
+
+    return (draw->x == 0) && (draw->y == 0) &&
+           (draw->width == pScreen->width) &&
+           (draw->height == pScreen->height);
+}
+
+Bool LS_DRI3_GetFormats(ScreenPtr screen,
+                        CARD32 *num_formats,
+                        CARD32 **formats)
 {
-    /* TODO: Return formats */
-    *num_formats = 0;
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(screen);
+
+    *num_formats = drmmode_get_formats(pScrn, formats);
+
+    DEBUG_MSG("%u formats", *num_formats);
+
     return TRUE;
 }
 
+Bool LS_DRI3_GetModifiers(ScreenPtr screen,
+                          uint32_t format,
+                          const uint64_t *supported,
+                          uint32_t num_supported,
+                          uint32_t *num_modifiers,
+                          uint64_t **modifiers)
+{
+    *modifiers = malloc(num_supported * sizeof(uint64_t));
+    if (*modifiers == NULL)
+    {
+        *num_modifiers = 0;
+        return FALSE;
+    }
+
+    memcpy(*modifiers, supported, num_supported * sizeof(uint64_t));
+    *num_modifiers = num_supported;
 
-static Bool ms_exa_get_modifiers(ScreenPtr screen,
-        uint32_t format, uint32_t *num_modifiers, uint64_t **modifiers)
+    return TRUE;
+}
+
+/*
+ * For a window which may be flipped to, offer the modifiers the scanout
+ * plane accepts for @format, restricted to the ones the acceleration
+ * backend can also read back for the times the window is composited.
+ * Planes without an IN_FORMATS blob only take implicit, linear buffers.
+ */
+Bool LS_DRI3_GetDrawableModifiers(DrawablePtr draw,
+                                  uint32_t format,
+                                  const uint64_t *supported,
+                                  uint32_t num_supported,
+                                  uint32_t *num_modifiers,
+                                  uint64_t **modifiers)
 {
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(draw->pScreen);
+    uint64_t *plane_modifiers;
+    uint32_t num_plane_modifiers;
+    uint32_t i, n = 0;
+
     *num_modifiers = 0;
+    *modifiers = NULL;
+
+    if (!LS_DRI3_DrawableIsFlippable(draw))
+        return TRUE;
+
+    num_plane_modifiers = drmmode_get_modifiers(pScrn, format,
+                                                &plane_modifiers, TRUE);
+    if (num_plane_modifiers == 0)
+    {
+        if (!LS_DRI3_IsModifierSupported(supported, num_supported,
+                                         DRM_FORMAT_MOD_LINEAR))
+            return TRUE;
+
+        plane_modifiers = malloc(sizeof(uint64_t));
+        if (plane_modifiers == NULL)
+            return FALSE;
+
+        plane_modifiers[0] = DRM_FORMAT_MOD_LINEAR;
+        *num_modifiers = 1;
+        *modifiers = plane_modifiers;
+        return TRUE;
+    }
+
+    for (i = 0; i < num_plane_modifiers; i++)
+    {
+        if (LS_DRI3_IsModifierSupported(supported, num_supported,
+                                        plane_modifiers[i]))
+            plane_modifiers[n++] = plane_modifiers[i];
+    }
+
+    if (n == 0)
+    {
+        free(plane_modifiers);
+        return TRUE;
+    }
+
+    DEBUG_MSG("format %08x: %u scanout modifiers", format, n);
+
+    *num_modifiers = n;
+    *modifiers = plane_modifiers;
+
     return TRUE;
 }
 
+static Bool ms_exa_get_modifiers(ScreenPtr screen,
+        uint32_t format, uint32_t *num_modifiers, uint64_t **modifiers)
+{
+    return LS_DRI3_GetModifiers(screen, format,
+                                ms_exa_modifiers,
+                                ARRAY_SIZE(ms_exa_modifiers),
+                                num_modifiers, modifiers);
+}
+
 
 static Bool ms_exa_get_drawable_modifiers(DrawablePtr draw,
         uint32_t format, uint32_t *num_modifiers, uint64_t **modifiers)
 {
-    *num_modifiers = 0;
-    return TRUE;
+    return LS_DRI3_GetDrawableModifiers(draw, format,
+                                        ms_exa_modifiers,
+                                        ARRAY_SIZE(ms_exa_modifiers),
+                                        num_modifiers, modifiers);
 }
 
 
@@ -330,7 +471,7 @@ static const dri3_screen_info_rec loongson_dri3_info = {
     .pixmap_from_fds = ms_exa_pixmap_from_fds,
     .fd_from_pixmap = ms_exa_egl_fd_from_pixmap,
     .fds_from_pixmap = ms_exa_egl_fds_from_pixmap,
-    .get_formats = ms_exa_get_formats,
+    .get_formats = LS_DRI3_GetFormats,
     .get_modifiers = ms_exa_get_modifiers,
     .get_drawable_modifiers = ms_exa_get_drawable_modifiers,
 };
@@ -30,4 +30,24 @@
 
 Bool LS_DRI3_Init(ScreenPtr screen, const char *name);
 
+/* DRI3 1.2 modifier negotiation, shared by the acceleration backends */
+Bool LS_DRI3_IsModifierSupported(const uint64_t *supported,
+                                 uint32_t num_supported,
+                                 uint64_t modifier);
+Bool LS_DRI3_GetFormats(ScreenPtr screen,
+                        CARD32 *num_formats,
+                        CARD32 **formats);
+Bool LS_DRI3_GetModifiers(ScreenPtr screen,
+                          uint32_t format,
+                          const uint64_t *supported,
+                          uint32_t num_supported,
+                          uint32_t *num_modifiers,
+                          uint64_t **modifiers);
+Bool LS_DRI3_GetDrawableModifiers(DrawablePtr draw,
+                                  uint32_t format,
+                                  const uint64_t *supported,
+                                  uint32_t num_supported,
+                                  uint32_t *num_modifiers,
+                                  uint64_t **modifiers);
+
 #endif
@@ -55,6 +55,9 @@ struct loongsonEntRec
     unsigned long fd_wakeup_registered;
     int fd_wakeup_ref;
     unsigned int assigned_crtcs;
+    /* overlay planes already handed to a ZaphodHeads screen */
+    uint32_t assigned_planes[LS_ENTITY_MAX_PLANES];
+    int num_assigned_planes;
 };
 
 static int loongson_entity_index = -1;
@@ -164,6 +167,29 @@ void LS_EntityClearAssignedCrtc(ScrnInfoPtr pScrn)
     pLsEnt->assigned_crtcs = 0;
 }
 
+/*
+ * Claim an overlay plane for this screen. Screens sharing the entity
+ * see the same plane resources, so the first claim wins.
+ */
+Bool LS_EntityClaimPlane(ScrnInfoPtr pScrn, uint32_t plane_id)
+{
+    struct loongsonEntRec * const pLsEnt = LS_GetPrivEntity(pScrn);
+    int i;
+
+    for (i = 0; i < pLsEnt->num_assigned_planes; i++)
+    {
+        if (pLsEnt->assigned_planes[i] == plane_id)
+            return FALSE;
+    }
+
+    if (pLsEnt->num_assigned_planes == LS_ENTITY_MAX_PLANES)
+        return FALSE;
+
+    pLsEnt->assigned_planes[pLsEnt->num_assigned_planes++] = plane_id;
+
+    return TRUE;
+}
+
 unsigned long LS_EntityGetFd_wakeup(ScrnInfoPtr scrn)
 {
     struct loongsonEntRec * const pLsEnt = LS_GetPrivEntity(scrn);
@@ -32,8 +32,11 @@
 #include "config.h"
 #endif
 
+#include <stdint.h>
 #include <xf86str.h>
 
+#define LS_ENTITY_MAX_PLANES    16
+
 //// Entity
 void LS_SetupEntity(ScrnInfoPtr scrn, int entity_num);
 // bith return the renerence count
@@ -47,6 +50,7 @@ void LS_EntityInitFd(ScrnInfoPtr pScrn, int fd);
 void LS_MarkCrtcInUse(ScrnInfoPtr pScrn, int num);
 unsigned int LS_GetAssignedCrtc(ScrnInfoPtr pScrn);
 void LS_EntityClearAssignedCrtc(ScrnInfoPtr pScrn);
+Bool LS_EntityClaimPlane(ScrnInfoPtr pScrn, uint32_t plane_id);
 
 
 //// wakeup and server generation related stuff
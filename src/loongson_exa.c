@@ -31,7 +31,10 @@
 
 #include <exa.h>
 #include <xf86.h>
+#include <xf86drm.h>
 #include <fbpict.h>
+#include <errno.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 
@@ -42,14 +45,20 @@
 #include "loongson_pixmap.h"
 #include "loongson_debug.h"
 #include "loongson_exa.h"
+#include "loongson_exa_trace.h"
 
 #include "fake_exa.h"
 #include "etnaviv_exa.h"
 
 #if HAVE_LIBDRM_GSGPU
+#include <gsgpu.h>
 #include "gsgpu_exa.h"
 #endif
 
+#if HAVE_LIBDRM_ETNAVIV
+#include <etnaviv_drmif.h>
+#endif
+
 void print_pixmap_info(PixmapPtr pPixmap)
 {
 
@@ -120,11 +129,12 @@ Bool loongson_set_pixmap_dumb_bo(ScrnInfoPtr pScrn,
     priv->usage_hint = usage_hint;
 
     // destroy old backing memory, and update it with new.
+    LS_DmaBufRelease(priv);
+
     if (priv->fd > 0)
-    {
         close(priv->fd);
-        priv->fd = prime_fd;
-    }
+
+    priv->fd = prime_fd;
 
     if (priv->bo)
     {
@@ -145,27 +155,110 @@ Bool loongson_set_pixmap_dumb_bo(ScrnInfoPtr pScrn,
     return TRUE;
 }
 
+/*
+ * DRI3 and PRIME sinks ask for the dma-buf of the same pixmaps over and
+ * over. Export each bo once, keep the fd in the pixmap private (closed
+ * when the pixmap is destroyed) and hand out dup()s of it, which the
+ * caller owns.
+ */
+int loongson_exa_dup_dmabuf_fd(ScrnInfoPtr pScrn, PixmapPtr pPixmap)
+{
+    struct exa_pixmap_priv *priv = exaGetPixmapDriverPrivate(pPixmap);
+    loongsonPtr lsp = loongsonPTR(pScrn);
+    int fd = -1;
+
+    if (priv == NULL)
+        return -1;
+
+    if (priv->fd > 0)
+        return fcntl(priv->fd, F_DUPFD_CLOEXEC, 0);
+
+    if (priv->bo)
+    {
+        if (drmPrimeHandleToFD(lsp->fd, dumb_bo_handle(priv->bo),
+                               DRM_CLOEXEC, &fd))
+            fd = -1;
+    }
+#if HAVE_LIBDRM_GSGPU
+    else if (priv->gbo)
+    {
+        uint32_t shared;
+
+        if (gsgpu_bo_export(priv->gbo, gsgpu_bo_handle_type_dma_buf_fd,
+                            &shared) == 0)
+            fd = shared;
+    }
+#endif
+#if HAVE_LIBDRM_ETNAVIV
+    else if (priv->etna_bo)
+    {
+        fd = etna_bo_dmabuf(priv->etna_bo);
+    }
+#endif
+
+    if (fd < 0)
+    {
+        xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+                   "%s: failed to export pixmap %p: %s\n",
+                   __func__, pPixmap, strerror(errno));
+        return -1;
+    }
+
+    DEBUG_MSG("pixmap %p: cached dma-buf fd %d", pPixmap, fd);
+
+    priv->fd = fd;
+
+    return fcntl(priv->fd, F_DUPFD_CLOEXEC, 0);
+}
+
 int loongson_exa_shareable_fd_from_pixmap(ScreenPtr pScreen,
                                           PixmapPtr pixmap,
                                           CARD16 *stride,
                                           CARD32 *size)
 {
-    struct exa_pixmap_priv *priv = exaGetPixmapDriverPrivate(pixmap);
     ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
     loongsonPtr lsp = loongsonPTR(pScrn);
 
-    if ((lsp->exaDrvPtr == NULL) || (priv == NULL) || (priv->fd <= 0))
+    if (lsp->exaDrvPtr == NULL)
     {
         return -1;
     }
 
-    return priv->fd;
+    /* The sink keeps the fd, so it gets its own */
+    return loongson_exa_dup_dmabuf_fd(pScrn, pixmap);
 }
 
 /////////////////////////////////////////////////////////////////////////////
 //  EXA driver instance governor
 /////////////////////////////////////////////////////////////////////////////
 
+static void LS_OpenExaTrace(ScrnInfoPtr pScrn)
+{
+    loongsonPtr lsp = loongsonPTR(pScrn);
+    struct drmmode_rec * const pDrmMode = &lsp->drmmode;
+    enum ls_exa_trace_backend backend;
+    const char *path;
+
+    path = xf86GetOptValString(pDrmMode->Options, OPTION_EXA_TRACE);
+    if (!path)
+        return;
+
+    switch (pDrmMode->exa_acc_type)
+    {
+    case EXA_ACCEL_TYPE_ETNAVIV:
+        backend = LS_EXA_TRACE_BACKEND_ETNAVIV;
+        break;
+    case EXA_ACCEL_TYPE_GSGPU:
+        backend = LS_EXA_TRACE_BACKEND_GSGPU;
+        break;
+    default:
+        backend = LS_EXA_TRACE_BACKEND_FAKE;
+        break;
+    }
+
+    LS_ExaTraceOpen(pScrn, path, backend);
+}
+
 Bool LS_InitExaLayer(ScreenPtr pScreen)
 {
     ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
@@ -225,6 +318,8 @@ Bool LS_InitExaLayer(ScreenPtr pScreen)
 
         lsp->exaDrvPtr = pExaDrv;
 
+        LS_OpenExaTrace(pScrn);
+
         return TRUE;
     }
 
@@ -254,6 +349,8 @@ Bool LS_DestroyExaLayer(ScreenPtr pScreen)
 
         exaDriverFini(pScreen);
 
+        LS_ExaTraceClose(pScrn);
+
         free(lsp->exaDrvPtr);
 
         lsp->exaDrvPtr = NULL;
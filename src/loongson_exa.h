@@ -94,6 +94,8 @@ Bool loongson_set_pixmap_dumb_bo(ScrnInfoPtr pScrn,
                                  int usage_hint,
                                  int prime_fd);
 
+int loongson_exa_dup_dmabuf_fd(ScrnInfoPtr pScrn, PixmapPtr pPixmap);
+
 int loongson_exa_shareable_fd_from_pixmap(ScreenPtr pScreen,
                                           PixmapPtr pixmap,
                                           CARD16 *stride,
@@ -0,0 +1,775 @@
+/*
+ * Copyright (C) 2026 Loongson Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+ * loongson-exa-replay: replay an EXA trace recorded with Option "ExaTrace"
+ * against malloc backed pixmaps and report the throughput of each hook.
+ *
+ * The fb and EXA glue around the backends needs a running server, so the
+ * replay drives the code those hooks spend their time in, the same way the
+ * recording backend would have: pixman for solid fills, linear copies and
+ * composite, the etnaviv and gsgpu resolvers for copies out of tiled
+ * buffers, and memcpy or loongson_blt for upload and download. Resolvers
+ * not built for this machine are reported as skipped.
+ *
+ * Only geometry is recorded, pixel contents, transforms and repeat modes
+ * of composite pictures are not.
+ *
+ * Usage: loongson-exa-replay [-r repeat] trace
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pixman.h>
+
+#include "loongson_debug.h"
+#include "loongson_blt.h"
+#include "etnaviv_resolve.h"
+#include "gsgpu_resolve.h"
+#include "loongson_exa_trace_format.h"
+
+#define REPLAY_ALIGN(x, a)       (((x) + (a) - 1) & ~((a) - 1))
+#define REPLAY_HASH_SIZE         4096
+
+/* One row per op, copies out of tiled buffers are reported apart */
+#define REPLAY_ROW_NUM           (LS_EXA_TRACE_OP_NUM + LS_EXA_TRACE_LAYOUT_NUM - 1)
+
+struct replay_surface
+{
+    uint32_t id;
+    uint16_t width;
+    uint16_t height;
+    uint8_t bpp;
+    uint8_t layout;
+    /* in bytes */
+    int stride;
+    uint32_t *bits;
+    /* bytes behind bits, only kept on the view which owns them */
+    size_t size;
+    Bool own;
+    struct replay_surface *next;
+};
+
+struct replay_op
+{
+    const struct ls_exa_trace_record *pRec;
+    struct replay_surface *dst;
+    struct replay_surface *src;
+    struct replay_surface *mask;
+};
+
+struct replay_stat
+{
+    uint64_t count;
+    uint64_t skipped;
+    uint64_t pixels;
+    uint64_t bytes;
+    uint64_t ns;
+};
+
+static const char * const replay_backend_names[LS_EXA_TRACE_BACKEND_NUM] =
+{
+    [LS_EXA_TRACE_BACKEND_FAKE]    = "fake",
+    [LS_EXA_TRACE_BACKEND_ETNAVIV] = "etnaviv",
+    [LS_EXA_TRACE_BACKEND_GSGPU]   = "gsgpu",
+};
+
+static const char * const replay_row_names[REPLAY_ROW_NUM] =
+{
+    [LS_EXA_TRACE_SOLID]          = "solid",
+    [LS_EXA_TRACE_COPY]           = "copy",
+    [LS_EXA_TRACE_COMPOSITE]      = "composite",
+    [LS_EXA_TRACE_UPLOAD]         = "upload",
+    [LS_EXA_TRACE_DOWNLOAD]       = "download",
+    [LS_EXA_TRACE_PREPARE_ACCESS] = "prepare access",
+    [LS_EXA_TRACE_FINISH_ACCESS]  = "finish access",
+    [LS_EXA_TRACE_OP_NUM + LS_EXA_TRACE_ETNAVIV_TILED - 1] =
+        "resolve etnaviv tiled",
+    [LS_EXA_TRACE_OP_NUM + LS_EXA_TRACE_ETNAVIV_SUPER_TILED - 1] =
+        "resolve etnaviv super tiled",
+    [LS_EXA_TRACE_OP_NUM + LS_EXA_TRACE_GSGPU_TILED4 - 1] =
+        "resolve gsgpu tiled4",
+};
+
+static struct replay_surface *replay_hash[REPLAY_HASH_SIZE];
+static struct replay_stat replay_stats[REPLAY_ROW_NUM];
+static uint8_t *replay_scratch;
+
+/* The kernels log through the server, which is not there */
+Bool lsEnableDebug = FALSE;
+
+void xf86Msg(MessageType type, const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+void xf86DrvMsg(int scrnIndex, MessageType type, const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+static uint64_t replay_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Pixmap ids are recycled by the server, a surface is only the same one
+ * if the geometry matches too. Earlier records keep pointing at the old
+ * geometry, so each one gets its own view, but all views of an id share
+ * one buffer: when a new geometry does not fit, the old buffer is freed
+ * and replaced by a larger one.
+ */
+static struct replay_surface *
+replay_get_surface(const struct ls_exa_trace_surface *pTS)
+{
+    struct replay_surface **ppHead;
+    struct replay_surface *pSurf;
+    struct replay_surface *pOwner = NULL;
+    size_t size;
+    int cpp;
+    int height;
+
+    if (pTS->id == 0 || pTS->bpp == 0)
+        return NULL;
+
+    ppHead = &replay_hash[pTS->id % REPLAY_HASH_SIZE];
+
+    for (pSurf = *ppHead; pSurf; pSurf = pSurf->next)
+    {
+        if (pSurf->id != pTS->id)
+            continue;
+
+        if (pSurf->width == pTS->width &&
+            pSurf->height == pTS->height &&
+            pSurf->bpp == pTS->bpp &&
+            pSurf->layout == pTS->layout)
+            return pSurf;
+
+        if (pSurf->own)
+            pOwner = pSurf;
+    }
+
+    pSurf = calloc(1, sizeof(*pSurf));
+    if (!pSurf)
+        return NULL;
+
+    /* Whole super tiles, the resolvers work on 64x64 blocks */
+    cpp = (pTS->bpp + 7) / 8;
+    pSurf->stride = REPLAY_ALIGN(REPLAY_ALIGN(pTS->width, 64) * cpp, 256);
+    height = REPLAY_ALIGN(pTS->height, 64);
+    size = (size_t)pSurf->stride * height;
+
+    if (!pOwner || pOwner->size < size)
+    {
+        struct replay_surface *pView;
+        uint32_t *bits;
+
+        if (posix_memalign((void **)&bits, 64, size))
+        {
+            free(pSurf);
+            return NULL;
+        }
+
+        /* Fault the pages in now rather than in the first timed op */
+        memset(bits, 0x5a, size);
+
+        if (pOwner)
+        {
+            free(pOwner->bits);
+
+            for (pView = *ppHead; pView; pView = pView->next)
+            {
+                if (pView->id == pTS->id)
+                    pView->bits = bits;
+            }
+
+            pOwner->size = size;
+        }
+        else
+        {
+            pSurf->size = size;
+            pSurf->own = TRUE;
+        }
+
+        pSurf->bits = bits;
+    }
+    else
+    {
+        pSurf->bits = pOwner->bits;
+    }
+
+    pSurf->id = pTS->id;
+    pSurf->width = pTS->width;
+    pSurf->height = pTS->height;
+    pSurf->bpp = pTS->bpp;
+    pSurf->layout = pTS->layout;
+    pSurf->next = *ppHead;
+    *ppHead = pSurf;
+
+    return pSurf;
+}
+
+static void replay_free_surfaces(void)
+{
+    int i;
+
+    for (i = 0; i < REPLAY_HASH_SIZE; ++i)
+    {
+        struct replay_surface *pSurf = replay_hash[i];
+
+        while (pSurf)
+        {
+            struct replay_surface *pNext = pSurf->next;
+
+            if (pSurf->own)
+                free(pSurf->bits);
+            free(pSurf);
+            pSurf = pNext;
+        }
+
+        replay_hash[i] = NULL;
+    }
+}
+
+static Bool replay_fits(const struct replay_surface *pSurf,
+                        const struct ls_exa_trace_surface *pTS,
+                        int w, int h)
+{
+    if (!pSurf)
+        return FALSE;
+
+    return pTS->x >= 0 && pTS->y >= 0 &&
+           pTS->x + w <= pSurf->width &&
+           pTS->y + h <= pSurf->height;
+}
+
+static Bool replay_solid(const struct replay_op *pOp)
+{
+    const struct ls_exa_trace_record *pRec = pOp->pRec;
+    struct replay_surface *dst = pOp->dst;
+
+    if (!replay_fits(dst, &pRec->dst, pRec->width, pRec->height))
+        return FALSE;
+
+    return pixman_fill(dst->bits, dst->stride / 4, dst->bpp,
+                       pRec->dst.x, pRec->dst.y,
+                       pRec->width, pRec->height, pRec->value);
+}
+
+static Bool replay_copy_linear(const struct replay_op *pOp)
+{
+    const struct ls_exa_trace_record *pRec = pOp->pRec;
+    struct replay_surface *src = pOp->src;
+    struct replay_surface *dst = pOp->dst;
+    int cpp = (dst->bpp + 7) / 8;
+    uint8_t *pSrc;
+    uint8_t *pDst;
+    int i;
+
+    if (pixman_blt(src->bits, dst->bits,
+                   src->stride / 4, dst->stride / 4,
+                   src->bpp, dst->bpp,
+                   pRec->src.x, pRec->src.y,
+                   pRec->dst.x, pRec->dst.y,
+                   pRec->width, pRec->height))
+        return TRUE;
+
+    /* Overlapping copies within one pixmap, as fbBlt would do them */
+    if (src->bpp != dst->bpp)
+        return FALSE;
+
+    pSrc = (uint8_t *)src->bits + pRec->src.y * src->stride + pRec->src.x * cpp;
+    pDst = (uint8_t *)dst->bits + pRec->dst.y * dst->stride + pRec->dst.x * cpp;
+
+    if (pDst > pSrc)
+    {
+        pSrc += (pRec->height - 1) * src->stride;
+        pDst += (pRec->height - 1) * dst->stride;
+
+        for (i = 0; i < pRec->height; ++i)
+        {
+            memmove(pDst, pSrc, pRec->width * cpp);
+            pSrc -= src->stride;
+            pDst -= dst->stride;
+        }
+    }
+    else
+    {
+        for (i = 0; i < pRec->height; ++i)
+        {
+            memmove(pDst, pSrc, pRec->width * cpp);
+            pSrc += src->stride;
+            pDst += dst->stride;
+        }
+    }
+
+    return TRUE;
+}
+
+static Bool replay_copy(const struct replay_op *pOp)
+{
+    const struct ls_exa_trace_record *pRec = pOp->pRec;
+    struct replay_surface *src = pOp->src;
+    struct replay_surface *dst = pOp->dst;
+
+    if (!replay_fits(src, &pRec->src, pRec->width, pRec->height) ||
+        !replay_fits(dst, &pRec->dst, pRec->width, pRec->height))
+        return FALSE;
+
+    switch (pRec->src.layout)
+    {
+    case LS_EXA_TRACE_LINEAR:
+        return replay_copy_linear(pOp);
+
+    case LS_EXA_TRACE_ETNAVIV_TILED:
+#if HAVE_LIBDRM_ETNAVIV && HAVE_LSX
+        if (src->bpp != 32 || dst->bpp != 32)
+            return FALSE;
+
+        return lsx_resolve_etnaviv_tile_4x4(src->bits, dst->bits,
+                                            src->stride / 4, dst->stride / 4,
+                                            pRec->src.x, pRec->src.y,
+                                            pRec->dst.x, pRec->dst.y,
+                                            pRec->width, pRec->height);
+#else
+        return FALSE;
+#endif
+
+    case LS_EXA_TRACE_ETNAVIV_SUPER_TILED:
+#if HAVE_LIBDRM_ETNAVIV
+        if (src->bpp != 32 || dst->bpp != 32)
+            return FALSE;
+
+#if HAVE_LSX
+        return etnaviv_supertile_to_linear_lsx(src->bits, dst->bits,
+                                               src->stride / 4, dst->stride / 4,
+                                               pRec->src.x, pRec->src.y,
+                                               pRec->dst.x, pRec->dst.y,
+                                               pRec->width, pRec->height);
+#elif HAVE_MSA
+        return etnaviv_supertile_to_linear_msa(src->bits, dst->bits,
+                                               src->stride / 4, dst->stride / 4,
+                                               pRec->src.x, pRec->src.y,
+                                               pRec->dst.x, pRec->dst.y,
+                                               pRec->width, pRec->height);
+#else
+        return etnaviv_supertile_to_linear_generic(src->bits, dst->bits,
+                                                   src->stride / 4,
+                                                   dst->stride / 4,
+                                                   pRec->src.x, pRec->src.y,
+                                                   pRec->dst.x, pRec->dst.y,
+                                                   pRec->width, pRec->height);
+#endif
+#else
+        return FALSE;
+#endif
+
+    case LS_EXA_TRACE_GSGPU_TILED4:
+#if HAVE_LIBDRM_GSGPU && HAVE_LSX
+        return lsx_resolve_gsgpu_tile_4x4(src->bits, dst->bits,
+                                          src->stride / 4, dst->stride / 4,
+                                          src->bpp, dst->bpp,
+                                          pRec->src.x, pRec->src.y,
+                                          pRec->dst.x, pRec->dst.y,
+                                          pRec->width, pRec->height);
+#else
+        return FALSE;
+#endif
+    }
+
+    return FALSE;
+}
+
+static pixman_image_t *
+replay_picture(const struct ls_exa_trace_surface *pTS,
+               struct replay_surface *pSurf)
+{
+    pixman_format_code_t format = pTS->format;
+    pixman_color_t grey = { 0x8000, 0x8000, 0x8000, 0xc000 };
+
+    /* Source-only pictures, like a solid mask */
+    if (!pSurf)
+        return pixman_image_create_solid_fill(&grey);
+
+    if (!pixman_format_supported_source(format) ||
+        PIXMAN_FORMAT_BPP(format) != pSurf->bpp)
+        return NULL;
+
+    return pixman_image_create_bits(format, pSurf->width, pSurf->height,
+                                    pSurf->bits, pSurf->stride);
+}
+
+static Bool replay_composite(const struct replay_op *pOp)
+{
+    const struct ls_exa_trace_record *pRec = pOp->pRec;
+    pixman_image_t *pSrc = NULL;
+    pixman_image_t *pMask = NULL;
+    pixman_image_t *pDst = NULL;
+    Bool ret = FALSE;
+
+    if (!pOp->dst ||
+        !pixman_format_supported_destination(pRec->dst.format) ||
+        PIXMAN_FORMAT_BPP(pRec->dst.format) != pOp->dst->bpp)
+        return FALSE;
+
+    pDst = pixman_image_create_bits(pRec->dst.format,
+                                    pOp->dst->width, pOp->dst->height,
+                                    pOp->dst->bits, pOp->dst->stride);
+    pSrc = replay_picture(&pRec->src, pOp->src);
+
+    if (pRec->mask.format)
+    {
+        pMask = replay_picture(&pRec->mask, pOp->mask);
+        if (!pMask)
+            goto out;
+    }
+
+    if (!pDst || !pSrc)
+        goto out;
+
+    pixman_image_composite32(pRec->arg, pSrc, pMask, pDst,
+                             pRec->src.x, pRec->src.y,
+                             pRec->mask.x, pRec->mask.y,
+                             pRec->dst.x, pRec->dst.y,
+                             pRec->width, pRec->height);
+    ret = TRUE;
+
+out:
+    if (pMask)
+        pixman_image_unref(pMask);
+    if (pSrc)
+        pixman_image_unref(pSrc);
+    if (pDst)
+        pixman_image_unref(pDst);
+
+    return ret;
+}
+
+/* Upload and download, with the row copy of the recording backend */
+static Bool replay_transfer(const struct replay_op *pOp, int backend)
+{
+    const struct ls_exa_trace_record *pRec = pOp->pRec;
+    Bool upload = pRec->op == LS_EXA_TRACE_UPLOAD;
+    const struct ls_exa_trace_surface *pTS = upload ? &pRec->dst : &pRec->src;
+    struct replay_surface *pSurf = upload ? pOp->dst : pOp->src;
+    uint8_t *pPix;
+    uint8_t *pMem = replay_scratch;
+    int cpp;
+    int len;
+    int i;
+
+    if (!replay_fits(pSurf, pTS, pRec->width, pRec->height))
+        return FALSE;
+
+    cpp = (pSurf->bpp + 7) / 8;
+    len = pRec->width * cpp;
+    pPix = (uint8_t *)pSurf->bits + pTS->y * pSurf->stride + pTS->x * cpp;
+
+    for (i = 0; i < pRec->height; ++i)
+    {
+        if (backend == LS_EXA_TRACE_BACKEND_GSGPU)
+        {
+            if (upload)
+                loongson_blt(pPix, pMem, len);
+            else
+                loongson_blt(pMem, pPix, len);
+        }
+        else
+        {
+            if (upload)
+                memcpy(pPix, pMem, len);
+            else
+                memcpy(pMem, pPix, len);
+        }
+
+        pPix += pSurf->stride;
+        pMem += len;
+    }
+
+    return TRUE;
+}
+
+static int replay_row(const struct ls_exa_trace_record *pRec)
+{
+    if (pRec->op == LS_EXA_TRACE_COPY &&
+        pRec->src.layout != LS_EXA_TRACE_LINEAR &&
+        pRec->src.layout < LS_EXA_TRACE_LAYOUT_NUM)
+        return LS_EXA_TRACE_OP_NUM + pRec->src.layout - 1;
+
+    return pRec->op;
+}
+
+static void replay_run(const struct replay_op *pOps, size_t num, int backend)
+{
+    size_t i;
+
+    for (i = 0; i < num; ++i)
+    {
+        const struct replay_op *pOp = &pOps[i];
+        const struct ls_exa_trace_record *pRec = pOp->pRec;
+        struct replay_stat *pStat = &replay_stats[replay_row(pRec)];
+        const struct replay_surface *pBytesFrom;
+        uint64_t start = replay_now();
+        Bool done;
+
+        switch (pRec->op)
+        {
+        case LS_EXA_TRACE_SOLID:
+            done = replay_solid(pOp);
+            break;
+        case LS_EXA_TRACE_COPY:
+            done = replay_copy(pOp);
+            break;
+        case LS_EXA_TRACE_COMPOSITE:
+            done = replay_composite(pOp);
+            break;
+        case LS_EXA_TRACE_UPLOAD:
+        case LS_EXA_TRACE_DOWNLOAD:
+            done = replay_transfer(pOp, backend);
+            break;
+        default:
+            /* Mapping and fencing has no CPU side worth replaying */
+            pStat->count++;
+            continue;
+        }
+
+        if (!done)
+        {
+            pStat->skipped++;
+            continue;
+        }
+
+        pStat->ns += replay_now() - start;
+        pStat->count++;
+        pStat->pixels += (uint64_t)pRec->width * pRec->height;
+
+        pBytesFrom = pRec->op == LS_EXA_TRACE_DOWNLOAD ? pOp->src : pOp->dst;
+        pStat->bytes += (uint64_t)pRec->width * pRec->height *
+                        ((pBytesFrom->bpp + 7) / 8);
+    }
+}
+
+static void replay_report(void)
+{
+    int i;
+
+    printf("%-28s %10s %8s %10s %10s %10s %10s %10s\n",
+           "op", "count", "skipped", "Mpixels", "MB", "ms", "MB/s", "ops/s");
+
+    for (i = 0; i < REPLAY_ROW_NUM; ++i)
+    {
+        const struct replay_stat *pStat = &replay_stats[i];
+        double sec = pStat->ns / 1e9;
+
+        if (!pStat->count && !pStat->skipped)
+            continue;
+
+        printf("%-28s %10llu %8llu %10.2f %10.2f %10.2f %10.1f %10.0f\n",
+               replay_row_names[i],
+               (unsigned long long)pStat->count,
+               (unsigned long long)pStat->skipped,
+               pStat->pixels / 1e6,
+               pStat->bytes / 1e6,
+               pStat->ns / 1e6,
+               sec > 0 ? pStat->bytes / 1e6 / sec : 0.0,
+               sec > 0 ? pStat->count / sec : 0.0);
+    }
+}
+
+static void *replay_load(const char *path, size_t *pSize)
+{
+    FILE *fp = fopen(path, "rb");
+    void *pData;
+    long size;
+
+    if (!fp)
+    {
+        perror(path);
+        return NULL;
+    }
+
+    if (fseek(fp, 0, SEEK_END) || (size = ftell(fp)) < 0 ||
+        fseek(fp, 0, SEEK_SET))
+    {
+        perror(path);
+        fclose(fp);
+        return NULL;
+    }
+
+    pData = malloc(size ? size : 1);
+    if (!pData || fread(pData, 1, size, fp) != (size_t)size)
+    {
+        fprintf(stderr, "%s: read failed\n", path);
+        free(pData);
+        fclose(fp);
+        return NULL;
+    }
+
+    fclose(fp);
+
+    *pSize = size;
+
+    return pData;
+}
+
+static void replay_usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [-r repeat] trace\n", argv0);
+}
+
+int main(int argc, char **argv)
+{
+    const struct ls_exa_trace_header *pHeader;
+    const struct ls_exa_trace_record *pRecs;
+    struct replay_op *pOps;
+    size_t scratch_size = 0;
+    size_t size;
+    size_t num;
+    size_t i;
+    void *pData;
+    int repeat = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            repeat = atoi(optarg);
+            if (repeat > 0)
+                break;
+            /* fall through */
+        default:
+            replay_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind != argc - 1)
+    {
+        replay_usage(argv[0]);
+        return 1;
+    }
+
+    pData = replay_load(argv[optind], &size);
+    if (!pData)
+        return 1;
+
+    pHeader = pData;
+    if (size < sizeof(*pHeader) ||
+        pHeader->magic != LS_EXA_TRACE_MAGIC ||
+        pHeader->version != LS_EXA_TRACE_VERSION ||
+        pHeader->record_size != sizeof(struct ls_exa_trace_record) ||
+        pHeader->backend >= LS_EXA_TRACE_BACKEND_NUM)
+    {
+        fprintf(stderr, "%s: not a version %d EXA trace of this build\n",
+                argv[optind], LS_EXA_TRACE_VERSION);
+        free(pData);
+        return 1;
+    }
+
+    pRecs = (const struct ls_exa_trace_record *)(pHeader + 1);
+    num = (size - sizeof(*pHeader)) / sizeof(*pRecs);
+
+    pOps = calloc(num ? num : 1, sizeof(*pOps));
+    if (!pOps)
+    {
+        free(pData);
+        return 1;
+    }
+
+    /* Allocate every surface up front, outside of the timed loop */
+    for (i = 0; i < num; ++i)
+    {
+        const struct ls_exa_trace_record *pRec = &pRecs[i];
+        size_t transfer;
+
+        if (pRec->op >= LS_EXA_TRACE_OP_NUM)
+        {
+            fprintf(stderr, "record %zu: unknown op %u\n", i, pRec->op);
+            free(pOps);
+            free(pData);
+            return 1;
+        }
+
+        pOps[i].pRec = pRec;
+        pOps[i].dst = replay_get_surface(&pRec->dst);
+        pOps[i].src = replay_get_surface(&pRec->src);
+        pOps[i].mask = replay_get_surface(&pRec->mask);
+
+        transfer = (size_t)pRec->width * pRec->height * 4;
+        if (transfer > scratch_size)
+            scratch_size = transfer;
+    }
+
+    replay_scratch = malloc(scratch_size ? scratch_size : 1);
+    if (!replay_scratch)
+    {
+        replay_free_surfaces();
+        free(pOps);
+        free(pData);
+        return 1;
+    }
+
+    memset(replay_scratch, 0xa5, scratch_size);
+
+    loongson_init_blitter();
+
+    printf("%s: %zu records from the %s backend, replayed %d time(s)\n\n",
+           argv[optind], num, replay_backend_names[pHeader->backend], repeat);
+
+    for (i = 0; i < (size_t)repeat; ++i)
+        replay_run(pOps, num, pHeader->backend);
+
+    replay_report();
+
+    free(replay_scratch);
+    replay_free_surfaces();
+    free(pOps);
+    free(pData);
+
+    return 0;
+}
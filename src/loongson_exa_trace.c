@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2026 Loongson Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <xf86.h>
+
+#include "loongson_exa_trace.h"
+
+struct ls_exa_trace
+{
+    FILE *fp;
+    uint64_t records;
+};
+
+struct ls_exa_trace *ls_exa_trace;
+
+static uint32_t LS_ExaTraceId(PixmapPtr pPixmap)
+{
+    uintptr_t p = (uintptr_t)pPixmap;
+
+    return (uint32_t)(p ^ ((uint64_t)p >> 32));
+}
+
+static void LS_ExaTraceSurface(struct ls_exa_trace_surface *pSurf,
+                               PixmapPtr pPixmap,
+                               int x, int y)
+{
+    if (!pPixmap)
+        return;
+
+    pSurf->id = LS_ExaTraceId(pPixmap);
+    pSurf->width = pPixmap->drawable.width;
+    pSurf->height = pPixmap->drawable.height;
+    pSurf->bpp = pPixmap->drawable.bitsPerPixel;
+    pSurf->layout = LS_EXA_TRACE_LINEAR;
+    pSurf->x = x;
+    pSurf->y = y;
+}
+
+static void LS_ExaTraceWrite(const struct ls_exa_trace_record *pRec)
+{
+    if (fwrite(pRec, sizeof(*pRec), 1, ls_exa_trace->fp) == 1)
+    {
+        ls_exa_trace->records++;
+        return;
+    }
+
+    /* Out of space most likely, keep what was written so far */
+    xf86Msg(X_ERROR, "EXA trace: write failed after %llu records: %s\n",
+            (unsigned long long)ls_exa_trace->records, strerror(errno));
+
+    fclose(ls_exa_trace->fp);
+    free(ls_exa_trace);
+    ls_exa_trace = NULL;
+}
+
+Bool LS_ExaTraceOpen(ScrnInfoPtr pScrn, const char *path,
+                     enum ls_exa_trace_backend backend)
+{
+    struct ls_exa_trace_header header;
+    struct ls_exa_trace *pTrace;
+
+    if (ls_exa_trace)
+    {
+        xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+                   "EXA trace: already recording, %s ignored\n", path);
+        return FALSE;
+    }
+
+    pTrace = calloc(1, sizeof(*pTrace));
+    if (!pTrace)
+        return FALSE;
+
+    pTrace->fp = fopen(path, "wbe");
+    if (!pTrace->fp)
+    {
+        xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+                   "EXA trace: failed to open %s: %s\n",
+                   path, strerror(errno));
+        free(pTrace);
+        return FALSE;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = LS_EXA_TRACE_MAGIC;
+    header.version = LS_EXA_TRACE_VERSION;
+    header.record_size = sizeof(struct ls_exa_trace_record);
+    header.backend = backend;
+
+    if (fwrite(&header, sizeof(header), 1, pTrace->fp) != 1)
+    {
+        xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+                   "EXA trace: failed to write %s: %s\n",
+                   path, strerror(errno));
+        fclose(pTrace->fp);
+        free(pTrace);
+        return FALSE;
+    }
+
+    ls_exa_trace = pTrace;
+
+    xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+               "EXA trace: recording to %s\n", path);
+
+    return TRUE;
+}
+
+void LS_ExaTraceClose(ScrnInfoPtr pScrn)
+{
+    if (!ls_exa_trace)
+        return;
+
+    xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+               "EXA trace: %llu records written\n",
+               (unsigned long long)ls_exa_trace->records);
+
+    fclose(ls_exa_trace->fp);
+    free(ls_exa_trace);
+    ls_exa_trace = NULL;
+}
+
+void LS_ExaTraceSolid(PixmapPtr pPixmap, int alu, Pixel fg,
+                      int x1, int y1, int x2, int y2)
+{
+    struct ls_exa_trace_record rec = { 0 };
+
+    rec.op = LS_EXA_TRACE_SOLID;
+    rec.arg = alu;
+    rec.value = fg;
+    rec.width = x2 - x1;
+    rec.height = y2 - y1;
+    LS_ExaTraceSurface(&rec.dst, pPixmap, x1, y1);
+
+    LS_ExaTraceWrite(&rec);
+}
+
+void LS_ExaTraceCopy(PixmapPtr pSrc, PixmapPtr pDst,
+                     enum ls_exa_trace_layout src_layout, int alu,
+                     int srcX, int srcY, int dstX, int dstY,
+                     int width, int height)
+{
+    struct ls_exa_trace_record rec = { 0 };
+
+    rec.op = LS_EXA_TRACE_COPY;
+    rec.arg = alu;
+    rec.width = width;
+    rec.height = height;
+    LS_ExaTraceSurface(&rec.dst, pDst, dstX, dstY);
+    LS_ExaTraceSurface(&rec.src, pSrc, srcX, srcY);
+    rec.src.layout = src_layout;
+
+    LS_ExaTraceWrite(&rec);
+}
+
+void LS_ExaTraceComposite(int op,
+                          PicturePtr pSrcPicture,
+                          PicturePtr pMaskPicture,
+                          PicturePtr pDstPicture,
+                          PixmapPtr pSrc, PixmapPtr pMask, PixmapPtr pDst,
+                          int srcX, int srcY, int maskX, int maskY,
+                          int dstX, int dstY, int width, int height)
+{
+    struct ls_exa_trace_record rec = { 0 };
+
+    rec.op = LS_EXA_TRACE_COMPOSITE;
+    rec.arg = op;
+    rec.width = width;
+    rec.height = height;
+
+    LS_ExaTraceSurface(&rec.dst, pDst, dstX, dstY);
+    rec.dst.format = pDstPicture->format;
+
+    LS_ExaTraceSurface(&rec.src, pSrc, srcX, srcY);
+    rec.src.format = pSrcPicture->format;
+
+    if (pMaskPicture)
+    {
+        LS_ExaTraceSurface(&rec.mask, pMask, maskX, maskY);
+        rec.mask.format = pMaskPicture->format;
+    }
+
+    LS_ExaTraceWrite(&rec);
+}
+
+void LS_ExaTraceUpload(PixmapPtr pPixmap, int x, int y, int w, int h)
+{
+    struct ls_exa_trace_record rec = { 0 };
+
+    rec.op = LS_EXA_TRACE_UPLOAD;
+    rec.width = w;
+    rec.height = h;
+    LS_ExaTraceSurface(&rec.dst, pPixmap, x, y);
+
+    LS_ExaTraceWrite(&rec);
+}
+
+void LS_ExaTraceDownload(PixmapPtr pPixmap, int x, int y, int w, int h)
+{
+    struct ls_exa_trace_record rec = { 0 };
+
+    rec.op = LS_EXA_TRACE_DOWNLOAD;
+    rec.width = w;
+    rec.height = h;
+    LS_ExaTraceSurface(&rec.src, pPixmap, x, y);
+
+    LS_ExaTraceWrite(&rec);
+}
+
+void LS_ExaTraceAccess(enum ls_exa_trace_op op, PixmapPtr pPixmap, int index)
+{
+    struct ls_exa_trace_record rec = { 0 };
+
+    rec.op = op;
+    rec.arg = index;
+    LS_ExaTraceSurface(&rec.dst, pPixmap, 0, 0);
+
+    LS_ExaTraceWrite(&rec);
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2026 Loongson Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef LOONGSON_EXA_TRACE_H_
+#define LOONGSON_EXA_TRACE_H_
+
+#include <xf86.h>
+#include <pixmapstr.h>
+#include <picturestr.h>
+
+#include "loongson_exa_trace_format.h"
+
+/*
+ * EXA trace recording, enabled with Option "ExaTrace" "<file>". Every
+ * hook of the active EXA backend appends one record with its geometry,
+ * so that the same traffic can later be replayed without a server by
+ * loongson-exa-replay. Pixel contents are not recorded.
+ *
+ * When no trace is open each hook costs one test of ls_exa_trace.
+ */
+
+struct ls_exa_trace;
+
+extern struct ls_exa_trace *ls_exa_trace;
+
+Bool LS_ExaTraceOpen(ScrnInfoPtr pScrn, const char *path,
+                     enum ls_exa_trace_backend backend);
+void LS_ExaTraceClose(ScrnInfoPtr pScrn);
+
+void LS_ExaTraceSolid(PixmapPtr pPixmap, int alu, Pixel fg,
+                      int x1, int y1, int x2, int y2);
+
+void LS_ExaTraceCopy(PixmapPtr pSrc, PixmapPtr pDst,
+                     enum ls_exa_trace_layout src_layout, int alu,
+                     int srcX, int srcY, int dstX, int dstY,
+                     int width, int height);
+
+void LS_ExaTraceComposite(int op,
+                          PicturePtr pSrcPicture,
+                          PicturePtr pMaskPicture,
+                          PicturePtr pDstPicture,
+                          PixmapPtr pSrc, PixmapPtr pMask, PixmapPtr pDst,
+                          int srcX, int srcY, int maskX, int maskY,
+                          int dstX, int dstY, int width, int height);
+
+void LS_ExaTraceUpload(PixmapPtr pPixmap, int x, int y, int w, int h);
+void LS_ExaTraceDownload(PixmapPtr pPixmap, int x, int y, int w, int h);
+
+void LS_ExaTraceAccess(enum ls_exa_trace_op op, PixmapPtr pPixmap, int index);
+
+#define LS_EXA_TRACE(hook, ...)                 \
+    do {                                        \
+        if (ls_exa_trace)                       \
+            LS_ExaTrace##hook(__VA_ARGS__);     \
+    } while (0)
+
+#endif
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2026 Loongson Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef LOONGSON_EXA_TRACE_FORMAT_H_
+#define LOONGSON_EXA_TRACE_FORMAT_H_
+
+#include <stdint.h>
+
+/*
+ * On-disk layout of an EXA trace, as written by the driver with
+ * Option "ExaTrace" and read back by loongson-exa-replay. This header
+ * must not depend on the X server, the replayer is built without one.
+ *
+ * A trace is one ls_exa_trace_header followed by fixed size records in
+ * host byte order. Pixmaps are named by an opaque id which is only
+ * stable while the pixmap lives; the replayer tells reused ids apart by
+ * their geometry.
+ */
+
+#define LS_EXA_TRACE_MAGIC      0x5458534c    /* "LSXT" */
+#define LS_EXA_TRACE_VERSION    1
+
+enum ls_exa_trace_backend
+{
+    LS_EXA_TRACE_BACKEND_FAKE,
+    LS_EXA_TRACE_BACKEND_ETNAVIV,
+    LS_EXA_TRACE_BACKEND_GSGPU,
+    LS_EXA_TRACE_BACKEND_NUM
+};
+
+enum ls_exa_trace_op
+{
+    LS_EXA_TRACE_SOLID,
+    LS_EXA_TRACE_COPY,
+    LS_EXA_TRACE_COMPOSITE,
+    LS_EXA_TRACE_UPLOAD,
+    LS_EXA_TRACE_DOWNLOAD,
+    LS_EXA_TRACE_PREPARE_ACCESS,
+    LS_EXA_TRACE_FINISH_ACCESS,
+    LS_EXA_TRACE_OP_NUM
+};
+
+/* How the pixels of a surface are laid out in memory */
+enum ls_exa_trace_layout
+{
+    LS_EXA_TRACE_LINEAR,
+    LS_EXA_TRACE_ETNAVIV_TILED,
+    LS_EXA_TRACE_ETNAVIV_SUPER_TILED,
+    LS_EXA_TRACE_GSGPU_TILED4,
+    LS_EXA_TRACE_LAYOUT_NUM
+};
+
+struct ls_exa_trace_header
+{
+    uint32_t magic;
+    uint16_t version;
+    /* sizeof(struct ls_exa_trace_record) of the writer */
+    uint16_t record_size;
+    uint8_t backend;
+    uint8_t pad[7];
+};
+
+struct ls_exa_trace_surface
+{
+    /* 0 when the operation has no such surface */
+    uint32_t id;
+    /* pixman format code of the picture, composite only */
+    uint32_t format;
+    uint16_t width;
+    uint16_t height;
+    uint8_t bpp;
+    uint8_t layout;
+    uint16_t pad;
+    /* origin of the operation within this surface */
+    int16_t x;
+    int16_t y;
+};
+
+struct ls_exa_trace_record
+{
+    uint8_t op;
+    /* alu for solid and copy, render op for composite,
+     * EXA_PREPARE_* index for prepare and finish access
+     */
+    uint8_t arg;
+    uint16_t pad;
+    /* fill colour of a solid */
+    uint32_t value;
+    uint16_t width;
+    uint16_t height;
+    struct ls_exa_trace_surface dst;
+    struct ls_exa_trace_surface src;
+    struct ls_exa_trace_surface mask;
+};
+
+#endif
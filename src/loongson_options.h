@@ -35,11 +35,16 @@ typedef enum {
     OPTION_SW_CURSOR,
     OPTION_DEVICE_PATH,
     OPTION_SHADOW_FB,
+    OPTION_SHADOW_PAGEFLIP,
     OPTION_ACCEL_METHOD,
     OPTION_EXA_TYPE,
     OPTION_PAGEFLIP,
+    OPTION_VARIABLE_REFRESH,
+    OPTION_FAST_STARTUP,
     OPTION_ZAPHOD_HEADS,
     OPTION_ATOMIC,
+    OPTION_SWAP_DAMAGE,
+    OPTION_EXA_TRACE,
     OPTION_DEBUG,
 } LoongsonOpts;
 
@@ -30,7 +30,12 @@
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <linux/dma-buf.h>
 #include <xf86.h>
+#include <xf86drm.h>
 
 #include "driver.h"
 #include "loongson_buffer.h"
@@ -201,6 +206,8 @@ void LS_DestroyDumbPixmap(ScreenPtr pScreen, void *driverPriv)
     struct drmmode_rec * const pDrmMode = &lsp->drmmode;
     struct exa_pixmap_priv *priv = (struct exa_pixmap_priv *)driverPriv;
 
+    LS_DmaBufRelease(priv);
+
     if (priv->fd > 0)
     {
         close(priv->fd);
@@ -252,3 +259,115 @@ uint64_t loongson_pixmap_get_tiling_info(PixmapPtr pPixmap)
 
     return priv->tiling_info;
 }
+
+
+///////////////////////////////////////////////////////////////////////////
+//
+// CPU access to buffers imported from DRI3 clients goes through an mmap
+// of the dma-buf itself rather than of our GEM handle. The mapping is
+// made on first use and kept until the pixmap is destroyed, and every
+// access is bracketed with DMA_BUF_IOCTL_SYNC so that the exporter can
+// flush or invalidate its caches around it.
+//
+///////////////////////////////////////////////////////////////////////////
+
+static uint64_t LS_DmaBufSyncFlags(int index)
+{
+    switch (index)
+    {
+    case EXA_PREPARE_DEST:
+    case EXA_PREPARE_AUX_DEST:
+        return DMA_BUF_SYNC_RW;
+    default:
+        return DMA_BUF_SYNC_READ;
+    }
+}
+
+static void LS_DmaBufSync(struct exa_pixmap_priv *priv, uint64_t flags)
+{
+    struct dma_buf_sync sync = { .flags = flags };
+
+    /* Exporters without cache maintenance just don't implement it */
+    if (drmIoctl(priv->fd, DMA_BUF_IOCTL_SYNC, &sync))
+        DEBUG_MSG("fd %d: sync 0x%llx: %s", priv->fd,
+                  (unsigned long long) flags, strerror(errno));
+}
+
+Bool LS_DmaBufPrepareAccess(PixmapPtr pPixmap, int index)
+{
+    struct exa_pixmap_priv *priv = exaGetPixmapDriverPrivate(pPixmap);
+    uint64_t flags = LS_DmaBufSyncFlags(index);
+
+    if (priv->dmabuf_map == NULL)
+    {
+        off_t size = lseek(priv->fd, 0, SEEK_END);
+        void *map;
+
+        if (size <= 0)
+            return FALSE;
+
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   priv->fd, 0);
+        if (map == MAP_FAILED)
+        {
+            xf86Msg(X_WARNING, "%s: mmap of dma-buf %d failed: %s\n",
+                    __func__, priv->fd, strerror(errno));
+            return FALSE;
+        }
+
+        priv->dmabuf_map = map;
+        priv->dmabuf_size = size;
+    }
+
+    if (priv->dmabuf_access == 0)
+    {
+        LS_SyncPrepareAccess(pPixmap, index);
+        LS_DmaBufSync(priv, DMA_BUF_SYNC_START | flags);
+        priv->dmabuf_flags = flags;
+    }
+    else if ((flags & DMA_BUF_SYNC_WRITE) &&
+             !(priv->dmabuf_flags & DMA_BUF_SYNC_WRITE))
+    {
+        /* A nested access writes to what was opened for reading */
+        LS_DmaBufSync(priv, DMA_BUF_SYNC_END | priv->dmabuf_flags);
+        LS_DmaBufSync(priv, DMA_BUF_SYNC_START | flags);
+        priv->dmabuf_flags = flags;
+    }
+
+    priv->dmabuf_access++;
+    priv->is_mapped = TRUE;
+    pPixmap->devPrivate.ptr = priv->dmabuf_map;
+
+    return TRUE;
+}
+
+void LS_DmaBufFinishAccess(PixmapPtr pPixmap, int index)
+{
+    struct exa_pixmap_priv *priv = exaGetPixmapDriverPrivate(pPixmap);
+
+    if (priv->dmabuf_access == 0)
+        return;
+
+    if (--priv->dmabuf_access)
+        return;
+
+    LS_DmaBufSync(priv, DMA_BUF_SYNC_END | priv->dmabuf_flags);
+
+    /* The mapping stays, prepare access hands it out again */
+    priv->is_mapped = FALSE;
+    pPixmap->devPrivate.ptr = NULL;
+}
+
+void LS_DmaBufRelease(struct exa_pixmap_priv *priv)
+{
+    if (priv->dmabuf_access)
+        LS_DmaBufSync(priv, DMA_BUF_SYNC_END | priv->dmabuf_flags);
+
+    if (priv->dmabuf_map)
+        munmap(priv->dmabuf_map, priv->dmabuf_size);
+
+    priv->dmabuf_map = NULL;
+    priv->dmabuf_size = 0;
+    priv->dmabuf_access = 0;
+    priv->dmabuf_import = FALSE;
+}
@@ -71,6 +71,8 @@ struct exa_pixmap_priv {
     struct drmmode_fb *fb;
 
     uint64_t tiling_info;
+    /* DRM format modifier of the buffer, as negotiated over DRI3 */
+    uint64_t modifier;
 
     /* GEM handle for pixmaps shared via DRI2/3 */
     int fd;
@@ -84,6 +86,15 @@ struct exa_pixmap_priv {
     Bool is_dumb;
     Bool is_gtt;
     Bool is_mapped;
+
+    /* CPU view of a buffer imported over DRI3, mapped through its
+     * dma-buf (the fd above), see LS_DmaBufPrepareAccess()
+     */
+    Bool dmabuf_import;
+    void *dmabuf_map;
+    size_t dmabuf_size;
+    int dmabuf_access;
+    uint64_t dmabuf_flags;
 };
 
 /* OUTPUT SLAVE SUPPORT */
@@ -99,6 +110,15 @@ typedef struct LoongsonPixmapPriv
     int flip_seq; /* seq of current page flip event handler */
     Bool wait_for_damage; /* if we have requested damage notification from source */
 
+    /** Sink fields for scanning out an imported dma-buf */
+    int prime_fd; /* the shared dma-buf, polled for the source's fences */
+    Bool has_prime_fd;
+    void *prime_map; /* CPU view of the dma-buf when it has to be copied */
+    Bool prime_map_rw; /* prime_map may be written, i.e. used as devPrivate */
+    Bool prime_copy; /* import failed, backing_bo is a local copy */
+    Bool fence_wait; /* a flip is waiting for prime_fd to become readable */
+    xf86CrtcPtr fence_crtc;
+
     /** Source fields for flipping shared pixmaps */
     Bool defer_dirty_update; /* if we want to manually update */
     PixmapDirtyUpdatePtr dirty; /* cached dirty ent to avoid searching list */
@@ -126,4 +146,8 @@ PixmapPtr loongson_pixmap_create_header(ScreenPtr pScreen,
         int devKind, void *pPixData);
 
 uint64_t loongson_pixmap_get_tiling_info(PixmapPtr pPixmap);
+
+Bool LS_DmaBufPrepareAccess(PixmapPtr pPixmap, int index);
+void LS_DmaBufFinishAccess(PixmapPtr pPixmap, int index);
+void LS_DmaBufRelease(struct exa_pixmap_priv *priv);
 #endif
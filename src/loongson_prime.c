@@ -31,6 +31,8 @@
 
 #include <unistd.h>
 #include <malloc.h>
+#include <sys/mman.h>
+#include <linux/dma-buf.h>
 
 #include <xf86str.h>
 #include <xf86Crtc.h>
@@ -42,8 +44,16 @@
 #include "loongson_prime.h"
 #include "loongson_pixmap.h"
 #include "loongson_exa.h"
+#include "loongson_debug.h"
+#include "loongson_blt.h"
+#include "loongson_stats.h"
 
-/* OUTPUT SLAVE SUPPORT */
+/*
+ * Import the source GPU's dma-buf so the crtc scans it out directly. The
+ * fd is kept: it is polled for the source's fences before flipping to it.
+ * Only if the display can't import the buffer (say it isn't contiguous)
+ * is a local dumb bo scanned out instead, refreshed from a CPU mapping.
+ */
 static Bool SetSlaveBO(PixmapPtr ppix,
                        int fd_handle,
                        int pitch,
@@ -55,13 +65,205 @@ static Bool SetSlaveBO(PixmapPtr ppix,
     pPixPriv->backing_bo = dumb_get_bo_from_fd(drmmode->fd, fd_handle, pitch, size);
     if (pPixPriv->backing_bo == NULL)
     {
-        return FALSE;
+        /*
+         * The sink renders into the pixmap through this mapping as well,
+         * see drmmode_set_target_scanout_pixmap_cpu(). An exporter which
+         * only hands out read-only dma-bufs gets the local copy instead.
+         */
+        Bool rw = TRUE;
+        void *map = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED, fd_handle, 0);
+
+        if (map == MAP_FAILED)
+        {
+            rw = FALSE;
+            map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd_handle, 0);
+        }
+
+        if (map == MAP_FAILED)
+        {
+            close(fd_handle);
+            return FALSE;
+        }
+
+        pPixPriv->backing_bo = dumb_bo_create(drmmode->fd,
+                                              ppix->drawable.width,
+                                              ppix->drawable.height,
+                                              ppix->drawable.bitsPerPixel);
+        if (pPixPriv->backing_bo == NULL)
+        {
+            munmap(map, size);
+            close(fd_handle);
+            return FALSE;
+        }
+
+        pPixPriv->prime_map = map;
+        pPixPriv->prime_map_rw = rw;
+        pPixPriv->prime_copy = TRUE;
+
+        xf86DrvMsg(drmmode->scrn->scrnIndex, X_WARNING,
+                   "Can't import the shared pixmap, copying it instead\n");
     }
 
-    close(fd_handle);
+    pPixPriv->prime_fd = fd_handle;
+    pPixPriv->has_prime_fd = TRUE;
+
     return TRUE;
 }
 
+static void LS_ReleaseSlaveBO(PixmapPtr ppix, drmmode_ptr drmmode)
+{
+    msPixmapPrivPtr pPixPriv = msGetPixmapPriv(drmmode, ppix);
+
+    if (pPixPriv->fence_wait)
+    {
+        RemoveNotifyFd(pPixPriv->prime_fd);
+        pPixPriv->fence_wait = FALSE;
+    }
+
+    if (pPixPriv->prime_map)
+    {
+        munmap(pPixPriv->prime_map, ppix->devKind * ppix->drawable.height);
+        pPixPriv->prime_map = NULL;
+        pPixPriv->prime_map_rw = FALSE;
+    }
+
+    if (pPixPriv->has_prime_fd)
+    {
+        close(pPixPriv->prime_fd);
+        pPixPriv->has_prime_fd = FALSE;
+    }
+
+    if (pPixPriv->backing_bo)
+    {
+        dumb_bo_destroy(drmmode->fd, pPixPriv->backing_bo);
+        pPixPriv->backing_bo = NULL;
+    }
+
+    pPixPriv->prime_copy = FALSE;
+}
+
+/*
+ * Refresh the local copy of a shared pixmap that couldn't be imported,
+ * only 'pRegion' if given. DMA_BUF_IOCTL_SYNC waits for the source's
+ * rendering and keeps the CPU view coherent.
+ */
+void LS_CopySlaveBO(drmmode_ptr drmmode, PixmapPtr ppix, RegionPtr pRegion)
+{
+    msPixmapPrivPtr pPixPriv = msGetPixmapPriv(drmmode, ppix);
+    struct dma_buf_sync sync = { DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ };
+    struct dumb_bo *bo = pPixPriv->backing_bo;
+    int cpp = ppix->drawable.bitsPerPixel / 8;
+    int src_pitch = ppix->devKind;
+    int dst_pitch;
+    BoxRec whole;
+    BoxPtr pBox;
+    uint8_t *dst;
+    const uint8_t *src = pPixPriv->prime_map;
+    int nBox;
+
+    if (!pPixPriv->prime_copy || dumb_bo_map(drmmode->fd, bo))
+        return;
+
+    dst = dumb_bo_cpu_addr(bo);
+    dst_pitch = dumb_bo_pitch(bo);
+
+    if (pRegion)
+    {
+        pBox = REGION_RECTS(pRegion);
+        nBox = REGION_NUM_RECTS(pRegion);
+    }
+    else
+    {
+        whole.x1 = 0;
+        whole.y1 = 0;
+        whole.x2 = ppix->drawable.width;
+        whole.y2 = ppix->drawable.height;
+        pBox = &whole;
+        nBox = 1;
+    }
+
+    drmIoctl(pPixPriv->prime_fd, DMA_BUF_IOCTL_SYNC, &sync);
+
+    while (nBox--)
+    {
+        int y;
+
+        for (y = pBox->y1; y < pBox->y2; y++)
+            loongson_blt(dst + y * dst_pitch + pBox->x1 * cpp,
+                         src + y * src_pitch + pBox->x1 * cpp,
+                         (pBox->x2 - pBox->x1) * cpp);
+        pBox++;
+    }
+
+    sync.flags = DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ;
+    drmIoctl(pPixPriv->prime_fd, DMA_BUF_IOCTL_SYNC, &sync);
+}
+
+/* What the kernel refuses more than, see drm_mode_dirtyfb_ioctl() */
+#ifndef DRM_MODE_FB_DIRTY_MAX_CLIPS
+#define DRM_MODE_FB_DIRTY_MAX_CLIPS     256
+#endif
+
+/*
+ * The damage rectangles are handed to the kernel as they are, a BoxRec
+ * is four 16 bit coordinates just like a drmModeClip and damage is
+ * clipped to the pixmap so none of them is negative.
+ */
+typedef char dirty_clip_matches_box[(sizeof(BoxRec) == sizeof(drmModeClip)) ? 1 : -1];
+
+static drmModeClip *dirty_clip_buffer(loongsonPtr lsp, unsigned int n)
+{
+    if (n > lsp->dirty_clips_size)
+    {
+        drmModeClip *pClips = reallocarray(lsp->dirty_clips, n,
+                                           sizeof(drmModeClip));
+        if (pClips == NULL)
+            return NULL;
+
+        lsp->dirty_clips = pClips;
+        lsp->dirty_clips_size = n;
+    }
+
+    return lsp->dirty_clips;
+}
+
+/*
+ * Squash nBox rectangles into at most nMax by merging runs of neighbours.
+ * Region rectangles are sorted in y-x bands, so a run covers nearby area.
+ */
+static unsigned int dirty_merge_clips(drmModeClip *pClips,
+                                      const BoxRec *pBox,
+                                      unsigned int nBox,
+                                      unsigned int nMax)
+{
+    unsigned int run = (nBox + nMax - 1) / nMax;
+    unsigned int n = 0;
+    unsigned int i;
+
+    for (i = 0; i < nBox; i += run)
+    {
+        unsigned int end = min(i + run, nBox);
+        drmModeClip *pClip = &pClips[n++];
+        unsigned int j;
+
+        pClip->x1 = pBox[i].x1;
+        pClip->y1 = pBox[i].y1;
+        pClip->x2 = pBox[i].x2;
+        pClip->y2 = pBox[i].y2;
+
+        for (j = i + 1; j < end; j++)
+        {
+            pClip->x1 = min(pClip->x1, pBox[j].x1);
+            pClip->y1 = min(pClip->y1, pBox[j].y1);
+            pClip->x2 = max(pClip->x2, pBox[j].x2);
+            pClip->y2 = max(pClip->y2, pBox[j].y2);
+        }
+    }
+
+    return n;
+}
+
 static int dispatch_dirty_region(ScrnInfoPtr pScrn,
                                  DamagePtr damage,
                                  int fb_id)
@@ -71,54 +273,75 @@ static int dispatch_dirty_region(ScrnInfoPtr pScrn,
     unsigned int nClipRects = REGION_NUM_RECTS(pDirty);
     BoxPtr pRect = REGION_RECTS(pDirty);
     int ret = 0;
+    LS_STATS_BEGIN(t);
 
-    if (nClipRects)
-    {
-        drmModeClip *pClip;
-        unsigned int i;
-
-        xf86DrvMsg(pScrn->scrnIndex, X_INFO,
-                   "%s: dispatch %u damage region to fb_id=%d\n",
-                   __func__, nClipRects, fb_id);
-
-        pClip = xallocarray(nClipRects, sizeof(drmModeClip));
-        if (pClip == NULL)
-        {
-            return -ENOMEM;
-        }
+    if (nClipRects == 0)
+        return 0;
 
-        /* XXX no need for copy? */
-        for (i = 0; i < nClipRects; ++i)
-        {
-            pClip[i].x1 = pRect->x1;
-            pClip[i].y1 = pRect->y1;
-            pClip[i].x2 = pRect->x2;
-            pClip[i].y2 = pRect->y2;
+    /*
+     * The limit belongs to the device, the fbs of the prime pixmaps and
+     * CRTCs we alternate between all share it.
+     */
+    if (lsp->dirty_max_clips == 0)
+        lsp->dirty_max_clips = DRM_MODE_FB_DIRTY_MAX_CLIPS;
 
-            ++pRect;
-        }
+    DEBUG_MSG("dispatch %u damage region to fb_id=%d", nClipRects, fb_id);
 
-        /* TODO query connector property to see if this is needed */
-        ret = drmModeDirtyFB(lsp->fd, fb_id, pClip, nClipRects);
+    for (;;)
+    {
+        drmModeClip *pClip = (drmModeClip *)pRect;
+        unsigned int nClip = nClipRects;
 
-        /* if we're swamping it with work, try one at a time */
-        if (ret == -EINVAL)
+        if (nClip > lsp->dirty_max_clips)
         {
-            for (i = 0; i < nClipRects; i++)
+            pClip = dirty_clip_buffer(lsp, lsp->dirty_max_clips);
+            if (pClip == NULL)
             {
-                ret = drmModeDirtyFB(lsp->fd, fb_id, &pClip[i], 1);
-                if (ret < 0)
-                    break;
+                ret = -ENOMEM;
+                break;
             }
+
+            nClip = dirty_merge_clips(pClip, pRect, nClipRects,
+                                      lsp->dirty_max_clips);
         }
 
-        free(pClip);
-        DamageEmpty(damage);
+        ret = drmModeDirtyFB(lsp->fd, fb_id, pClip, nClip);
+
+        if (ret == 0)
+            lsp->dirty_clips_ok = max(lsp->dirty_clips_ok, nClip);
+
+        /*
+         * The kernel's clip limit is smaller than we thought, learn it
+         * instead of splitting into one ioctl per rectangle. No more
+         * clips than were accepted before, or a single one, being
+         * refused means the failure is about something else.
+         */
+        if ((ret != -EINVAL) || (nClip <= max(lsp->dirty_clips_ok, 1)))
+            break;
+
+        lsp->dirty_max_clips = max(nClip / 2, max(lsp->dirty_clips_ok, 1));
+
+        DEBUG_MSG("%u clips refused, limit is now %u",
+                  nClip, lsp->dirty_max_clips);
     }
 
+    LS_STATS_END(LS_STAT_DIRTYFB, t,
+                 LS_StatsRegionBytes(pDirty, pScrn->bitsPerPixel / 8));
+
+    DamageEmpty(damage);
+
     return ret;
 }
 
+void LS_FreeDirtyClips(ScrnInfoPtr pScrn)
+{
+    loongsonPtr lsp = loongsonPTR(pScrn);
+
+    free(lsp->dirty_clips);
+    lsp->dirty_clips = NULL;
+    lsp->dirty_clips_size = 0;
+}
+
 /* OUTPUT SLAVE SUPPORT */
 void LS_DispatchDirty(ScreenPtr pScreen)
 {
@@ -142,41 +365,53 @@ void LS_DispatchDirty(ScreenPtr pScreen)
 }
 
 
+static void dispatch_slave_pixmap(ScrnInfoPtr pScrn,
+                                  PixmapPtr pPix,
+                                  Bool flipping)
+{
+    loongsonPtr ms = loongsonPTR(pScrn);
+    msPixmapPrivPtr ppriv = msGetPixmapPriv(&ms->drmmode, pPix);
+
+    if (!ppriv->slave_damage)
+        return;
+
+    /* Each flip presents a whole new frame, nothing to flush */
+    if (flipping)
+    {
+        DamageEmpty(ppriv->slave_damage);
+        return;
+    }
+
+    if (ppriv->prime_copy)
+        LS_CopySlaveBO(&ms->drmmode, pPix, DamageRegion(ppriv->slave_damage));
+
+    dispatch_dirty_region(pScrn, ppriv->slave_damage, ppriv->fb_id);
+}
+
 // ifdef MODESETTING_OUTPUT_SLAVE_SUPPORT
 /* OUTPUT SLAVE SUPPORT */
 void LS_DispatchSlaveDirty(ScreenPtr pScreen)
 {
     ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
-    loongsonPtr ms = loongsonPTR(pScrn);
     xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(pScrn);
     const int nCrtc = xf86_config->num_crtc;
-    msPixmapPrivPtr ppriv;
     int c;
 
     for (c = 0; c < nCrtc; ++c)
     {
         xf86CrtcPtr pCrtc = xf86_config->crtc[c];
         drmmode_crtc_private_ptr drmmode_crtc = pCrtc->driver_private;
-        PixmapPtr pPix;
 
         if (!drmmode_crtc)
             continue;
 
-        pPix = drmmode_crtc->prime_pixmap;
-        if (pPix)
-        {
-            // dispatch_dirty_pixmap(pScrn, pCrtc, drmmode_crtc->prime_pixmap);
-            ppriv = msGetPixmapPriv(&ms->drmmode, pPix);
-            dispatch_dirty_region(pScrn, ppriv->slave_damage, ppriv->fb_id);
-        }
+        if (drmmode_crtc->prime_pixmap)
+            dispatch_slave_pixmap(pScrn, drmmode_crtc->prime_pixmap,
+                                  drmmode_crtc->flipping_active);
 
-        pPix = drmmode_crtc->prime_pixmap_back;
-        if (pPix)
-        {
-            // dispatch_dirty_pixmap(pScrn, pCrtc, drmmode_crtc->prime_pixmap_back);
-            ppriv = msGetPixmapPriv(&ms->drmmode, pPix);
-            dispatch_dirty_region(pScrn, ppriv->slave_damage, ppriv->fb_id);
-        }
+        if (drmmode_crtc->prime_pixmap_back)
+            dispatch_slave_pixmap(pScrn, drmmode_crtc->prime_pixmap_back,
+                                  drmmode_crtc->flipping_active);
     }
 }
 
@@ -259,11 +494,8 @@ Bool LS_SetSharedPixmapBacking(PixmapPtr pPix, void *fd_handle)
     /* suijingfeng: pass -1 means unshare slave pixmap */
     if (ihandle == -1)
     {
-           msPixmapPrivPtr pPixPriv = msGetPixmapPriv(pDrmMode, pPix);
-
-           dumb_bo_destroy(pDrmMode->fd, pPixPriv->backing_bo);
-           pPixPriv->backing_bo = NULL;
-           return TRUE;
+        LS_ReleaseSlaveBO(pPix, pDrmMode);
+        return TRUE;
     }
 
     ret = SetSlaveBO(pPix, ihandle, pPix->devKind, size, pDrmMode);
@@ -38,5 +38,7 @@ Bool LS_SharePixmapBacking(PixmapPtr pPix, ScreenPtr slave, void **handle);
 Bool LS_SetSharedPixmapBacking(PixmapPtr pPix, void *fd_handle);
 void LS_DispatchSlaveDirty(ScreenPtr pScreen);
 void LS_DispatchDirty(ScreenPtr pScreen);
+void LS_FreeDirtyClips(ScrnInfoPtr pScrn);
+void LS_CopySlaveBO(drmmode_ptr drmmode, PixmapPtr ppix, RegionPtr pRegion);
 
 #endif
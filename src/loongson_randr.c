@@ -126,7 +126,14 @@ static Bool drmmode_set_target_scanout_pixmap_cpu(xf86CrtcPtr crtc,
                                            crtc->randr_crtc->pScreen,
                                            NULL);
     }
-    ptr = drmmode_map_slave_bo(drmmode, ppriv);
+    /*
+     * A copied pixmap's content lives in the dma-buf, not the local bo,
+     * as long as the mapping takes the sink's own rendering as well.
+     */
+    if (ppriv->prime_copy && ppriv->prime_map_rw)
+        ptr = ppriv->prime_map;
+    else
+        ptr = drmmode_map_slave_bo(drmmode, ppriv);
     ppix->devPrivate.ptr = ptr;
     DamageRegister(&ppix->drawable, ppriv->slave_damage);
 
@@ -137,7 +144,7 @@ static Bool drmmode_set_target_scanout_pixmap_cpu(xf86CrtcPtr crtc,
                      ppix->drawable.height,
                      ppix->drawable.depth,
                      ppix->drawable.bitsPerPixel,
-                     ppix->devKind,
+                     dumb_bo_pitch(ppriv->backing_bo),
                      dumb_bo_handle(ppriv->backing_bo),
                      &ppriv->fb_id);
     }
@@ -172,13 +179,15 @@ static Bool LS_EnableSharedPixmapFlipping(RRCrtcPtr crtc,
     loongsonPtr lsp = loongsonPTR(pScrn);
     struct drmmode_rec * const pDrmMode = &lsp->drmmode;
     xf86CrtcPtr xf86Crtc = crtc->devPrivate;
-    drmmode_crtc_private_ptr drmmode_crtc = xf86Crtc->driver_private;
+    drmmode_crtc_private_ptr drmmode_crtc;
 
     if (!xf86Crtc)
         return FALSE;
 
+    drmmode_crtc = xf86Crtc->driver_private;
+
     /* Not supported if we can't flip */
-    if (pDrmMode->pageflip)
+    if (!pDrmMode->pageflip)
     {
         xf86DrvMsg(pScrn->scrnIndex, X_INFO,
                    "Not supported because of we can't flip\n");
@@ -229,6 +238,7 @@ void drmmode_FiniSharedPixmapFlipping(xf86CrtcPtr crtc, drmmode_ptr drmmode)
         seq = pPrivPixmap->flip_seq;
         if (seq)
             ms_drm_abort_seq(crtc->scrn, seq);
+        drmmode_SharedPixmapCancelFenceWait(drmmode_crtc->prime_pixmap, drmmode);
     }
 
 
@@ -241,6 +251,8 @@ void drmmode_FiniSharedPixmapFlipping(xf86CrtcPtr crtc, drmmode_ptr drmmode)
         seq = pPrivPixmap->flip_seq;
         if (seq)
             ms_drm_abort_seq(crtc->scrn, seq);
+        drmmode_SharedPixmapCancelFenceWait(drmmode_crtc->prime_pixmap_back,
+                                            drmmode);
     }
 }
 
@@ -29,6 +29,9 @@
 #endif
 
 #include <xf86drm.h>
+#include <fb.h>
+#include <picturestr.h>
+
 #include "driver.h"
 #include "drmmode_display.h"
 #include "loongson_scanout.h"
@@ -36,6 +39,7 @@
 #include "loongson_shadow.h"
 #include "loongson_damage.h"
 #include "loongson_rotation.h"
+#include "loongson_blt.h"
 
 void *loongson_rotation_allocate_shadow(xf86CrtcPtr crtc,
                                         int width,
@@ -134,3 +138,200 @@ void loongson_rotation_destroy(xf86CrtcPtr crtc,
 
     pDrmMode->shadow_present = FALSE;
 }
+
+/* -1, 0 or 1 for a matrix entry that is one of those, 2 otherwise */
+static int loongson_rotation_unit(pixman_fixed_t v)
+{
+    if (v == 0)
+        return 0;
+    if (v == pixman_fixed_1)
+        return 1;
+    if (v == -pixman_fixed_1)
+        return -1;
+    return 2;
+}
+
+/* Only the shadows of this screen's rotated crtcs are worth looking at */
+static Bool loongson_rotation_is_shadow(ScrnInfoPtr pScrn,
+                                        DrawablePtr pDraw)
+{
+    xf86CrtcConfigPtr config = XF86_CRTC_CONFIG_PTR(pScrn);
+    int i;
+
+    if (pDraw->type != DRAWABLE_PIXMAP)
+        return FALSE;
+
+    for (i = 0; i < config->num_crtc; i++)
+    {
+        if (config->crtc[i]->rotatedPixmap == (PixmapPtr)pDraw)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/*
+ * The rotated shadow is refreshed by the server compositing the damaged
+ * boxes of the screen through the crtc transform, see xf86RotateRedisplay.
+ * For 90/180/270 degrees and the reflections that transform only moves
+ * whole pixels, so copy them with loongson_rotate_blt() instead of going
+ * through pixman's generic transformed fetch.
+ */
+static Bool loongson_rotation_blit(CARD8 op,
+                                   PicturePtr pSrc,
+                                   PicturePtr pMask,
+                                   PicturePtr pDst,
+                                   INT16 xSrc, INT16 ySrc,
+                                   INT16 xDst, INT16 yDst,
+                                   CARD16 width, CARD16 height)
+{
+    PictTransformPtr t = pSrc->transform;
+    DrawablePtr pSrcDraw = pSrc->pDrawable;
+    DrawablePtr pDstDraw = pDst->pDrawable;
+    FbBits *src_bits, *dst_bits;
+    FbStride src_stride, dst_stride;
+    int src_bpp, dst_bpp;
+    int src_xoff, src_yoff, dst_xoff, dst_yoff;
+    int a, b, c, d, sx, sy, cpp;
+    long src_pitch, dst_pitch;
+    uint8_t *dst;
+    const uint8_t *src;
+
+    if ((op != PictOpSrc) || pMask || !t || !pSrcDraw || !pDstDraw)
+        return FALSE;
+
+    if ((pSrc->format != pDst->format) || pSrc->alphaMap || pDst->alphaMap ||
+        pSrc->repeat || (pSrc->filter == PictFilterConvolution))
+        return FALSE;
+
+    /* The blit honours neither picture's clip */
+    if (pSrc->clientClip || pDst->clientClip)
+        return FALSE;
+
+    if (!loongson_rotation_is_shadow(xf86ScreenToScrn(pDstDraw->pScreen),
+                                     pDstDraw))
+        return FALSE;
+
+    /* Only the root window is unclipped by its children */
+    if ((pSrcDraw->type == DRAWABLE_WINDOW) && ((WindowPtr)pSrcDraw)->parent)
+        return FALSE;
+
+    if ((pDstDraw->bitsPerPixel != 16) && (pDstDraw->bitsPerPixel != 32))
+        return FALSE;
+
+    if (t->matrix[2][0] || t->matrix[2][1] ||
+        (t->matrix[2][2] != pixman_fixed_1) ||
+        pixman_fixed_frac(t->matrix[0][2]) ||
+        pixman_fixed_frac(t->matrix[1][2]))
+        return FALSE;
+
+    a = loongson_rotation_unit(t->matrix[0][0]);
+    b = loongson_rotation_unit(t->matrix[0][1]);
+    c = loongson_rotation_unit(t->matrix[1][0]);
+    d = loongson_rotation_unit(t->matrix[1][1]);
+
+    /* Exactly one +-1 in each row and column, and not the identity */
+    if ((a == 2) || (b == 2) || (c == 2) || (d == 2))
+        return FALSE;
+    if (((a == 0) == (b == 0)) || ((a == 0) == (c == 0)) ||
+        ((c == 0) == (d == 0)))
+        return FALSE;
+    if ((a == 1) && (d == 1))
+        return FALSE;
+
+    /*
+     * The source pixel of destination (i, j) is the one holding the
+     * transformed pixel center, as a and b are +-1 and 0 that is
+     * a * i + b * j plus the offsets below.
+     */
+    sx = a * xSrc + b * ySrc + pixman_fixed_to_int(t->matrix[0][2]) +
+         (a + b - 1) / 2;
+    sy = c * xSrc + d * ySrc + pixman_fixed_to_int(t->matrix[1][2]) +
+         (c + d - 1) / 2;
+
+    /* Anything sampled outside of the source needs RepeatNone's zeros */
+    if ((sx + min(0, a * (width - 1)) + min(0, b * (height - 1)) < 0) ||
+        (sx + max(0, a * (width - 1)) + max(0, b * (height - 1)) >= pSrcDraw->width) ||
+        (sy + min(0, c * (width - 1)) + min(0, d * (height - 1)) < 0) ||
+        (sy + max(0, c * (width - 1)) + max(0, d * (height - 1)) >= pSrcDraw->height))
+        return FALSE;
+
+    if ((xDst < 0) || (yDst < 0) ||
+        (xDst + width > pDstDraw->width) || (yDst + height > pDstDraw->height))
+        return FALSE;
+
+    fbGetDrawable(pSrcDraw, src_bits, src_stride, src_bpp, src_xoff, src_yoff);
+    fbGetDrawable(pDstDraw, dst_bits, dst_stride, dst_bpp, dst_xoff, dst_yoff);
+
+    if (!src_bits || !dst_bits || (src_bpp != dst_bpp))
+        return FALSE;
+
+    cpp = dst_bpp / 8;
+    src_pitch = src_stride * sizeof(FbBits);
+    dst_pitch = dst_stride * sizeof(FbBits);
+
+    src = (const uint8_t *)src_bits +
+          (sy + pSrcDraw->y + src_yoff) * src_pitch +
+          (sx + pSrcDraw->x + src_xoff) * cpp;
+    dst = (uint8_t *)dst_bits +
+          (yDst + pDstDraw->y + dst_yoff) * dst_pitch +
+          (xDst + pDstDraw->x + dst_xoff) * cpp;
+
+    loongson_rotate_blt(dst, dst_pitch, src,
+                        a * cpp + c * src_pitch,
+                        b * cpp + d * src_pitch,
+                        width, height, cpp);
+
+    return TRUE;
+}
+
+static void loongson_rotation_composite(CARD8 op,
+                                        PicturePtr pSrc,
+                                        PicturePtr pMask,
+                                        PicturePtr pDst,
+                                        INT16 xSrc, INT16 ySrc,
+                                        INT16 xMask, INT16 yMask,
+                                        INT16 xDst, INT16 yDst,
+                                        CARD16 width, CARD16 height)
+{
+    ScreenPtr pScreen = pDst->pDrawable->pScreen;
+    PictureScreenPtr ps = GetPictureScreen(pScreen);
+    loongsonPtr lsp = loongsonPTR(xf86ScreenToScrn(pScreen));
+
+    if (loongson_rotation_blit(op, pSrc, pMask, pDst,
+                               xSrc, ySrc, xDst, yDst, width, height))
+        return;
+
+    ps->Composite = lsp->Composite;
+    ps->Composite(op, pSrc, pMask, pDst, xSrc, ySrc,
+                  xMask, yMask, xDst, yDst, width, height);
+    ps->Composite = loongson_rotation_composite;
+}
+
+/*
+ * Wrap Composite below EXA, so that its software fallback reaches us with
+ * the pixmaps mapped for CPU access.
+ */
+void loongson_rotation_screen_init(ScreenPtr pScreen)
+{
+    PictureScreenPtr ps = GetPictureScreenIfSet(pScreen);
+    loongsonPtr lsp = loongsonPTR(xf86ScreenToScrn(pScreen));
+
+    if (!ps)
+        return;
+
+    lsp->Composite = ps->Composite;
+    ps->Composite = loongson_rotation_composite;
+}
+
+void loongson_rotation_close_screen(ScreenPtr pScreen)
+{
+    PictureScreenPtr ps = GetPictureScreenIfSet(pScreen);
+    loongsonPtr lsp = loongsonPTR(xf86ScreenToScrn(pScreen));
+
+    if (!ps || !lsp->Composite)
+        return;
+
+    ps->Composite = lsp->Composite;
+    lsp->Composite = NULL;
+}
@@ -47,4 +47,8 @@ void loongson_rotation_destroy(xf86CrtcPtr crtc,
                                PixmapPtr rotate_pixmap,
                                void *data);
 
+void loongson_rotation_screen_init(ScreenPtr pScreen);
+
+void loongson_rotation_close_screen(ScreenPtr pScreen);
+
 #endif
@@ -31,12 +31,14 @@
 #include <errno.h>
 #include <unistd.h>
 #include <malloc.h>
+#include <pthread.h>
 
 #include "dumb_bo.h"
 #include "driver.h"
 #include "loongson_scanout.h"
 #include "loongson_pixmap.h"
 #include "loongson_glamor.h"
+#include "loongson_debug.h"
 
 #ifdef HAVE_LIBDRM_GSGPU
 #include <gsgpu_drm.h>
@@ -137,6 +139,83 @@ void *LS_MapFrontBO(ScrnInfoPtr pScrn,
 }
 
 
+struct ls_front_map {
+    pthread_t thread;
+    int drm_fd;
+    struct dumb_bo *dumb;
+    int ret;
+};
+
+static void *ls_front_map_thread(void *data)
+{
+    struct ls_front_map *pMap = data;
+
+    pMap->ret = dumb_bo_map_populate(pMap->drm_fd, pMap->dumb);
+
+    return NULL;
+}
+
+/*
+ * Start mapping the front bo on a helper thread. Faulting in a whole
+ * framebuffer takes a while, let it overlap with the initial modeset.
+ * LS_MapFrontBOFinish() collects the result, it maps synchronously if
+ * the thread could not be started.
+ */
+void LS_MapFrontBOAsync(ScrnInfoPtr pScrn,
+                        int drm_fd,
+                        struct DrmModeBO *pFrontBO)
+{
+    loongsonPtr lsp = loongsonPTR(pScrn);
+    struct drmmode_rec * const pDrmMode = &lsp->drmmode;
+    struct ls_front_map *pMap;
+
+    if (!pFrontBO->dumb || pDrmMode->front_map)
+        return;
+
+    pMap = calloc(1, sizeof(*pMap));
+    if (!pMap)
+        return;
+
+    pMap->drm_fd = drm_fd;
+    pMap->dumb = pFrontBO->dumb;
+
+    if (pthread_create(&pMap->thread, NULL, ls_front_map_thread, pMap))
+    {
+        free(pMap);
+        return;
+    }
+
+    pDrmMode->front_map = pMap;
+}
+
+void *LS_MapFrontBOFinish(ScrnInfoPtr pScrn,
+                          int drm_fd,
+                          struct DrmModeBO *pFrontBO)
+{
+    loongsonPtr lsp = loongsonPTR(pScrn);
+    struct drmmode_rec * const pDrmMode = &lsp->drmmode;
+    struct ls_front_map *pMap = pDrmMode->front_map;
+    int ret;
+
+    if (!pMap)
+        return LS_MapFrontBO(pScrn, drm_fd, pFrontBO);
+
+    pthread_join(pMap->thread, NULL);
+    ret = pMap->ret;
+
+    free(pMap);
+    pDrmMode->front_map = NULL;
+
+    if (ret)
+    {
+        xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+                   "%s: Failed map front BO: %d.\n", __func__, ret);
+        return NULL;
+    }
+
+    return dumb_bo_cpu_addr(pFrontBO->dumb);
+}
+
 /*
  * Return TRUE if success
  */
@@ -383,12 +462,12 @@ int drmmode_bo_import(drmmode_ptr drmmode, drmmode_bo *bo, uint32_t *fb_id)
     kms_handle = drmmode_bo_get_handle(bo);
     pitch = drmmode_bo_get_pitch(bo);
 
+    /* This runs for every flip of a dumb bo, keep it out of the log */
     if (bo->dumb)
     {
-        xf86DrvMsg(pScrn->scrnIndex, X_INFO,
-                   "%s: Add DUMB BO(handle=%u): %dx%d, pitch:%u cpu addr: %p\n",
-                   __func__, kms_handle, bo->width, bo->height, pitch,
-                   dumb_bo_cpu_addr(bo->dumb));
+        DEBUG_MSG("Add DUMB BO(handle=%u): %dx%d, pitch:%u cpu addr: %p",
+                  kms_handle, bo->width, bo->height, pitch,
+                  dumb_bo_cpu_addr(bo->dumb));
     }
 
     return drmModeAddFB(drmmode->fd, bo->width, bo->height,
@@ -39,6 +39,14 @@ void *LS_MapFrontBO(ScrnInfoPtr pScrn,
                     int drm_fd,
                     struct DrmModeBO *pFrontBO);
 
+void LS_MapFrontBOAsync(ScrnInfoPtr pScrn,
+                        int drm_fd,
+                        struct DrmModeBO *pFrontBO);
+
+void *LS_MapFrontBOFinish(ScrnInfoPtr pScrn,
+                          int drm_fd,
+                          struct DrmModeBO *pFrontBO);
+
 void LS_FreeFrontBO(ScrnInfoPtr pScrn,
                     int drm_fd,
                     uint32_t fb_id,
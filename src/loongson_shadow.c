@@ -36,6 +36,11 @@
 #include "loongson_shadow.h"
 #include "loongson_blt.h"
 #include "driver.h"
+#include "dumb_bo.h"
+#include "vblank.h"
+#include "loongson_scanout.h"
+#include "loongson_stats.h"
+#include "loongson_usdt.h"
 
 Bool LS_ShadowAllocFB(ScrnInfoPtr pScrn,
                       int width,
@@ -94,6 +99,15 @@ void LS_TryEnableShadow(ScrnInfoPtr pScrn)
                "ShadowFB: preferred %s, enabled %s\n",
                prefer_shadow ? "YES" : "NO",
                pDrmMode->shadow_enable ? "YES" : "NO");
+
+    /* The flipped shadow only has a 32 bpp copy path */
+    pDrmMode->shadow_flip_enable = pDrmMode->shadow_enable &&
+        (pScrn->bitsPerPixel == 32) &&
+        xf86ReturnOptValBool(pDrmMode->Options, OPTION_SHADOW_PAGEFLIP, FALSE);
+
+    if (pDrmMode->shadow_flip_enable)
+        xf86DrvMsg(pScrn->scrnIndex, X_CONFIG,
+                   "ShadowFB: page flipping enabled\n");
 }
 
 
@@ -117,20 +131,16 @@ void *LS_ShadowWindow(ScreenPtr pScreen,
     return (base + row * stride + offset);
 }
 
-static void loongson_damage_update_u32(ScreenPtr pScreen,
-                                       PixmapPtr pShadow,
-                                       RegionPtr damage)
+static void ls_shadow_copy_u32(struct dumb_bo *pDstBO,
+                               const uint8_t *shaBase,
+                               uint32_t src_stride,
+                               RegionPtr damage)
 {
-    ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
-    loongsonPtr lsp = loongsonPTR(pScrn);
-    struct drmmode_rec * const pDrmMode = &lsp->drmmode;
-    struct dumb_bo *pFB = pDrmMode->front_bo->dumb;
-    uint8_t *winBase = (uint8_t *) dumb_bo_cpu_addr(pFB);
-    uint8_t *shaBase = (uint8_t *) pDrmMode->shadow_fb;
-    uint32_t dst_stride = dumb_bo_pitch(pFB);
-    uint32_t src_stride = pShadow->devKind;
+    uint8_t *winBase = (uint8_t *) dumb_bo_cpu_addr(pDstBO);
+    uint32_t dst_stride = dumb_bo_pitch(pDstBO);
     int nbox = RegionNumRects(damage);
     BoxPtr pbox = RegionRects(damage);
+    LS_STATS_BEGIN(t);
 
     while (nbox--)
     {
@@ -138,7 +148,7 @@ static void loongson_damage_update_u32(ScreenPtr pScreen,
         int y = pbox->y1;
         int w = pbox->x2 - pbox->x1;
         int h = pbox->y2 - pbox->y1;
-        uint8_t *pSrc = shaBase + y * src_stride + x * 4;
+        const uint8_t *pSrc = shaBase + y * src_stride + x * 4;
         uint8_t *pDst = winBase + y * dst_stride + x * 4;
         int len = w * 4;
 
@@ -150,6 +160,280 @@ static void loongson_damage_update_u32(ScreenPtr pScreen,
         }
         pbox++;
     }
+
+    LS_STATS_END(LS_STAT_SHADOW_FLUSH, t, LS_StatsRegionBytes(damage, 4));
+}
+
+static void loongson_damage_update_u32(ScreenPtr pScreen,
+                                       PixmapPtr pShadow,
+                                       RegionPtr damage)
+{
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+    loongsonPtr lsp = loongsonPTR(pScrn);
+    struct drmmode_rec * const pDrmMode = &lsp->drmmode;
+
+    ls_shadow_copy_u32(pDrmMode->front_bo->dumb,
+                       pDrmMode->shadow_fb,
+                       pShadow->devKind,
+                       damage);
+}
+
+/*
+ * Option "ShadowPageFlip"
+ *
+ * Instead of writing into the bo being scanned out, the damage is copied
+ * into the other one of two scanout bos, which is flipped to at vblank.
+ * The copy no longer has to beat the beam, and is off the critical path
+ * as it only waits for the previous flip. The bo we copy into was last
+ * filled two frames ago, so it gets the damage of both frames.
+ */
+
+static void ls_shadow_flip_fini(ScreenPtr pScreen)
+{
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+    loongsonPtr lsp = loongsonPTR(pScrn);
+    struct drmmode_shadow_flip * const pFlip = &lsp->drmmode.shadow_flip;
+    int i;
+
+    for (i = 0; i < 2; i++)
+    {
+        if (pFlip->pixmap[i])
+        {
+            pScreen->DestroyPixmap(pFlip->pixmap[i]);
+            pFlip->pixmap[i] = NULL;
+        }
+    }
+
+    /* bo[0] is the front bo and freed together with it */
+    if (pFlip->bo[1])
+    {
+        LS_FreeFrontBO(pScrn, lsp->fd, 0, pFlip->bo[1]);
+        pFlip->bo[1] = NULL;
+    }
+    pFlip->bo[0] = NULL;
+
+    RegionUninit(&pFlip->prev_damage);
+    RegionUninit(&pFlip->pending_damage);
+}
+
+static Bool ls_shadow_flip_setup(ScreenPtr pScreen)
+{
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+    loongsonPtr lsp = loongsonPTR(pScrn);
+    struct drmmode_rec * const pDrmMode = &lsp->drmmode;
+    struct drmmode_shadow_flip * const pFlip = &pDrmMode->shadow_flip;
+    struct DrmModeBO *pFront = pDrmMode->front_bo;
+    BoxRec box;
+    int i;
+
+    pFlip->bo[0] = pFront;
+    pFlip->bo[1] = LS_CreateFrontBO(pScrn, lsp->fd,
+                                    pFront->width, pFront->height,
+                                    pDrmMode->kbpp);
+    RegionNull(&pFlip->prev_damage);
+    RegionNull(&pFlip->pending_damage);
+
+    if (!pFlip->bo[1] || !LS_MapFrontBO(pScrn, lsp->fd, pFlip->bo[1]))
+        goto fail;
+
+    for (i = 0; i < 2; i++)
+    {
+        struct dumb_bo *dumb = pFlip->bo[i]->dumb;
+
+        pFlip->pixmap[i] = pScreen->CreatePixmap(pScreen, 0, 0,
+                                                 pScrn->depth, 0);
+        if (!pFlip->pixmap[i])
+            goto fail;
+
+        if (!pScreen->ModifyPixmapHeader(pFlip->pixmap[i],
+                                         pFront->width, pFront->height,
+                                         pScrn->depth, pDrmMode->kbpp,
+                                         dumb_bo_pitch(dumb),
+                                         dumb_bo_cpu_addr(dumb)))
+            goto fail;
+    }
+
+    /* The new bo starts out blank */
+    box.x1 = 0;
+    box.y1 = 0;
+    box.x2 = pFront->width;
+    box.y2 = pFront->height;
+    RegionReset(&pFlip->prev_damage, &box);
+
+    pFlip->scanout = 0;
+    pFlip->pending = FALSE;
+
+    xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+               "Shadow: page flipping between two %dx%d scanout bos\n",
+               pFront->width, pFront->height);
+
+    return TRUE;
+
+fail:
+    xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+               "Shadow: can't set up the second scanout bo, "
+               "not page flipping\n");
+    ls_shadow_flip_fini(pScreen);
+    return FALSE;
+}
+
+/* Rotated crtcs scan out their own bo, flipping fb_id would undo that */
+static Bool ls_shadow_flip_possible(ScrnInfoPtr pScrn)
+{
+    xf86CrtcConfigPtr config = XF86_CRTC_CONFIG_PTR(pScrn);
+    struct drmmode_rec * const pDrmMode = &loongsonPTR(pScrn)->drmmode;
+    int num_crtcs_on = 0;
+    int i;
+
+    if (!pScrn->vtSema)
+        return FALSE;
+
+    /* A client flipping its own buffers owns the scanout for now */
+    if (!pDrmMode->pageflip || pDrmMode->present_flipping ||
+        pDrmMode->dri2_flipping)
+        return FALSE;
+
+    for (i = 0; i < config->num_crtc; i++)
+    {
+        xf86CrtcPtr crtc = config->crtc[i];
+        drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+
+        if (drmmode_crtc->rotate_bo)
+            return FALSE;
+
+        if (ls_is_crtc_on(crtc))
+            num_crtcs_on++;
+    }
+
+    return num_crtcs_on > 0;
+}
+
+static void ls_shadow_flip_commit(ScreenPtr pScreen);
+
+static void ls_shadow_flip_handler(loongsonPtr lsp,
+                                   uint64_t msc,
+                                   uint64_t ust,
+                                   void *data)
+{
+    ScreenPtr pScreen = data;
+    struct drmmode_shadow_flip * const pFlip = &lsp->drmmode.shadow_flip;
+
+    pFlip->pending = FALSE;
+
+    /* Whatever came in while this flip was in flight */
+    if (RegionNotEmpty(&pFlip->pending_damage))
+        ls_shadow_flip_commit(pScreen);
+}
+
+static void ls_shadow_flip_abort(loongsonPtr lsp, void *data)
+{
+    lsp->drmmode.shadow_flip.pending = FALSE;
+}
+
+static void ls_shadow_flip_commit(ScreenPtr pScreen)
+{
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+    loongsonPtr lsp = loongsonPTR(pScrn);
+    struct drmmode_rec * const pDrmMode = &lsp->drmmode;
+    struct drmmode_shadow_flip * const pFlip = &pDrmMode->shadow_flip;
+    PixmapPtr pShadow = pScreen->GetScreenPixmap(pScreen);
+    int back = !pFlip->scanout;
+    RegionRec region;
+
+    if (!ls_shadow_flip_possible(pScrn))
+    {
+        /* Update the bo on screen directly, the other one lags more */
+        ls_shadow_copy_u32(pFlip->bo[pFlip->scanout]->dumb,
+                           pDrmMode->shadow_fb, pShadow->devKind,
+                           &pFlip->pending_damage);
+        RegionUnion(&pFlip->prev_damage,
+                    &pFlip->prev_damage, &pFlip->pending_damage);
+        RegionEmpty(&pFlip->pending_damage);
+        return;
+    }
+
+    RegionNull(&region);
+    RegionUnion(&region, &pFlip->pending_damage, &pFlip->prev_damage);
+    ls_shadow_copy_u32(pFlip->bo[back]->dumb,
+                       pDrmMode->shadow_fb, pShadow->devKind, &region);
+    RegionUninit(&region);
+
+    if (ms_do_pageflip(pScreen, pFlip->pixmap[back], pScreen, -1, FALSE,
+                       ls_shadow_flip_handler,
+                       ls_shadow_flip_abort,
+                       "Shadow-flip", LS_STATS_NOW_US(), 0))
+    {
+        pFlip->pending = TRUE;
+        pFlip->scanout = back;
+        /* The bo we just left misses exactly this frame */
+        RegionCopy(&pFlip->prev_damage, &pFlip->pending_damage);
+    }
+    else
+    {
+        /* Bring the bo on screen up to date too, then both are */
+        ls_shadow_copy_u32(pFlip->bo[pFlip->scanout]->dumb,
+                           pDrmMode->shadow_fb, pShadow->devKind,
+                           &pFlip->pending_damage);
+        RegionEmpty(&pFlip->prev_damage);
+    }
+
+    RegionEmpty(&pFlip->pending_damage);
+}
+
+static void ls_shadow_flip_update(ScreenPtr pScreen, RegionPtr damage)
+{
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+    loongsonPtr lsp = loongsonPTR(pScrn);
+    struct drmmode_rec * const pDrmMode = &lsp->drmmode;
+    struct drmmode_shadow_flip * const pFlip = &pDrmMode->shadow_flip;
+
+    /* First frame, or the front bo got replaced by a resize */
+    if (pFlip->bo[0] != pDrmMode->front_bo)
+    {
+        if (pFlip->bo[0])
+            ls_shadow_flip_fini(pScreen);
+
+        if (!ls_shadow_flip_setup(pScreen))
+        {
+            pDrmMode->shadow_flip_enable = FALSE;
+            loongson_damage_update_u32(pScreen,
+                                       pScreen->GetScreenPixmap(pScreen),
+                                       damage);
+            return;
+        }
+    }
+
+    RegionUnion(&pFlip->pending_damage, &pFlip->pending_damage, damage);
+
+    /* The flip handler picks it up */
+    if (pFlip->pending)
+        return;
+
+    ls_shadow_flip_commit(pScreen);
+}
+
+void LS_ShadowFlipFini(ScreenPtr pScreen)
+{
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+    loongsonPtr lsp = loongsonPTR(pScrn);
+
+    if (lsp->drmmode.shadow_flip.bo[0])
+        ls_shadow_flip_fini(pScreen);
+}
+
+struct dumb_bo *LS_ShadowFlipGetBO(ScrnInfoPtr pScrn, PixmapPtr pPixmap)
+{
+    loongsonPtr lsp = loongsonPTR(pScrn);
+    struct drmmode_shadow_flip * const pFlip = &lsp->drmmode.shadow_flip;
+    int i;
+
+    for (i = 0; i < 2; i++)
+    {
+        if (pFlip->pixmap[i] && (pFlip->pixmap[i] == pPixmap))
+            return pFlip->bo[i]->dumb;
+    }
+
+    return NULL;
 }
 
 void LS_ShadowUpdatePacked(ScreenPtr pScreen,
@@ -161,6 +445,12 @@ void LS_ShadowUpdatePacked(ScreenPtr pScreen,
 
     if (pScrn->bitsPerPixel == 32)
     {
+        if (lsp->drmmode.shadow_flip_enable)
+        {
+            ls_shadow_flip_update(pScreen, DamageRegion(pSdwBuf->pDamage));
+            return;
+        }
+
         loongson_damage_update_u32(pScreen,
                                    pSdwBuf->pPixmap,
                                    DamageRegion(pSdwBuf->pDamage));
@@ -179,11 +469,19 @@ void loongson_dispatch_dirty(ScreenPtr pScreen)
     RegionPtr pRegion;
 
     pRegion = DamageRegion(lsp->damage);
+
+    LS_PROBE2(dispatch_dirty_entry, RegionNumRects(pRegion),
+              (pRegion->extents.x2 - pRegion->extents.x1) *
+              (pRegion->extents.y2 - pRegion->extents.y1) *
+              (pPixmap->drawable.bitsPerPixel / 8));
+
     if (RegionNotEmpty(pRegion))
     {
         loongson_damage_update_u32(pScreen, pPixmap, pRegion);
         DamageEmpty(lsp->damage);
     }
+
+    LS_PROBE(dispatch_dirty_return);
 }
 
 Bool LS_ShadowLoadAPI(ScrnInfoPtr pScrn)
@@ -48,4 +48,8 @@ void *LS_ShadowWindow(ScreenPtr pScreen, CARD32 row, CARD32 offset,
 void LS_ShadowUpdatePacked(ScreenPtr pScreen, shadowBufPtr pBuf);
 
 void loongson_dispatch_dirty(ScreenPtr pScreen);
+
+void LS_ShadowFlipFini(ScreenPtr pScreen);
+
+struct dumb_bo *LS_ShadowFlipGetBO(ScrnInfoPtr pScrn, PixmapPtr pPixmap);
 #endif
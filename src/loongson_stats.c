@@ -0,0 +1,366 @@
+/*
+ * Copyright (C) 2026 Loongson Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef LOONGSON_STATS
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <X11/Xatom.h>
+#include <xf86.h>
+#include <os.h>
+#include <property.h>
+
+#include "driver.h"
+#include "loongson_stats.h"
+
+/* Indexed by vblank pipe */
+#define LS_STATS_MAX_CRTC        8
+/* log2 buckets of microseconds, the last one is open ended */
+#define LS_STATS_HIST_BUCKETS    24
+
+struct ls_frame_stats
+{
+    uint64_t hist[LS_FRAME_HIST_NUM][LS_STATS_HIST_BUCKETS];
+    uint64_t events;
+    uint64_t missed;
+};
+
+struct ls_screen_stats
+{
+    struct ls_frame_stats frame[LS_STATS_MAX_CRTC];
+    /* Last dump request this screen answered */
+    sig_atomic_t dumped;
+};
+
+__thread struct ls_stats_block *ls_stats_local;
+
+static struct ls_stats_block *ls_stats_blocks;
+static pthread_mutex_t ls_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Bumped by each SIGUSR2, every screen dumps once per request */
+static volatile sig_atomic_t ls_stats_dump_requested;
+static Bool ls_stats_signal_installed;
+
+static const char * const ls_stat_names[LS_STAT_NUM] =
+{
+    [LS_STAT_SHADOW_FLUSH] = "shadow flush",
+    [LS_STAT_RESOLVE]      = "resolve",
+    [LS_STAT_SOLID]        = "solid",
+    [LS_STAT_COPY]         = "copy",
+    [LS_STAT_COMPOSITE]    = "composite",
+    [LS_STAT_UPLOAD]       = "upload",
+    [LS_STAT_DOWNLOAD]     = "download",
+    [LS_STAT_PAGEFLIP]     = "page flip",
+    [LS_STAT_DIRTYFB]      = "DirtyFB",
+    [LS_STAT_DRI2_IMPORT]  = "DRI2 buffer",
+    [LS_STAT_DRI3_IMPORT]  = "DRI3 import",
+};
+
+/*
+ * The blocks are never freed, a thread that goes away leaves its
+ * counts behind for the totals. The server only has a handful.
+ */
+struct ls_stats_block *LS_StatsRegisterThread(void)
+{
+    struct ls_stats_block *pBlock = calloc(1, sizeof(*pBlock));
+
+    if (!pBlock)
+        return NULL;
+
+    pthread_mutex_lock(&ls_stats_lock);
+    pBlock->next = ls_stats_blocks;
+    ls_stats_blocks = pBlock;
+    pthread_mutex_unlock(&ls_stats_lock);
+
+    ls_stats_local = pBlock;
+
+    return pBlock;
+}
+
+static void LS_StatsSum(struct ls_stat *pTotal)
+{
+    struct ls_stats_block *pBlock;
+    int i;
+
+    memset(pTotal, 0, sizeof(struct ls_stat) * LS_STAT_NUM);
+
+    /* Other threads keep counting, a slightly stale sum is fine */
+    pthread_mutex_lock(&ls_stats_lock);
+    for (pBlock = ls_stats_blocks; pBlock; pBlock = pBlock->next)
+    {
+        for (i = 0; i < LS_STAT_NUM; ++i)
+        {
+            pTotal[i].count += pBlock->stat[i].count;
+            pTotal[i].bytes += pBlock->stat[i].bytes;
+            pTotal[i].ns += pBlock->stat[i].ns;
+        }
+    }
+    pthread_mutex_unlock(&ls_stats_lock);
+}
+
+/* Only the main thread handles DRM events, no need for per-thread copies */
+static struct ls_frame_stats *LS_StatsCrtc(xf86CrtcPtr crtc)
+{
+    drmmode_crtc_private_ptr drmmode_crtc;
+    loongsonPtr lsp;
+
+    if (!crtc)
+        return NULL;
+
+    lsp = loongsonPTR(crtc->scrn);
+    drmmode_crtc = crtc->driver_private;
+    if (!lsp->stats || (drmmode_crtc->vblank_pipe >= LS_STATS_MAX_CRTC))
+        return NULL;
+
+    return &lsp->stats->frame[drmmode_crtc->vblank_pipe];
+}
+
+static void LS_StatsHistAdd(uint64_t *hist, uint64_t us)
+{
+    int bucket = us ? 64 - __builtin_clzll(us) : 0;
+
+    if (bucket >= LS_STATS_HIST_BUCKETS)
+        bucket = LS_STATS_HIST_BUCKETS - 1;
+
+    hist[bucket]++;
+}
+
+/* Upper bound of the bucket holding the given percentile, in us */
+static uint64_t LS_StatsHistPercentile(const uint64_t *hist,
+                                       uint64_t total,
+                                       int percent)
+{
+    uint64_t rank = (total * percent + 99) / 100;
+    uint64_t seen = 0;
+    int i;
+
+    for (i = 0; i < LS_STATS_HIST_BUCKETS; ++i)
+    {
+        seen += hist[i];
+        if (seen >= rank)
+            break;
+    }
+
+    return 1ULL << i;
+}
+
+void LS_StatsFrameQueued(xf86CrtcPtr crtc,
+                         uint64_t request_us,
+                         uint64_t queued_us)
+{
+    struct ls_frame_stats *pFrame = LS_StatsCrtc(crtc);
+
+    if (pFrame && queued_us >= request_us)
+        LS_StatsHistAdd(pFrame->hist[LS_FRAME_QUEUE], queued_us - request_us);
+}
+
+void LS_StatsFrameDone(xf86CrtcPtr crtc, uint64_t queued_us, uint64_t ust)
+{
+    struct ls_frame_stats *pFrame = LS_StatsCrtc(crtc);
+
+    /* Drivers without vblank timestamps report 0 */
+    if (pFrame && queued_us && ust >= queued_us)
+        LS_StatsHistAdd(pFrame->hist[LS_FRAME_COMPLETE], ust - queued_us);
+}
+
+void LS_StatsFrameMsc(xf86CrtcPtr crtc, uint64_t target_msc, uint64_t msc)
+{
+    struct ls_frame_stats *pFrame = LS_StatsCrtc(crtc);
+
+    if (!pFrame)
+        return;
+
+    pFrame->events++;
+    if (msc > target_msc)
+        pFrame->missed++;
+}
+
+static int LS_StatsDumpFrames(ScrnInfoPtr pScrn, char *buf, int size)
+{
+    static const char * const hist_names[LS_FRAME_HIST_NUM] =
+    {
+        [LS_FRAME_QUEUE]    = "queue",
+        [LS_FRAME_COMPLETE] = "complete",
+    };
+    loongsonPtr lsp = loongsonPTR(pScrn);
+    int len = 0;
+    int pipe;
+    int h;
+    int i;
+
+    if (!lsp->stats)
+        return 0;
+
+    for (pipe = 0; pipe < LS_STATS_MAX_CRTC; ++pipe)
+    {
+        const struct ls_frame_stats *pFrame = &lsp->stats->frame[pipe];
+
+        for (h = 0; h < LS_FRAME_HIST_NUM; ++h)
+        {
+            const uint64_t *hist = pFrame->hist[h];
+            uint64_t total = 0;
+            uint64_t p50, p90, p99;
+
+            for (i = 0; i < LS_STATS_HIST_BUCKETS; ++i)
+                total += hist[i];
+
+            if (!total)
+                continue;
+
+            p50 = LS_StatsHistPercentile(hist, total, 50);
+            p90 = LS_StatsHistPercentile(hist, total, 90);
+            p99 = LS_StatsHistPercentile(hist, total, 99);
+
+            xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+                       "stats: crtc %d %-8s %10llu flips, p50 <%llu us,"
+                       " p90 <%llu us, p99 <%llu us\n",
+                       pipe, hist_names[h], (unsigned long long)total,
+                       (unsigned long long)p50, (unsigned long long)p90,
+                       (unsigned long long)p99);
+
+            if (len < size)
+                len += snprintf(buf + len, size - len,
+                                "crtc %d %s: %llu %llu %llu %llu\n",
+                                pipe, hist_names[h],
+                                (unsigned long long)total,
+                                (unsigned long long)p50,
+                                (unsigned long long)p90,
+                                (unsigned long long)p99);
+        }
+
+        if (!pFrame->events)
+            continue;
+
+        xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+                   "stats: crtc %d missed %llu of %llu target MSCs\n",
+                   pipe, (unsigned long long)pFrame->missed,
+                   (unsigned long long)pFrame->events);
+
+        if (len < size)
+            len += snprintf(buf + len, size - len,
+                            "crtc %d missed: %llu %llu\n", pipe,
+                            (unsigned long long)pFrame->missed,
+                            (unsigned long long)pFrame->events);
+    }
+
+    return len < size ? len : size - 1;
+}
+
+static void LS_StatsSignal(int sig)
+{
+    ls_stats_dump_requested++;
+}
+
+void LS_StatsInit(ScreenPtr pScreen)
+{
+    loongsonPtr lsp = loongsonPTR(xf86ScreenToScrn(pScreen));
+
+    lsp->stats = calloc(1, sizeof(*lsp->stats));
+
+    if (ls_stats_signal_installed)
+        return;
+
+    OsSignal(SIGUSR2, LS_StatsSignal);
+    ls_stats_signal_installed = TRUE;
+}
+
+void LS_StatsFini(ScreenPtr pScreen)
+{
+    loongsonPtr lsp = loongsonPTR(xf86ScreenToScrn(pScreen));
+
+    free(lsp->stats);
+    lsp->stats = NULL;
+}
+
+void LS_StatsDump(ScreenPtr pScreen)
+{
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+    struct ls_stat total[LS_STAT_NUM];
+    char buf[LS_STAT_NUM * 96 + LS_STATS_MAX_CRTC * 256];
+    int len = 0;
+    int i;
+
+    LS_StatsSum(total);
+
+    for (i = 0; i < LS_STAT_NUM; ++i)
+    {
+        const struct ls_stat *pStat = &total[i];
+        uint64_t avg = pStat->count ? pStat->ns / pStat->count : 0;
+
+        xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+                   "stats: %-12s %10llu ops %14llu bytes %12llu us"
+                   " (%llu ns/op)\n",
+                   ls_stat_names[i],
+                   (unsigned long long)pStat->count,
+                   (unsigned long long)pStat->bytes,
+                   (unsigned long long)(pStat->ns / 1000),
+                   (unsigned long long)avg);
+
+        len += snprintf(buf + len, sizeof(buf) - len,
+                        "%s: %llu %llu %llu\n",
+                        ls_stat_names[i],
+                        (unsigned long long)pStat->count,
+                        (unsigned long long)pStat->bytes,
+                        (unsigned long long)pStat->ns);
+        if (len >= (int)sizeof(buf))
+        {
+            len = sizeof(buf) - 1;
+            break;
+        }
+    }
+
+    if (len < (int)sizeof(buf) - 1)
+        len += LS_StatsDumpFrames(pScrn, buf + len, sizeof(buf) - len);
+
+    if (pScreen->root)
+    {
+        Atom name = MakeAtom("LOONGSON_STATS",
+                             strlen("LOONGSON_STATS"), TRUE);
+
+        dixChangeWindowProperty(serverClient, pScreen->root, name,
+                                XA_STRING, 8, PropModeReplace,
+                                len, buf, TRUE);
+    }
+}
+
+void LS_StatsBlockHandler(ScreenPtr pScreen)
+{
+    loongsonPtr lsp = loongsonPTR(xf86ScreenToScrn(pScreen));
+    sig_atomic_t requested = ls_stats_dump_requested;
+
+    if (!lsp->stats || (lsp->stats->dumped == requested))
+        return;
+
+    lsp->stats->dumped = requested;
+    LS_StatsDump(pScreen);
+}
+
+#endif
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2026 Loongson Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef LOONGSON_STATS_H_
+#define LOONGSON_STATS_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <xf86.h>
+#include <xf86Crtc.h>
+#include <regionstr.h>
+
+/*
+ * Performance counters, built with --enable-stats only. Every hot path
+ * gets a count, the bytes it moved and the nanoseconds it took, kept in
+ * a thread local block so that recording is three adds and no lock.
+ *
+ * Frame timing is kept per CRTC as log2 histograms in microseconds, for
+ * the time from a flip request to the flip being queued, the time from
+ * queued to completed, and how many vblank events arrived after their
+ * target MSC.
+ *
+ * "kill -USR2 <Xorg pid>" writes the totals to the log and to the
+ * LOONGSON_STATS property of the root window (xprop -root LOONGSON_STATS).
+ */
+
+enum ls_stat_id
+{
+    LS_STAT_SHADOW_FLUSH,
+    LS_STAT_RESOLVE,
+    LS_STAT_SOLID,
+    LS_STAT_COPY,
+    LS_STAT_COMPOSITE,
+    LS_STAT_UPLOAD,
+    LS_STAT_DOWNLOAD,
+    LS_STAT_PAGEFLIP,
+    LS_STAT_DIRTYFB,
+    LS_STAT_DRI2_IMPORT,
+    LS_STAT_DRI3_IMPORT,
+    LS_STAT_NUM
+};
+
+enum ls_frame_hist
+{
+    /* flip requested -> flip queued to the kernel */
+    LS_FRAME_QUEUE,
+    /* flip queued -> flip completed, by the vblank timestamp */
+    LS_FRAME_COMPLETE,
+    LS_FRAME_HIST_NUM
+};
+
+#ifdef LOONGSON_STATS
+
+#include <time.h>
+
+struct ls_stat
+{
+    uint64_t count;
+    uint64_t bytes;
+    uint64_t ns;
+};
+
+struct ls_stats_block
+{
+    struct ls_stat stat[LS_STAT_NUM];
+    struct ls_stats_block *next;
+};
+
+extern __thread struct ls_stats_block *ls_stats_local;
+
+struct ls_stats_block *LS_StatsRegisterThread(void);
+
+static inline uint64_t LS_StatsNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void LS_StatsAdd(enum ls_stat_id id,
+                               uint64_t bytes,
+                               uint64_t ns)
+{
+    struct ls_stats_block *pBlock = ls_stats_local;
+
+    if (!pBlock && !(pBlock = LS_StatsRegisterThread()))
+        return;
+
+    pBlock->stat[id].count++;
+    pBlock->stat[id].bytes += bytes;
+    pBlock->stat[id].ns += ns;
+}
+
+static inline uint64_t LS_StatsRegionBytes(RegionPtr pRegion, int cpp)
+{
+    int nbox = RegionNumRects(pRegion);
+    BoxPtr pbox = RegionRects(pRegion);
+    uint64_t bytes = 0;
+
+    while (nbox--)
+    {
+        bytes += (uint64_t)(pbox->x2 - pbox->x1) * (pbox->y2 - pbox->y1);
+        pbox++;
+    }
+
+    return bytes * cpp;
+}
+
+void LS_StatsInit(ScreenPtr pScreen);
+void LS_StatsFini(ScreenPtr pScreen);
+void LS_StatsBlockHandler(ScreenPtr pScreen);
+void LS_StatsDump(ScreenPtr pScreen);
+
+void LS_StatsFrameQueued(xf86CrtcPtr crtc,
+                         uint64_t request_us,
+                         uint64_t queued_us);
+void LS_StatsFrameDone(xf86CrtcPtr crtc, uint64_t queued_us, uint64_t ust);
+void LS_StatsFrameMsc(xf86CrtcPtr crtc, uint64_t target_msc, uint64_t msc);
+
+#define LS_STATS_BEGIN(t)            uint64_t t = LS_StatsNow()
+#define LS_STATS_END(id, t, bytes)   LS_StatsAdd(id, bytes, LS_StatsNow() - (t))
+#define LS_STATS_COUNT(id, bytes)    LS_StatsAdd(id, bytes, 0)
+#define LS_STATS_STAMP_US(var)       ((var) = LS_StatsNow() / 1000)
+#define LS_STATS_NOW_US()            (LS_StatsNow() / 1000)
+
+#else
+
+#define LS_StatsInit(pScreen)          do { } while (0)
+#define LS_StatsFini(pScreen)          do { } while (0)
+#define LS_StatsBlockHandler(pScreen)  do { } while (0)
+#define LS_StatsDump(pScreen)          do { } while (0)
+
+#define LS_StatsFrameQueued(crtc, request_us, queued_us)  do { } while (0)
+#define LS_StatsFrameDone(crtc, queued_us, ust)           do { } while (0)
+#define LS_StatsFrameMsc(crtc, target_msc, msc)           do { } while (0)
+
+#define LS_STATS_BEGIN(t)              do { } while (0)
+#define LS_STATS_END(id, t, bytes)     do { } while (0)
+#define LS_STATS_COUNT(id, bytes)      do { } while (0)
+#define LS_STATS_STAMP_US(var)         do { } while (0)
+#define LS_STATS_NOW_US()              0
+
+#endif
+
+#endif
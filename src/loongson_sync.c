@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2026 Loongson Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <poll.h>
+
+#include <xf86.h>
+#include <exa.h>
+
+#include "driver.h"
+#include "loongson_pixmap.h"
+#include "loongson_sync.h"
+
+/*
+ * A few frames at the slowest rate a client can sensibly render at. The
+ * wait blocks the whole server, past this we rather touch the buffer
+ * early and show a torn frame than stall every other client.
+ */
+#define LS_SYNC_TIMEOUT_MS    100
+
+static Bool LS_SyncPoll(int fd, short events, int timeout)
+{
+    struct pollfd pfd = { .fd = fd, .events = events };
+    int ret;
+
+    do {
+        ret = poll(&pfd, 1, timeout);
+    } while (ret < 0 && (errno == EINTR || errno == EAGAIN));
+
+    if (ret == 0 && timeout)
+        xf86Msg(X_WARNING, "%s: fd %d still busy after %d ms\n",
+                __func__, fd, timeout);
+
+    return ret > 0;
+}
+
+/*
+ * Wait for the rendering clients queued to a shared BO. Read access only
+ * has to wait for writers, write access for everyone.
+ */
+void LS_SyncPrepareAccess(PixmapPtr pPixmap, int index)
+{
+    struct exa_pixmap_priv *priv = exaGetPixmapDriverPrivate(pPixmap);
+    short events;
+
+    /* Only buffers shared with clients carry GPU work */
+    if (!priv || priv->fd <= 0)
+        return;
+
+    switch (index)
+    {
+    case EXA_PREPARE_DEST:
+    case EXA_PREPARE_AUX_DEST:
+        events = POLLOUT;
+        break;
+    default:
+        events = POLLIN;
+        break;
+    }
+
+    /* Idle, hand it out without waiting at all */
+    if (LS_SyncPoll(priv->fd, events, 0))
+        return;
+
+    LS_SyncPoll(priv->fd, events, LS_SYNC_TIMEOUT_MS);
+}
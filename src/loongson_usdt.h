@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2026 Loongson Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef LOONGSON_USDT_H_
+#define LOONGSON_USDT_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/*
+ * Static USDT probes on the hot paths, provider "loongson". Built in
+ * whenever <sys/sdt.h> is available (--disable-probes to leave them out).
+ * A probe site is a single nop until perf or bpftrace attaches to it. Its
+ * arguments are box counts and byte sizes which take a multiply or two to
+ * work out, nothing that walks a region or takes a lock:
+ *
+ *   perf probe -x loongson_drv.so sdt_loongson:*
+ *   bpftrace -l 'usdt:/usr/lib/xorg/modules/drivers/loongson_drv.so:*'
+ *
+ * Every traced function has a <name>_entry and a <name>_return probe.
+ */
+
+#ifdef LOONGSON_PROBES
+
+#include <sys/sdt.h>
+
+#define LS_PROBE(name)                  DTRACE_PROBE(loongson, name)
+#define LS_PROBE1(name, a)              DTRACE_PROBE1(loongson, name, a)
+#define LS_PROBE2(name, a, b)           DTRACE_PROBE2(loongson, name, a, b)
+#define LS_PROBE3(name, a, b, c)        DTRACE_PROBE3(loongson, name, a, b, c)
+
+#else
+
+#define LS_PROBE(name)                  do { } while (0)
+#define LS_PROBE1(name, a)              do { } while (0)
+#define LS_PROBE2(name, a, b)           do { } while (0)
+#define LS_PROBE3(name, a, b, c)        do { } while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,971 @@
+/*
+ * Copyright (C) 2022 Loongson Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Xv adaptor backed by the display controller's overlay planes.
+ *
+ * A port whose window is fully visible, unredirected and sits on a single
+ * unrotated crtc gets an overlay plane: the frame is copied into a dumb bo
+ * as NV12 or YUYV and shown with a non-blocking atomic commit, the crtc does
+ * the color conversion and the scaling. Everything else, and ports which
+ * lost the competition for a plane, fall back to a CPU color conversion
+ * followed by a CopyArea through the acceleration layer.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <xf86.h>
+#include <xf86xv.h>
+#include <fourcc.h>
+#include <gcstruct.h>
+#include <X11/extensions/Xv.h>
+#include <drm_fourcc.h>
+#include <xf86drmMode.h>
+
+#include "driver.h"
+#include "dumb_bo.h"
+#include "loongson_debug.h"
+#include "loongson_video.h"
+
+#ifndef FOURCC_NV12
+#define FOURCC_NV12     0x3231564e
+#endif
+
+#ifndef XVIMAGE_NV12
+#define XVIMAGE_NV12 \
+   { \
+        FOURCC_NV12, \
+        XvYUV, \
+        LSBFirst, \
+        {'N','V','1','2', \
+          0x00,0x00,0x00,0x10,0x80,0x00,0x00,0xAA,0x00,0x38,0x9B,0x71}, \
+        12, \
+        XvPlanar, \
+        2, \
+        0, 0, 0, 0, \
+        8, 8, 8, \
+        1, 2, 2, \
+        1, 2, 2, \
+        {'Y','U','V', \
+          0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0}, \
+        XvTopToBottom \
+   }
+#endif
+
+#define LS_VIDEO_NUM_PORTS      8
+#define LS_VIDEO_NUM_BUFS       3
+#define LS_VIDEO_MAX_SIZE       4096
+
+struct ls_video_port {
+    ScrnInfoPtr pScrn;
+
+    /* Overlay plane state, plane == NULL on the software path */
+    struct drmmode_overlay_plane *plane;
+    xf86CrtcPtr crtc;
+    /* Area of the destination, the smaller one loses the plane */
+    int area;
+    /* The kernel refused our plane setup, stay with the software path */
+    Bool plane_broken;
+
+    struct dumb_bo *bo[LS_VIDEO_NUM_BUFS];
+    uint32_t fb_id[LS_VIDEO_NUM_BUFS];
+    int cur;
+    uint32_t bo_format;
+    int bo_width;
+    int bo_height;
+
+    /* Software path: the converted frame, at the destination size */
+    void *sw_buf;
+    size_t sw_size;
+};
+
+struct ls_video {
+    XF86VideoAdaptorPtr adaptor;
+    struct ls_video_port ports[LS_VIDEO_NUM_PORTS];
+};
+
+static XF86VideoEncodingRec ls_video_encodings[] = {
+    { 0, "XV_IMAGE", LS_VIDEO_MAX_SIZE, LS_VIDEO_MAX_SIZE, { 1, 1 } },
+};
+
+static XF86VideoFormatRec ls_video_formats[] = {
+    { 15, TrueColor }, { 16, TrueColor }, { 24, TrueColor },
+};
+
+static XF86ImageRec ls_video_images[] = {
+    XVIMAGE_YUY2,
+    XVIMAGE_YV12,
+    XVIMAGE_I420,
+    XVIMAGE_NV12,
+};
+
+/*
+ * Pitches and offsets of the planes of a client image, shared by
+ * QueryImageAttributes and PutImage so that they can never disagree.
+ * Returns the size of the whole image in bytes.
+ */
+static int ls_video_image_layout(int id,
+                                 unsigned short *w,
+                                 unsigned short *h,
+                                 int *pitches,
+                                 int *offsets)
+{
+    int size, tmp;
+
+    if (*w > LS_VIDEO_MAX_SIZE)
+        *w = LS_VIDEO_MAX_SIZE;
+    if (*h > LS_VIDEO_MAX_SIZE)
+        *h = LS_VIDEO_MAX_SIZE;
+
+    *w = (*w + 1) & ~1;
+
+    if (offsets)
+        offsets[0] = 0;
+
+    switch (id)
+    {
+    case FOURCC_YV12:
+    case FOURCC_I420:
+        *h = (*h + 1) & ~1;
+        size = (*w + 3) & ~3;
+        if (pitches)
+            pitches[0] = size;
+        size *= *h;
+        if (offsets)
+            offsets[1] = size;
+        tmp = ((*w >> 1) + 3) & ~3;
+        if (pitches)
+            pitches[1] = pitches[2] = tmp;
+        tmp *= (*h >> 1);
+        size += tmp;
+        if (offsets)
+            offsets[2] = size;
+        size += tmp;
+        break;
+    case FOURCC_NV12:
+        *h = (*h + 1) & ~1;
+        size = (*w + 3) & ~3;
+        if (pitches)
+            pitches[0] = pitches[1] = size;
+        tmp = size * *h;
+        if (offsets)
+            offsets[1] = tmp;
+        size = tmp + tmp / 2;
+        break;
+    case FOURCC_YUY2:
+    default:
+        size = *w << 1;
+        if (pitches)
+            pitches[0] = size;
+        size *= *h;
+        break;
+    }
+
+    return size;
+}
+
+/*
+ * Overlay plane path
+ */
+
+static void ls_video_free_bos(struct ls_video_port *port)
+{
+    loongsonPtr lsp = loongsonPTR(port->pScrn);
+    int i;
+
+    for (i = 0; i < LS_VIDEO_NUM_BUFS; i++)
+    {
+        if (port->fb_id[i])
+        {
+            drmModeRmFB(lsp->fd, port->fb_id[i]);
+            port->fb_id[i] = 0;
+        }
+
+        if (port->bo[i])
+        {
+            dumb_bo_destroy(lsp->fd, port->bo[i]);
+            port->bo[i] = NULL;
+        }
+    }
+
+    port->bo_format = 0;
+    port->bo_width = 0;
+    port->bo_height = 0;
+}
+
+static Bool ls_video_alloc_bos(struct ls_video_port *port,
+                               uint32_t format,
+                               int width,
+                               int height)
+{
+    loongsonPtr lsp = loongsonPTR(port->pScrn);
+    int i;
+
+    if ((port->bo_format == format) &&
+        (port->bo_width == width) &&
+        (port->bo_height == height))
+        return TRUE;
+
+    ls_video_free_bos(port);
+
+    for (i = 0; i < LS_VIDEO_NUM_BUFS; i++)
+    {
+        uint32_t handles[4] = { 0 };
+        uint32_t pitches[4] = { 0 };
+        uint32_t offsets[4] = { 0 };
+        uint32_t pitch;
+
+        if (format == DRM_FORMAT_NV12)
+            port->bo[i] = dumb_bo_create(lsp->fd, width, height * 3 / 2, 8);
+        else
+            port->bo[i] = dumb_bo_create(lsp->fd, width, height, 16);
+
+        if (!port->bo[i])
+            goto fail;
+
+        if (dumb_bo_map(lsp->fd, port->bo[i]))
+            goto fail;
+
+        pitch = dumb_bo_pitch(port->bo[i]);
+        handles[0] = dumb_bo_handle(port->bo[i]);
+        pitches[0] = pitch;
+
+        if (format == DRM_FORMAT_NV12)
+        {
+            handles[1] = handles[0];
+            pitches[1] = pitch;
+            offsets[1] = pitch * height;
+        }
+
+        if (drmModeAddFB2(lsp->fd, width, height, format,
+                          handles, pitches, offsets, &port->fb_id[i], 0))
+            goto fail;
+    }
+
+    port->bo_format = format;
+    port->bo_width = width;
+    port->bo_height = height;
+    port->cur = 0;
+
+    return TRUE;
+
+fail:
+    ls_video_free_bos(port);
+    return FALSE;
+}
+
+/* Copy the client image into a plane buffer, converting planar to NV12 */
+static void ls_video_copy_to_bo(struct ls_video_port *port,
+                                struct dumb_bo *bo,
+                                int id,
+                                const unsigned char *buf,
+                                int width,
+                                int height)
+{
+    unsigned short w = width, h = height;
+    int pitches[3], offsets[3];
+    uint8_t *dst = dumb_bo_cpu_addr(bo);
+    uint32_t dst_pitch = dumb_bo_pitch(bo);
+    int x, y;
+
+    ls_video_image_layout(id, &w, &h, pitches, offsets);
+
+    if (id == FOURCC_YUY2)
+    {
+        for (y = 0; y < height; y++)
+            memcpy(dst + y * dst_pitch, buf + y * pitches[0], width * 2);
+        return;
+    }
+
+    /* Luma is the same for all the 4:2:0 formats */
+    for (y = 0; y < height; y++)
+        memcpy(dst + y * dst_pitch, buf + y * pitches[0], width);
+
+    dst += dst_pitch * port->bo_height;
+
+    if (id == FOURCC_NV12)
+    {
+        for (y = 0; y < height / 2; y++)
+            memcpy(dst + y * dst_pitch,
+                   buf + offsets[1] + y * pitches[1], width);
+    }
+    else
+    {
+        const unsigned char *u, *v;
+
+        if (id == FOURCC_YV12)
+        {
+            v = buf + offsets[1];
+            u = buf + offsets[2];
+        }
+        else
+        {
+            u = buf + offsets[1];
+            v = buf + offsets[2];
+        }
+
+        for (y = 0; y < height / 2; y++)
+        {
+            uint8_t *d = dst + y * dst_pitch;
+
+            for (x = 0; x < width / 2; x++)
+            {
+                d[2 * x] = u[x];
+                d[2 * x + 1] = v[x];
+            }
+
+            u += pitches[1];
+            v += pitches[2];
+        }
+    }
+}
+
+/* Turn off the plane and hand it back, the buffers are kept */
+static void ls_video_release_plane(struct ls_video_port *port)
+{
+    loongsonPtr lsp = loongsonPTR(port->pScrn);
+    struct drmmode_overlay_plane *plane = port->plane;
+
+    if (!plane)
+        return;
+
+    if (drmmode_overlay_commit(&lsp->drmmode, plane, port->crtc,
+                               0, NULL, NULL, 0))
+    {
+        xf86DrvMsg(port->pScrn->scrnIndex, X_WARNING,
+                   "Failed to disable overlay plane %u\n", plane->plane_id);
+    }
+
+    plane->owner = NULL;
+    port->plane = NULL;
+    port->crtc = NULL;
+    port->area = 0;
+}
+
+/*
+ * The crtc the destination box can be shown on with a plane: the box must
+ * be entirely inside it and no other crtc may see any part of it.
+ */
+static xf86CrtcPtr ls_video_covering_crtc(ScrnInfoPtr pScrn, BoxPtr box)
+{
+    xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(pScrn);
+    xf86CrtcPtr best = NULL;
+    int c;
+
+    for (c = 0; c < xf86_config->num_crtc; c++)
+    {
+        xf86CrtcPtr crtc = xf86_config->crtc[c];
+        BoxRec crtc_box;
+
+        if (!crtc->enabled)
+            continue;
+
+        crtc_box.x1 = crtc->x;
+        crtc_box.y1 = crtc->y;
+        crtc_box.x2 = crtc->x + xf86ModeWidth(&crtc->mode, crtc->rotation);
+        crtc_box.y2 = crtc->y + xf86ModeHeight(&crtc->mode, crtc->rotation);
+
+        if ((box->x1 >= crtc_box.x2) || (box->x2 <= crtc_box.x1) ||
+            (box->y1 >= crtc_box.y2) || (box->y2 <= crtc_box.y1))
+            continue;
+
+        if (best)
+            return NULL;
+
+        if ((box->x1 < crtc_box.x1) || (box->x2 > crtc_box.x2) ||
+            (box->y1 < crtc_box.y1) || (box->y2 > crtc_box.y2))
+            return NULL;
+
+        if ((crtc->rotation != RR_Rotate_0) || crtc->transformPresent)
+            return NULL;
+
+        best = crtc;
+    }
+
+    return best;
+}
+
+static Bool ls_video_plane_fits(struct drmmode_overlay_plane *plane,
+                                xf86CrtcPtr crtc,
+                                uint32_t format)
+{
+    drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+
+    if (!(plane->possible_crtcs & (1 << drmmode_crtc->crtc_index)))
+        return FALSE;
+
+    if (format == DRM_FORMAT_NV12)
+        return plane->has_nv12;
+
+    return plane->has_yuyv;
+}
+
+/*
+ * Find a plane for the port: keep the one we have if it still fits, take a
+ * free one, or take it away from the port showing the smallest video if
+ * that one is smaller than ours.
+ */
+static Bool ls_video_acquire_plane(struct ls_video_port *port,
+                                   xf86CrtcPtr crtc,
+                                   uint32_t format,
+                                   int area)
+{
+    loongsonPtr lsp = loongsonPTR(port->pScrn);
+    struct drmmode_rec * const pDrmMode = &lsp->drmmode;
+    struct drmmode_overlay_plane *victim = NULL;
+    int i;
+
+    if (port->plane)
+    {
+        if ((port->crtc == crtc) && ls_video_plane_fits(port->plane, crtc, format))
+        {
+            port->area = area;
+            return TRUE;
+        }
+
+        ls_video_release_plane(port);
+    }
+
+    for (i = 0; i < pDrmMode->num_overlays; i++)
+    {
+        struct drmmode_overlay_plane *plane = &pDrmMode->overlays[i];
+        struct ls_video_port *holder = plane->owner;
+
+        if (!ls_video_plane_fits(plane, crtc, format))
+            continue;
+
+        if (!holder)
+        {
+            victim = plane;
+            break;
+        }
+
+        if ((holder->area < area) &&
+            (!victim || (holder->area <
+                         ((struct ls_video_port *) victim->owner)->area)))
+            victim = plane;
+    }
+
+    if (!victim)
+        return FALSE;
+
+    if (victim->owner)
+    {
+        struct ls_video_port *holder = victim->owner;
+
+        DEBUG_MSG("Overlay plane %u goes to a bigger video", victim->plane_id);
+
+        /* It falls back to the software path with its next frame */
+        ls_video_release_plane(holder);
+    }
+
+    victim->owner = port;
+    port->plane = victim;
+    port->crtc = crtc;
+    port->area = area;
+
+    return TRUE;
+}
+
+/*
+ * Returns Success if the frame went to the plane (or was dropped because
+ * the previous commit has not landed yet), BadAlloc if the software path
+ * must draw it.
+ */
+static int ls_video_put_plane(struct ls_video_port *port,
+                              DrawablePtr pDraw,
+                              short src_x, short src_y,
+                              short src_w, short src_h,
+                              BoxPtr dst,
+                              int id,
+                              const unsigned char *buf,
+                              short width, short height,
+                              RegionPtr clipBoxes)
+{
+    ScrnInfoPtr pScrn = port->pScrn;
+    ScreenPtr pScreen = pDraw->pScreen;
+    loongsonPtr lsp = loongsonPTR(pScrn);
+    xf86CrtcPtr crtc;
+    uint32_t format;
+    BoxRec src_box, crtc_box;
+    unsigned short w = width, h = height;
+    int next, ret;
+
+    if (port->plane_broken || (lsp->drmmode.num_overlays == 0))
+        return BadAlloc;
+
+    if (!pScrn->vtSema)
+        return BadAlloc;
+
+    /* Fully visible and not redirected, or we would cover other windows */
+    if (pDraw->type != DRAWABLE_WINDOW)
+        return BadAlloc;
+
+    if (pScreen->GetWindowPixmap((WindowPtr) pDraw) !=
+        pScreen->GetScreenPixmap(pScreen))
+        return BadAlloc;
+
+    if ((RegionNumRects(clipBoxes) != 1) ||
+        memcmp(RegionExtents(clipBoxes), dst, sizeof(BoxRec)))
+        return BadAlloc;
+
+    crtc = ls_video_covering_crtc(pScrn, dst);
+    if (!crtc)
+        return BadAlloc;
+
+    format = (id == FOURCC_YUY2) ? DRM_FORMAT_YUYV : DRM_FORMAT_NV12;
+
+    if (!ls_video_acquire_plane(port, crtc, format,
+                                (dst->x2 - dst->x1) * (dst->y2 - dst->y1)))
+        return BadAlloc;
+
+    /* The padded size of the client image, even for the chroma planes */
+    ls_video_image_layout(id, &w, &h, NULL, NULL);
+
+    if (!ls_video_alloc_bos(port, format, w, h))
+    {
+        ls_video_release_plane(port);
+        return BadAlloc;
+    }
+
+    next = (port->cur + 1) % LS_VIDEO_NUM_BUFS;
+
+    ls_video_copy_to_bo(port, port->bo[next], id, buf, w, h);
+
+    src_box.x1 = src_x;
+    src_box.y1 = src_y;
+    src_box.x2 = src_x + src_w;
+    src_box.y2 = src_y + src_h;
+
+    crtc_box.x1 = dst->x1 - crtc->x;
+    crtc_box.y1 = dst->y1 - crtc->y;
+    crtc_box.x2 = dst->x2 - crtc->x;
+    crtc_box.y2 = dst->y2 - crtc->y;
+
+    ret = drmmode_overlay_commit(&lsp->drmmode, port->plane, crtc,
+                                 port->fb_id[next], &src_box, &crtc_box,
+                                 DRM_MODE_ATOMIC_NONBLOCK);
+    if (ret == 0)
+    {
+        port->cur = next;
+        return Success;
+    }
+
+    /* The previous frame is still queued, drop this one */
+    if (ret == -EBUSY)
+        return Success;
+
+    xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+               "Overlay plane %u rejected the video: %s, using software path\n",
+               port->plane->plane_id, strerror(-ret));
+
+    port->plane_broken = TRUE;
+    ls_video_release_plane(port);
+    ls_video_free_bos(port);
+
+    return BadAlloc;
+}
+
+/*
+ * Software path
+ */
+
+static inline uint8_t ls_video_clamp(int v)
+{
+    if (v < 0)
+        return 0;
+    if (v > 255)
+        return 255;
+    return v;
+}
+
+/* BT.601, limited range */
+static inline void ls_video_yuv_to_rgb(int y, int u, int v,
+                                       uint8_t *r, uint8_t *g, uint8_t *b)
+{
+    int c = 298 * (y - 16) + 128;
+    int d = u - 128;
+    int e = v - 128;
+
+    *r = ls_video_clamp((c + 409 * e) >> 8);
+    *g = ls_video_clamp((c - 100 * d - 208 * e) >> 8);
+    *b = ls_video_clamp((c + 516 * d) >> 8);
+}
+
+static void ls_video_convert(int id,
+                             const unsigned char *buf,
+                             short width, short height,
+                             short src_x, short src_y,
+                             short src_w, short src_h,
+                             int dst_w, int dst_h,
+                             int bpp, int depth,
+                             uint8_t *dst,
+                             int dst_pitch)
+{
+    unsigned short w = width, h = height;
+    int pitches[3], offsets[3];
+    const unsigned char *u_plane = NULL, *v_plane = NULL;
+    int dx, dy;
+
+    ls_video_image_layout(id, &w, &h, pitches, offsets);
+
+    if (id == FOURCC_YV12)
+    {
+        v_plane = buf + offsets[1];
+        u_plane = buf + offsets[2];
+    }
+    else if (id == FOURCC_I420)
+    {
+        u_plane = buf + offsets[1];
+        v_plane = buf + offsets[2];
+    }
+
+    for (dy = 0; dy < dst_h; dy++)
+    {
+        int sy = src_y + dy * src_h / dst_h;
+        const unsigned char *line = buf + sy * pitches[0];
+        uint32_t *d32 = (uint32_t *) (dst + dy * dst_pitch);
+        uint16_t *d16 = (uint16_t *) (dst + dy * dst_pitch);
+
+        for (dx = 0; dx < dst_w; dx++)
+        {
+            int sx = src_x + dx * src_w / dst_w;
+            int y, u, v;
+            uint8_t r, g, b;
+
+            switch (id)
+            {
+            case FOURCC_YUY2:
+                y = line[sx * 2];
+                u = line[(sx & ~1) * 2 + 1];
+                v = line[(sx & ~1) * 2 + 3];
+                break;
+            case FOURCC_NV12:
+            {
+                const unsigned char *uv = buf + offsets[1] +
+                                          (sy >> 1) * pitches[1];
+                y = line[sx];
+                u = uv[sx & ~1];
+                v = uv[(sx & ~1) + 1];
+                break;
+            }
+            default:
+                y = line[sx];
+                u = u_plane[(sy >> 1) * pitches[1] + (sx >> 1)];
+                v = v_plane[(sy >> 1) * pitches[2] + (sx >> 1)];
+                break;
+            }
+
+            ls_video_yuv_to_rgb(y, u, v, &r, &g, &b);
+
+            if (bpp == 32)
+                d32[dx] = 0xff000000 | (r << 16) | (g << 8) | b;
+            else if (depth == 15)
+                d16[dx] = ((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3);
+            else
+                d16[dx] = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+        }
+    }
+}
+
+static int ls_video_put_sw(struct ls_video_port *port,
+                           DrawablePtr pDraw,
+                           short src_x, short src_y,
+                           short src_w, short src_h,
+                           BoxPtr dst,
+                           int id,
+                           const unsigned char *buf,
+                           short width, short height,
+                           RegionPtr clipBoxes)
+{
+    ScreenPtr pScreen = pDraw->pScreen;
+    int dst_w = dst->x2 - dst->x1;
+    int dst_h = dst->y2 - dst->y1;
+    int bpp = pDraw->bitsPerPixel;
+    int pitch = ((dst_w * bpp / 8) + 3) & ~3;
+    size_t size = (size_t) pitch * dst_h;
+    PixmapPtr pSrc, pDst;
+    GCPtr pGC;
+    BoxPtr pbox;
+    int nbox;
+    int xoff = 0, yoff = 0;
+
+    if ((bpp != 32) && (bpp != 16))
+        return BadMatch;
+
+    if (size > port->sw_size)
+    {
+        void *tmp = realloc(port->sw_buf, size);
+
+        if (!tmp)
+            return BadAlloc;
+
+        port->sw_buf = tmp;
+        port->sw_size = size;
+    }
+
+    ls_video_convert(id, buf, width, height, src_x, src_y, src_w, src_h,
+                     dst_w, dst_h, bpp, pDraw->depth, port->sw_buf, pitch);
+
+    pSrc = GetScratchPixmapHeader(pScreen, dst_w, dst_h, pDraw->depth,
+                                  bpp, pitch, port->sw_buf);
+    if (!pSrc)
+        return BadAlloc;
+
+    if (pDraw->type == DRAWABLE_WINDOW)
+    {
+        pDst = pScreen->GetWindowPixmap((WindowPtr) pDraw);
+#ifdef COMPOSITE
+        xoff = -pDst->screen_x;
+        yoff = -pDst->screen_y;
+#endif
+    }
+    else
+    {
+        pDst = (PixmapPtr) pDraw;
+    }
+
+    pGC = GetScratchGC(pDst->drawable.depth, pScreen);
+    if (!pGC)
+    {
+        FreeScratchPixmapHeader(pSrc);
+        return BadAlloc;
+    }
+
+    ValidateGC(&pDst->drawable, pGC);
+
+    pbox = RegionRects(clipBoxes);
+    nbox = RegionNumRects(clipBoxes);
+
+    while (nbox--)
+    {
+        pGC->ops->CopyArea(&pSrc->drawable, &pDst->drawable, pGC,
+                           pbox->x1 - dst->x1, pbox->y1 - dst->y1,
+                           pbox->x2 - pbox->x1, pbox->y2 - pbox->y1,
+                           pbox->x1 + xoff, pbox->y1 + yoff);
+        pbox++;
+    }
+
+    FreeScratchGC(pGC);
+    FreeScratchPixmapHeader(pSrc);
+
+    return Success;
+}
+
+/*
+ * Adaptor hooks
+ */
+
+static void ls_video_stop(ScrnInfoPtr pScrn, pointer data, Bool shutdown)
+{
+    struct ls_video_port *port = data;
+
+    ls_video_release_plane(port);
+
+    if (shutdown)
+    {
+        ls_video_free_bos(port);
+
+        free(port->sw_buf);
+        port->sw_buf = NULL;
+        port->sw_size = 0;
+        port->plane_broken = FALSE;
+    }
+}
+
+static int ls_video_set_attribute(ScrnInfoPtr pScrn,
+                                  Atom attribute,
+                                  INT32 value,
+                                  pointer data)
+{
+    return BadMatch;
+}
+
+static int ls_video_get_attribute(ScrnInfoPtr pScrn,
+                                  Atom attribute,
+                                  INT32 *value,
+                                  pointer data)
+{
+    return BadMatch;
+}
+
+static void ls_video_query_best_size(ScrnInfoPtr pScrn,
+                                     Bool motion,
+                                     short vid_w, short vid_h,
+                                     short drw_w, short drw_h,
+                                     unsigned int *p_w,
+                                     unsigned int *p_h,
+                                     pointer data)
+{
+    *p_w = drw_w;
+    *p_h = drw_h;
+}
+
+static int ls_video_put_image(ScrnInfoPtr pScrn,
+                              short src_x, short src_y,
+                              short drw_x, short drw_y,
+                              short src_w, short src_h,
+                              short drw_w, short drw_h,
+                              int id,
+                              unsigned char *buf,
+                              short width, short height,
+                              Bool sync,
+                              RegionPtr clipBoxes,
+                              pointer data,
+                              DrawablePtr pDraw)
+{
+    struct ls_video_port *port = data;
+    BoxRec dst;
+
+    if ((src_w <= 0) || (src_h <= 0) || (drw_w <= 0) || (drw_h <= 0))
+        return Success;
+
+    if ((width > LS_VIDEO_MAX_SIZE) || (height > LS_VIDEO_MAX_SIZE))
+        return BadValue;
+
+    if ((src_x < 0) || (src_y < 0) ||
+        (src_x + src_w > width) || (src_y + src_h > height))
+        return BadValue;
+
+    dst.x1 = pDraw->x + drw_x;
+    dst.y1 = pDraw->y + drw_y;
+    dst.x2 = dst.x1 + drw_w;
+    dst.y2 = dst.y1 + drw_h;
+
+    if (ls_video_put_plane(port, pDraw, src_x, src_y, src_w, src_h,
+                           &dst, id, buf, width, height, clipBoxes) == Success)
+        return Success;
+
+    ls_video_release_plane(port);
+
+    return ls_video_put_sw(port, pDraw, src_x, src_y, src_w, src_h,
+                           &dst, id, buf, width, height, clipBoxes);
+}
+
+static int ls_video_query_image_attributes(ScrnInfoPtr pScrn,
+                                           int id,
+                                           unsigned short *w,
+                                           unsigned short *h,
+                                           int *pitches,
+                                           int *offsets)
+{
+    return ls_video_image_layout(id, w, h, pitches, offsets);
+}
+
+Bool LS_VideoScreenInit(ScreenPtr pScreen)
+{
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+    loongsonPtr lsp = loongsonPTR(pScrn);
+    XF86VideoAdaptorPtr adaptor;
+    struct ls_video *video;
+    int i;
+
+    video = calloc(1, sizeof(*video));
+    if (!video)
+        return FALSE;
+
+    adaptor = xf86XVAllocateVideoAdaptorRec(pScrn);
+    if (!adaptor)
+    {
+        free(video);
+        return FALSE;
+    }
+
+    adaptor->pPortPrivates = calloc(LS_VIDEO_NUM_PORTS, sizeof(DevUnion));
+    if (!adaptor->pPortPrivates)
+    {
+        xf86XVFreeVideoAdaptorRec(adaptor);
+        free(video);
+        return FALSE;
+    }
+
+    for (i = 0; i < LS_VIDEO_NUM_PORTS; i++)
+    {
+        video->ports[i].pScrn = pScrn;
+        adaptor->pPortPrivates[i].ptr = &video->ports[i];
+    }
+
+    adaptor->type = XvWindowMask | XvInputMask | XvImageMask;
+    adaptor->flags = 0;
+    adaptor->name = "Loongson Overlay";
+    adaptor->nEncodings = ARRAY_SIZE(ls_video_encodings);
+    adaptor->pEncodings = ls_video_encodings;
+    adaptor->nFormats = ARRAY_SIZE(ls_video_formats);
+    adaptor->pFormats = ls_video_formats;
+    adaptor->nPorts = LS_VIDEO_NUM_PORTS;
+    adaptor->nAttributes = 0;
+    adaptor->pAttributes = NULL;
+    adaptor->nImages = ARRAY_SIZE(ls_video_images);
+    adaptor->pImages = ls_video_images;
+    adaptor->PutVideo = NULL;
+    adaptor->PutStill = NULL;
+    adaptor->GetVideo = NULL;
+    adaptor->GetStill = NULL;
+    adaptor->StopVideo = ls_video_stop;
+    adaptor->SetPortAttribute = ls_video_set_attribute;
+    adaptor->GetPortAttribute = ls_video_get_attribute;
+    adaptor->QueryBestSize = ls_video_query_best_size;
+    adaptor->PutImage = ls_video_put_image;
+    adaptor->QueryImageAttributes = ls_video_query_image_attributes;
+
+    if (!xf86XVScreenInit(pScreen, &adaptor, 1))
+    {
+        free(adaptor->pPortPrivates);
+        xf86XVFreeVideoAdaptorRec(adaptor);
+        free(video);
+        return FALSE;
+    }
+
+    video->adaptor = adaptor;
+    lsp->video = video;
+
+    xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+               "Xv: %d ports, %d overlay planes\n",
+               LS_VIDEO_NUM_PORTS, lsp->drmmode.num_overlays);
+
+    return TRUE;
+}
+
+void LS_VideoCloseScreen(ScreenPtr pScreen)
+{
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+    loongsonPtr lsp = loongsonPTR(pScrn);
+    struct ls_video *video = lsp->video;
+    int i;
+
+    if (!video)
+        return;
+
+    for (i = 0; i < LS_VIDEO_NUM_PORTS; i++)
+        ls_video_stop(pScrn, &video->ports[i], TRUE);
+
+    free(video->adaptor->pPortPrivates);
+    xf86XVFreeVideoAdaptorRec(video->adaptor);
+    free(video);
+
+    lsp->video = NULL;
+}
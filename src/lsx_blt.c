@@ -199,3 +199,175 @@ COPY_LESS_THAN_2:
     memcpy(pDst, pSrc, w);
 #endif
 }
+
+#ifdef HAVE_LSX
+
+#define LSX_LOAD(p)         __lsx_vld((const void *)(p), 0)
+#define LSX_STORE(v, p)     __lsx_vst((v), (void *)(p), 0)
+
+/* reverse the 4 words of a vector */
+#define LSX_REV_W(v)        __lsx_vshuf4i_w((v), 0x1B)
+/* reverse the 8 halfwords of a vector */
+#define LSX_REV_H(v)        __lsx_vshuf4i_w(__lsx_vshuf4i_h((v), 0x1B), 0x4E)
+
+/*
+ * Rotated copy of a w x h box, w and h are multiples of 4.
+ *
+ * Moving one pixel right in the destination moves 'step_x' bytes in the
+ * source, moving one row down moves 'step_y' bytes, pSrc is the source of
+ * the first destination pixel. Either step_x is -4 (the rows are reversed,
+ * 180 degrees or reflect-x) or step_y is +-4 (the box is transposed, 90 or
+ * 270 degrees): a 4x4 block is loaded as 4 source rows, transposed in
+ * registers and stored as 4 destination rows.
+ */
+void lsx_rotate_blt_u32(void *pDst, long dst_pitch,
+                        const void *pSrc, long step_x, long step_y,
+                        int w, int h)
+{
+    long src_pitch = (step_x < 0) ? -step_x : step_x;
+    int x, y;
+
+    if (step_x == -4)
+    {
+        for (y = 0; y < h; y++)
+        {
+            uint8_t *d = (uint8_t *)pDst + y * dst_pitch;
+            const uint8_t *s = (const uint8_t *)pSrc + y * step_y;
+
+            for (x = 0; x < w; x += 4)
+                LSX_STORE(LSX_REV_W(LSX_LOAD(s - (x + 3) * 4)), d + x * 4);
+        }
+        return;
+    }
+
+    for (y = 0; y < h; y += 4)
+    {
+        for (x = 0; x < w; x += 4)
+        {
+            uint8_t *d = (uint8_t *)pDst + y * dst_pitch + x * 4;
+            const uint8_t *s = (const uint8_t *)pSrc + x * step_x + y * step_y;
+            __m128i r0, r1, r2, r3, t0, t1, t2, t3, c[4];
+
+            /* top left corner of the 4x4 source block */
+            if (step_x < 0)
+                s += 3 * step_x;
+            if (step_y < 0)
+                s += 3 * step_y;
+
+            r0 = LSX_LOAD(s);
+            r1 = LSX_LOAD(s + src_pitch);
+            r2 = LSX_LOAD(s + 2 * src_pitch);
+            r3 = LSX_LOAD(s + 3 * src_pitch);
+
+            t0 = __lsx_vilvl_w(r1, r0);
+            t1 = __lsx_vilvh_w(r1, r0);
+            t2 = __lsx_vilvl_w(r3, r2);
+            t3 = __lsx_vilvh_w(r3, r2);
+
+            /* c[k] is source column k, top to bottom */
+            c[0] = __lsx_vilvl_d(t2, t0);
+            c[1] = __lsx_vilvh_d(t2, t0);
+            c[2] = __lsx_vilvl_d(t3, t1);
+            c[3] = __lsx_vilvh_d(t3, t1);
+
+            if (step_x < 0)
+            {
+                c[0] = LSX_REV_W(c[0]);
+                c[1] = LSX_REV_W(c[1]);
+                c[2] = LSX_REV_W(c[2]);
+                c[3] = LSX_REV_W(c[3]);
+            }
+
+            if (step_y > 0)
+            {
+                LSX_STORE(c[0], d);
+                LSX_STORE(c[1], d + dst_pitch);
+                LSX_STORE(c[2], d + 2 * dst_pitch);
+                LSX_STORE(c[3], d + 3 * dst_pitch);
+            }
+            else
+            {
+                LSX_STORE(c[3], d);
+                LSX_STORE(c[2], d + dst_pitch);
+                LSX_STORE(c[1], d + 2 * dst_pitch);
+                LSX_STORE(c[0], d + 3 * dst_pitch);
+            }
+        }
+    }
+}
+
+/*
+ * The 16 bpp version of lsx_rotate_blt_u32, w and h are multiples of 8
+ * and the blocks are 8x8.
+ */
+void lsx_rotate_blt_u16(void *pDst, long dst_pitch,
+                        const void *pSrc, long step_x, long step_y,
+                        int w, int h)
+{
+    long src_pitch = (step_x < 0) ? -step_x : step_x;
+    int x, y, k;
+
+    if (step_x == -2)
+    {
+        for (y = 0; y < h; y++)
+        {
+            uint8_t *d = (uint8_t *)pDst + y * dst_pitch;
+            const uint8_t *s = (const uint8_t *)pSrc + y * step_y;
+
+            for (x = 0; x < w; x += 8)
+                LSX_STORE(LSX_REV_H(LSX_LOAD(s - (x + 7) * 2)), d + x * 2);
+        }
+        return;
+    }
+
+    for (y = 0; y < h; y += 8)
+    {
+        for (x = 0; x < w; x += 8)
+        {
+            uint8_t *d = (uint8_t *)pDst + y * dst_pitch + x * 2;
+            const uint8_t *s = (const uint8_t *)pSrc + x * step_x + y * step_y;
+            __m128i r[8], a[8], b[8], c[8];
+
+            if (step_x < 0)
+                s += 7 * step_x;
+            if (step_y < 0)
+                s += 7 * step_y;
+
+            for (k = 0; k < 8; k++)
+                r[k] = LSX_LOAD(s + k * src_pitch);
+
+            for (k = 0; k < 8; k += 2)
+            {
+                a[k] = __lsx_vilvl_h(r[k + 1], r[k]);
+                a[k + 1] = __lsx_vilvh_h(r[k + 1], r[k]);
+            }
+
+            /* b[0..3] hold rows 0-3, b[4..7] rows 4-7, two columns each */
+            b[0] = __lsx_vilvl_w(a[2], a[0]);
+            b[1] = __lsx_vilvh_w(a[2], a[0]);
+            b[2] = __lsx_vilvl_w(a[3], a[1]);
+            b[3] = __lsx_vilvh_w(a[3], a[1]);
+            b[4] = __lsx_vilvl_w(a[6], a[4]);
+            b[5] = __lsx_vilvh_w(a[6], a[4]);
+            b[6] = __lsx_vilvl_w(a[7], a[5]);
+            b[7] = __lsx_vilvh_w(a[7], a[5]);
+
+            for (k = 0; k < 4; k++)
+            {
+                c[2 * k] = __lsx_vilvl_d(b[k + 4], b[k]);
+                c[2 * k + 1] = __lsx_vilvh_d(b[k + 4], b[k]);
+            }
+
+            if (step_x < 0)
+            {
+                for (k = 0; k < 8; k++)
+                    c[k] = LSX_REV_H(c[k]);
+            }
+
+            for (k = 0; k < 8; k++)
+                LSX_STORE(c[(step_y > 0) ? k : 7 - k], d + k * dst_pitch);
+        }
+    }
+}
+
+#endif
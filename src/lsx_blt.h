@@ -29,4 +29,12 @@
 
 void lsx_blt_one_line_u8(void *pDst, const void *pSrc, long unsigned int w);
 
+void lsx_rotate_blt_u16(void *pDst, long dst_pitch,
+                        const void *pSrc, long step_x, long step_y,
+                        int w, int h);
+
+void lsx_rotate_blt_u32(void *pDst, long dst_pitch,
+                        const void *pSrc, long step_x, long step_y,
+                        int w, int h);
+
 #endif
@@ -32,6 +32,9 @@
 #include "vblank.h"
 #include "gsgpu_bo_helper.h"
 #include "loongson_scanout.h"
+#include "loongson_shadow.h"
+#include "loongson_stats.h"
+#include "loongson_usdt.h"
 /*
  * Flush the DRM event queue when full; makes space for new events.
  *
@@ -88,6 +91,10 @@ struct ms_flipdata {
     uint64_t fe_msc;
     uint64_t fe_usec;
     uint32_t old_fb_id;
+    /* when the flip was asked for, for the frame timing stats */
+    uint64_t request_us;
+    /* the MSC the flip should land on, 0 if it has none */
+    uint64_t target_msc;
 };
 
 /*
@@ -99,6 +106,8 @@ struct ms_crtc_pageflip {
     Bool on_reference_crtc;
     /* reference to the ms_flipdata */
     struct ms_flipdata *flipdata;
+    xf86CrtcPtr crtc;
+    uint64_t queued_us;
 };
 
 /**
@@ -130,10 +139,15 @@ static void ls_pageflip_handler_cb(uint64_t msc, uint64_t ust, void *data)
     ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
     loongsonPtr lsp = loongsonPTR(pScrn);
 
+    LS_StatsFrameDone(flip->crtc, flip->queued_us, ust);
+
     if (flip->on_reference_crtc)
     {
         flipdata->fe_msc = msc;
         flipdata->fe_usec = ust;
+
+        if (flipdata->target_msc)
+            LS_StatsFrameMsc(flip->crtc, flipdata->target_msc, msc);
     }
 
     if (flipdata->flip_count == 1)
@@ -168,6 +182,29 @@ static void ls_pageflip_abort_cb(void *data)
 
 
 
+/* Longest wait for a cursor plane commit ahead of a flip */
+#define LS_CURSOR_COMMIT_WAIT_MS    50
+
+/*
+ * The cursor plane commit still in flight on this CRTC would make the
+ * flip fail with EBUSY, let its event come in first.
+ */
+static void ls_wait_cursor_commit(loongsonPtr lsp, xf86CrtcPtr crtc)
+{
+    drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+    struct pollfd p = {
+        .fd = lsp->fd,
+        .events = POLLIN
+    };
+
+    while (drmmode_crtc->cursor_move_pending)
+    {
+        if (poll(&p, 1, LS_CURSOR_COMMIT_WAIT_MS) <= 0 ||
+            drmHandleEvent(lsp->fd, &lsp->event_context) < 0)
+            break;
+    }
+}
+
 static Bool do_queue_flip_on_crtc(loongsonPtr lsp,
                                   xf86CrtcPtr crtc,
                                   uint32_t flags,
@@ -215,6 +252,7 @@ static Bool queue_flip_on_crtc(ScreenPtr pScreen,
     flip->on_reference_crtc =
           (drmmode_crtc->vblank_pipe == ref_crtc_vblank_pipe);
     flip->flipdata = flipdata;
+    flip->crtc = crtc;
 
     seq = ms_drm_queue_alloc(crtc,
                              flip,
@@ -229,6 +267,8 @@ static Bool queue_flip_on_crtc(ScreenPtr pScreen,
     /* take a reference on flipdata for use in flip */
     flipdata->flip_count++;
 
+    ls_wait_cursor_commit(lsp, crtc);
+
     while (do_queue_flip_on_crtc(lsp, crtc, flags, seq))
     {
         err = errno;
@@ -249,29 +289,35 @@ static Bool queue_flip_on_crtc(ScreenPtr pScreen,
         xf86DrvMsg(pScrn->scrnIndex, X_WARNING, "flip queue retry\n");
     }
 
+    LS_STATS_STAMP_US(flip->queued_us);
+    LS_StatsFrameQueued(crtc, flipdata->request_us, flip->queued_us);
+
     /* The page flip succeded. */
     return TRUE;
 }
 
 
-Bool ms_do_pageflip(ScreenPtr pScreen,
-                    PixmapPtr pNewFrontPixmap,
-                    void *event,
-                    int ref_crtc_vblank_pipe,
-                    Bool async,
-                    pageflip_handler_cb pHandlerCB,
-                    pageflip_abort_cb pAbortCB,
-                    const char *log_prefix)
+static Bool ls_do_pageflip(ScreenPtr pScreen,
+                           PixmapPtr pNewFrontPixmap,
+                           void *event,
+                           int ref_crtc_vblank_pipe,
+                           Bool async,
+                           pageflip_handler_cb pHandlerCB,
+                           pageflip_abort_cb pAbortCB,
+                           const char *log_prefix,
+                           uint64_t request_us,
+                           uint64_t target_msc)
 {
     ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
     loongsonPtr lsp = loongsonPTR(pScrn);
     struct drmmode_rec * const pDrmMode = &lsp->drmmode;
     xf86CrtcConfigPtr config = XF86_CRTC_CONFIG_PTR(pScrn);
-    struct DrmModeBO front_bo_tmp;
+    struct DrmModeBO front_bo_tmp = { 0 };
     struct DrmModeBO *new_front_bo = &front_bo_tmp;
     uint32_t flags;
     int i;
     struct ms_flipdata *flipdata;
+    LS_STATS_BEGIN(t);
 
     if (pDrmMode->glamor_enabled)
     {
@@ -331,6 +377,12 @@ Bool ms_do_pageflip(ScreenPtr pScreen,
 
         new_front_bo->gbm = NULL;
     }
+    else if (pDrmMode->shadow_flip_enable)
+    {
+        new_front_bo->dumb = LS_ShadowFlipGetBO(pScrn, pNewFrontPixmap);
+        if (new_front_bo->dumb == NULL)
+            return FALSE;
+    }
     else
     {
         return FALSE;
@@ -340,6 +392,7 @@ Bool ms_do_pageflip(ScreenPtr pScreen,
     flipdata = calloc(1, sizeof(struct ms_flipdata));
     if (!flipdata)
     {
+        new_front_bo->dumb = NULL;
         drmmode_bo_destroy(pDrmMode, new_front_bo);
         xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
                    "%s: Failed to allocate flipdata\n", log_prefix);
@@ -350,6 +403,8 @@ Bool ms_do_pageflip(ScreenPtr pScreen,
     flipdata->screen = pScreen;
     flipdata->event_handler = pHandlerCB;
     flipdata->abort_handler = pAbortCB;
+    flipdata->request_us = request_us;
+    flipdata->target_msc = target_msc;
 
     /*
      * Take a local reference on flipdata.
@@ -426,6 +481,10 @@ Bool ms_do_pageflip(ScreenPtr pScreen,
         }
     }
 
+    /* Only a gbm bo is a new reference, a dumb bo still belongs to
+     * the pixmap and must survive this.
+     */
+    new_front_bo->dumb = NULL;
     drmmode_bo_destroy(pDrmMode, new_front_bo);
 
     /*
@@ -441,6 +500,7 @@ Bool ms_do_pageflip(ScreenPtr pScreen,
         xf86DrvMsg(pScrn->scrnIndex, X_INFO, "flip_count=%d\n",
                                      flipdata->flip_count);
 #endif
+        LS_STATS_END(LS_STAT_PAGEFLIP, t, 0);
         return TRUE;
     }
 
@@ -460,6 +520,7 @@ error_undo:
 error_out:
     xf86DrvMsg(pScrn->scrnIndex, X_WARNING, "Page flip failed: %s\n",
                strerror(errno));
+    new_front_bo->dumb = NULL;
     drmmode_bo_destroy(pDrmMode, new_front_bo);
     /* if only the local reference - free the structure,
      * else drop the local reference and return */
@@ -470,3 +531,29 @@ error_out:
 
     return FALSE;
 }
+
+Bool ms_do_pageflip(ScreenPtr pScreen,
+                    PixmapPtr pNewFrontPixmap,
+                    void *event,
+                    int ref_crtc_vblank_pipe,
+                    Bool async,
+                    pageflip_handler_cb pHandlerCB,
+                    pageflip_abort_cb pAbortCB,
+                    const char *log_prefix,
+                    uint64_t request_us,
+                    uint64_t target_msc)
+{
+    Bool ret;
+
+    LS_PROBE3(pageflip_entry, ref_crtc_vblank_pipe, async,
+              pNewFrontPixmap->devKind * pNewFrontPixmap->drawable.height);
+
+    ret = ls_do_pageflip(pScreen, pNewFrontPixmap, event,
+                         ref_crtc_vblank_pipe, async,
+                         pHandlerCB, pAbortCB, log_prefix, request_us,
+                         target_msc);
+
+    LS_PROBE1(pageflip_return, ret);
+
+    return ret;
+}
@@ -40,6 +40,7 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <time.h>
+#include <drm_fourcc.h>
 
 #include <xf86.h>
 #include <xf86Crtc.h>
@@ -52,12 +53,18 @@
 #include "vblank.h"
 #include "drmmode_display.h"
 #include "loongson_scanout.h"
+#include "loongson_pixmap.h"
 #include "loongson_debug.h"
+#include "loongson_stats.h"
+#include "loongson_usdt.h"
 
 
 struct ms_present_vblank_event {
     uint64_t event_id;
     Bool unflip;
+    /* for the missed MSC stats of queued vblanks */
+    xf86CrtcPtr crtc;
+    uint64_t target_msc;
 };
 
 
@@ -182,6 +189,8 @@ static void ms_present_vblank_handler(uint64_t msc, uint64_t usec, void *data)
                  (long long) event->event_id,
                  (long long) msc);
 
+    LS_StatsFrameMsc(event->crtc, event->target_msc, msc);
+
     present_event_notify(event->event_id, usec, msc);
     free(event);
 }
@@ -213,6 +222,8 @@ static int ms_present_queue_vblank(RRCrtcPtr crtc, uint64_t event_id,
     if (!event)
         return BadAlloc;
     event->event_id = event_id;
+    event->crtc = xf86_crtc;
+    event->target_msc = msc;
     seq = ms_drm_queue_alloc(xf86_crtc, event,
                              ms_present_vblank_handler,
                              ms_present_vblank_abort);
@@ -308,42 +319,44 @@ static void ms_present_flip_abort(loongsonPtr ms, void *data)
     free(event);
 }
 
+/* The format an EXA pixmap of this depth gets scanned out as */
+static uint32_t ls_present_exa_format(PixmapPtr pixmap)
+{
+    switch (pixmap->drawable.depth)
+    {
+    case 16:
+        return DRM_FORMAT_RGB565;
+    case 30:
+        return DRM_FORMAT_XRGB2101010;
+    case 24:
+    case 32:
+        return DRM_FORMAT_XRGB8888;
+    default:
+        return 0;
+    }
+}
+
 /*
- * Test to see if page flipping is possible on the target crtc
- *
- * We ignore sw-cursors when *disabling* flipping, we may very well be
- * returning to scanning out the normal framebuffer *because* we just
- * switched to sw-cursor mode and check_flip just failed because of that.
+ * The part of the flip checks which only depends on the pixmap and on the
+ * CRTC configuration, this is what ls_present_check_flip_cached() caches.
  */
-static Bool ms_present_check_unflip(RRCrtcPtr crtc,
-                                    WindowPtr window,
-                                    PixmapPtr pixmap,
-                                    Bool sync_flip,
-                                    PresentFlipReason *reason)
+static Bool ls_present_check_flip_uncached(ScrnInfoPtr pScrn,
+                                           PixmapPtr pixmap,
+                                           PresentFlipReason *reason)
 {
-    ScreenPtr pScreen = window->drawable.pScreen;
-    ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+    ScreenPtr pScreen = pixmap->drawable.pScreen;
     loongsonPtr ms = loongsonPTR(pScrn);
     struct drmmode_rec * const pDrmMode = &ms->drmmode;
     xf86CrtcConfigPtr config = XF86_CRTC_CONFIG_PTR(pScrn);
     int num_crtcs_on = 0;
     int i;
 
-    if (pDrmMode->pageflip == FALSE)
-        return FALSE;
-
-    if (pDrmMode->dri2_flipping)
-        return FALSE;
-
-    if (!pScrn->vtSema)
-        return FALSE;
-
     for (i = 0; i < config->num_crtc; i++)
     {
         drmmode_crtc_private_ptr drmmode_crtc = config->crtc[i]->driver_private;
 
         /* Don't do pageflipping if CRTCs are rotated. */
-        if (drmmode_crtc->rotate_bo->gbm)
+        if (drmmode_crtc->rotate_bo)
         {
             INFO_MSG("Don't do pageflipping because of CRTCs are rotated");
             return FALSE;
@@ -400,17 +413,100 @@ static Bool ms_present_check_unflip(RRCrtcPtr crtc,
     }
 #endif
 
+    /* A tiled DRI3 import must not be scanned out as if it were linear */
+    if (pDrmMode->exa_enabled)
+    {
+        struct exa_pixmap_priv *priv = exaGetPixmapDriverPrivate(pixmap);
+
+        if (priv &&
+            !drmmode_is_format_supported(pScrn, ls_present_exa_format(pixmap),
+                                         priv->modifier))
+        {
+            if (reason)
+                *reason = PRESENT_FLIP_REASON_BUFFER_FORMAT;
+            return FALSE;
+        }
+    }
+
     /* Make sure there's a bo we can get to */
     /* XXX: actually do this.  also...is it sufficient?
      * if (!glamor_get_pixmap_private(pixmap))
      *     return FALSE;
      */
 
-    TRACE_EXIT();
-
     return TRUE;
 }
 
+/*
+ * Present asks the same question for the same pixmap on every frame of
+ * a fullscreen client, while the answer only changes when the pixmap
+ * does (a new serial number) or when the CRTC configuration does, which
+ * includes rotation as that is applied by drmmode_set_mode_major().
+ */
+static Bool ls_present_check_flip_cached(ScrnInfoPtr pScrn,
+                                         PixmapPtr pixmap,
+                                         PresentFlipReason *reason)
+{
+    loongsonPtr lsp = loongsonPTR(pScrn);
+    struct drmmode_rec * const pDrmMode = &lsp->drmmode;
+    unsigned long serial = pixmap->drawable.serialNumber;
+    struct drmmode_flip_verdict *pVerdict;
+    PresentFlipReason new_reason = PRESENT_FLIP_REASON_UNKNOWN;
+
+    pVerdict = &pDrmMode->flip_cache[serial % DRMMODE_FLIP_CACHE_SIZE];
+
+    if ((pVerdict->serial == serial) &&
+        (pVerdict->crtc_gen == pDrmMode->crtc_config_gen))
+    {
+        if ((pVerdict->can_flip == FALSE) && reason)
+            *reason = pVerdict->reason;
+
+        return pVerdict->can_flip;
+    }
+
+    pVerdict->can_flip = ls_present_check_flip_uncached(pScrn,
+                                                        pixmap,
+                                                        &new_reason);
+    pVerdict->reason = new_reason;
+    pVerdict->serial = serial;
+    pVerdict->crtc_gen = pDrmMode->crtc_config_gen;
+
+    if ((pVerdict->can_flip == FALSE) && reason)
+        *reason = new_reason;
+
+    return pVerdict->can_flip;
+}
+
+/*
+ * Test to see if page flipping is possible on the target crtc
+ *
+ * We ignore sw-cursors when *disabling* flipping, we may very well be
+ * returning to scanning out the normal framebuffer *because* we just
+ * switched to sw-cursor mode and check_flip just failed because of that.
+ */
+static Bool ms_present_check_unflip(RRCrtcPtr crtc,
+                                    WindowPtr window,
+                                    PixmapPtr pixmap,
+                                    Bool sync_flip,
+                                    PresentFlipReason *reason)
+{
+    ScreenPtr pScreen = window->drawable.pScreen;
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+    loongsonPtr ms = loongsonPTR(pScrn);
+    struct drmmode_rec * const pDrmMode = &ms->drmmode;
+
+    if (pDrmMode->pageflip == FALSE)
+        return FALSE;
+
+    if (pDrmMode->dri2_flipping)
+        return FALSE;
+
+    if (!pScrn->vtSema)
+        return FALSE;
+
+    return ls_present_check_flip_cached(pScrn, pixmap, reason);
+}
+
 
 /*
  * Same as 'check_flip' but it can return a 'reason' why the flip would fail.
@@ -432,7 +528,14 @@ static Bool ls_present_check_flip(RRCrtcPtr crtc,
         return FALSE;
     }
 
-    return ms_present_check_unflip(crtc, window, pixmap, sync_flip, reason);
+    if (!ms_present_check_unflip(crtc, window, pixmap, sync_flip, reason))
+        return FALSE;
+
+    /* Present checks again right before flipping, so this is fresh */
+    if (window != pScreen->root)
+        pDrmMode->flip_window = window->drawable.id;
+
+    return TRUE;
 }
 
 /*
@@ -448,23 +551,28 @@ static Bool ls_present_check_flip(RRCrtcPtr crtc,
  *
  * present_event_notify should be called with 'event_id'
  * when the flip occurs
+ *
+ * There is no mailbox mode. Present never passes a flip while another
+ * one is pending on the screen and drops replaced frames itself, so the
+ * driver has nothing to park or replace.
  */
 
-static Bool ls_present_flip(RRCrtcPtr crtc,
-                            uint64_t event_id,
-                            uint64_t target_msc,
-                            PixmapPtr pixmap,
-                            Bool sync_flip)
+static Bool ls_present_do_flip(RRCrtcPtr crtc,
+                               uint64_t event_id,
+                               uint64_t target_msc,
+                               PixmapPtr pixmap,
+                               Bool sync_flip,
+                               uint64_t request_us)
 {
     ScreenPtr screen = crtc->pScreen;
     ScrnInfoPtr pScrn = xf86ScreenToScrn(screen);
     loongsonPtr ls = loongsonPTR(pScrn);
     struct drmmode_rec * const pDrmMode = &ls->drmmode;
-
     xf86CrtcPtr xf86_crtc = crtc->devPrivate;
     drmmode_crtc_private_ptr drmmode_crtc = xf86_crtc->driver_private;
-    Bool ret;
     struct ms_present_vblank_event *event;
+    WindowPtr window = NULL;
+    Bool ret;
 
     ret = ls_present_check_flip(crtc, screen->root, pixmap, sync_flip, NULL);
     if (ret == FALSE)
@@ -475,6 +583,16 @@ static Bool ls_present_flip(RRCrtcPtr crtc,
         return FALSE;
     }
 
+    /*
+     * The flipping window covers the whole screen, if it asks for
+     * variable refresh the crtcs can present as soon as frames arrive.
+     */
+    if (pDrmMode->flip_window != None)
+        dixLookupWindow(&window, pDrmMode->flip_window,
+                        serverClient, DixReadAccess);
+
+    drmmode_set_window_vrr(pScrn, window);
+
     event = calloc(1, sizeof(struct ms_present_vblank_event));
     if (!event)
         return FALSE;
@@ -486,13 +604,33 @@ static Bool ls_present_flip(RRCrtcPtr crtc,
                          !sync_flip,
                          ms_present_flip_handler,
                          ms_present_flip_abort,
-                         "Present-flip");
+                         "Present-flip", request_us, target_msc);
     if (ret == TRUE)
         pDrmMode->present_flipping = TRUE;
 
     return ret;
 }
 
+static Bool ls_present_flip(RRCrtcPtr crtc,
+                            uint64_t event_id,
+                            uint64_t target_msc,
+                            PixmapPtr pixmap,
+                            Bool sync_flip)
+{
+    uint64_t request_us = LS_STATS_NOW_US();
+    Bool ret;
+
+    LS_PROBE3(present_flip_entry, target_msc, sync_flip,
+              pixmap->devKind * pixmap->drawable.height);
+
+    ret = ls_present_do_flip(crtc, event_id, target_msc, pixmap, sync_flip,
+                             request_us);
+
+    LS_PROBE1(present_flip_return, ret);
+
+    return ret;
+}
+
 /*
  * Queue a flip back to the normal frame buffer
  */
@@ -518,6 +656,9 @@ static void ls_present_unflip(ScreenPtr pScreen, uint64_t event_id)
     event->event_id = event_id;
     event->unflip = TRUE;
 
+    pDrmMode->flip_window = None;
+    drmmode_set_screen_vrr(pScrn, FALSE);
+
     ret = ms_present_check_unflip(NULL, pScreen->root, pixmap, TRUE, NULL);
     if (ret == TRUE)
     {
@@ -526,7 +667,7 @@ static void ls_present_unflip(ScreenPtr pScreen, uint64_t event_id)
         {
             ret = ms_do_pageflip(pScreen, pixmap, event, -1, FALSE,
                        ms_present_flip_handler, ms_present_flip_abort,
-                       "Present-unflip");
+                       "Present-unflip", LS_STATS_NOW_US(), 0);
             if (ret)
                 return;
         }
@@ -16,8 +16,6 @@ typedef void (*ms_drm_handler_proc)(uint64_t frame,
 typedef void (*ms_drm_abort_proc)(void *data);
 
 
-#ifdef GLAMOR_HAS_GBM
-
 typedef void (*pageflip_handler_cb)(struct LoongsonRec *lsp,
                                     uint64_t frame,
                                     uint64_t usec,
@@ -33,9 +31,9 @@ Bool ms_do_pageflip(ScreenPtr screen,
                     Bool async,
                     pageflip_handler_cb pHandlerCB,
                     pageflip_abort_cb pAbortCB,
-                    const char *log_prefix);
-
-#endif
+                    const char *log_prefix,
+                    uint64_t request_us,
+                    uint64_t target_msc);
 
 /**
  * A tracked handler for an event that will hopefully be generated